@@ -7,6 +7,36 @@
 
 #include "Scheduler.hpp"
 #include <unordered_map>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <cmath>
+#include <algorithm>
+
+/* Name of this scheduler in its decision trace */
+#define SCHED_NAME "BRR"
+
+/* SHARED BEGIN logging */
+/* Scheduler logging. SCHED_LOG(level, message) only evaluates message, and so only builds the
+   string, when level is within both SCHED_LOG_MAX (compile time, -DSCHED_LOG_MAX=0 compiles every
+   message above 0 out) and schedLogLevel (runtime, taken from the SCHED_VERBOSE environment
+   variable). Both default to 4, which passes everything on to SimOutput as before */
+#ifndef SCHED_LOG_MAX
+#define SCHED_LOG_MAX 4
+#endif
+#define SCHED_LOG(level, message) \
+    do { \
+        if((level) <= SCHED_LOG_MAX && (level) <= schedLogLevel) { \
+            SimOutput((message), (level)); \
+        } \
+    } while(0)
+
+int initLogLevel(); 
+int schedLogLevel = initLogLevel(); 
+/* SHARED END logging */
 
 static bool migrating = false;
 static unsigned total_machines;
@@ -20,27 +50,273 @@ vector<MachineId_t> armMachines;
 vector<MachineId_t> powerMachines;
 vector<MachineId_t> riscvMachines;
 
-vector<unsigned> x86Tasks; 
-vector<unsigned> armTasks;
-vector<unsigned> powerTasks;
-vector<unsigned> riscvTasks; 
-
-int x86QuarterSize; 
-int armQuarterSize; 
-int powerQuarterSize; 
-int riscvQuarterSize; 
-
-unsigned x86ActiveQuarter = 1; 
-unsigned armActiveQuarter = 1; 
-unsigned powerActiveQuarter = 1; 
-unsigned riscvActiveQuarter = 1;
+/* Accounting table indexed directly by MachineId_t, sized once in Init */
+vector<unsigned> numTasks; 
+vector<unsigned> mipsDemand;    // taskMips of the machine's tasks
+
+/* Standby ladder, one per CPU type. The type's machines, in energy-efficiency order, are cut into
+   groups sized by ladderShare. The first activeGroups groups run in S0 and take work; the group
+   above them waits in S1, the next one in S3 and the rest in S5. A group is promoted when the
+   active ones run hot or when warnings pile up past checkTreshold. Once the load would fit in
+   one group less for ladderHold, the top group stops taking work and is demoted when it drains */
+#define LADDER_GROUPS 4
+typedef struct {
+    vector<MachineId_t> *machines; 
+    vector<unsigned> groupEnd;      // group k is machines[groupEnd[k-1], groupEnd[k])
+    vector<unsigned> groupCores; 
+    unsigned activeGroups; 
+    unsigned activeCores; 
+    unsigned tasks; 
+    bool draining;                  // top active group takes no new work until it empties
+    Time_t lastChange; 
+    Time_t quietSince;              // 0 while the load needs every active group
+} Ladder_t;
+
+Ladder_t ladders[4];    // indexed by CPUType_t
+double ladderShare[LADDER_GROUPS] = {0.25, 0.25, 0.25, 0.25}; 
+MachineState_t ladderStandby[] = {S1, S3, S5}; 
+double ladderHigh = 0.9;        // tasks per active core that wakes the next group
+double ladderLow = 0.4;         // tasks per core, without the top group, under which it drains
+Time_t ladderHold = 2000000; 
+vector<MachineState_t> requestedState; 
+
+void ladderInit(Ladder_t *ladder, vector<MachineId_t> *machines);
+MachineState_t ladderTarget(const Ladder_t *ladder, unsigned group);
+void ladderApply(Ladder_t *ladder, uint8_t reason);
+unsigned ladderServing(const Ladder_t *ladder);
+void ladderPromote(Ladder_t *ladder, Time_t now, uint8_t reason);
+void ladderCheck(Ladder_t *ladder, Time_t now);
 
 std::unordered_map<MachineId_t, vector<VMId_t>> vmMap;
 std::unordered_map<TaskId_t, MachineId_t> taskMap;
+std::unordered_map<TaskId_t, VMId_t> taskToVM;
+vector<unsigned> vmTasks;   // tasks on each VM, indexed by VMId_t
+
+/* Warm VM pool. A VM whose work is done stays attached to its machine in
+   warmVMs[machine * NUM_VM_TYPES + type] and goes to the next task of that type placed there,
+   so arrivals skip VM_Create/VM_Attach. VMs left idle for vmIdleLimit are shut down from
+   SchedulerCheck, oldest first */
+#define NUM_VM_TYPES 4
+vector<vector<VMId_t>> warmVMs; 
+std::deque<std::pair<Time_t, VMId_t>> idleVMs;     // in release order
+vector<MachineId_t> vmHost;     // per-VM entries below are indexed by VMId_t
+vector<VMType_t> vmType; 
+vector<Time_t> vmIdleSince; 
+vector<bool> vmIdle; 
+vector<bool> vmLive; 
+Time_t vmIdleLimit = 5000000; 
+
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu);
+void releaseVM(VMId_t vid, Time_t now);
+void reclaimIdleVMs(Time_t now);
+void shutdownVMs();
+void trackVM(VMId_t vid);
 
 unsigned checkTreshold = 1000; 
 unsigned checks = 0; 
 
+/* SHARED BEGIN latency */
+/* Scheduler overhead: wall time spent in each entry point, recorded by a CallbackTimer at the top
+   of the callback into a log-linear histogram (every power of two of nanoseconds split into 8
+   linear buckets, so a percentile is within 12.5%) and reported from SimulationComplete */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+typedef struct {
+    const char *name; 
+    uint64_t count = 0; 
+    uint64_t total = 0; 
+    uint64_t max = 0; 
+    uint64_t buckets[HIST_BUCKETS] = {}; 
+} LatencyHist_t;
+
+enum { CB_INIT, CB_NEW_TASK, CB_TASK_COMPLETE, CB_MEMORY_WARNING, CB_SLA_WARNING, CB_MIGRATION_DONE, 
+       CB_SCHEDULER_CHECK, CB_STATE_CHANGE, CB_COUNT };
+LatencyHist_t callbackLatency[CB_COUNT] = {
+    {"InitScheduler"}, {"HandleNewTask"}, {"HandleTaskCompletion"}, {"MemoryWarning"}, {"SLAWarning"}, 
+    {"MigrationDone"}, {"SchedulerCheck"}, {"StateChangeComplete"}
+};
+
+void histRecord(LatencyHist_t *hist, uint64_t ns);
+uint64_t histPercentile(const LatencyHist_t *hist, double q);
+void reportLatency();
+
+struct CallbackTimer {
+    unsigned which; 
+    std::chrono::steady_clock::time_point start; 
+    CallbackTimer(unsigned which) : which(which), start(std::chrono::steady_clock::now()) {}
+    ~CallbackTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start; 
+        histRecord(&callbackLatency[which], std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()); 
+    }
+};
+/* SHARED END latency */
+
+/* SHARED BEGIN trace */
+/* Decision trace. With SCHED_TRACE=<file> set, every placement, migration, VM attach/shutdown,
+   power-state and P-state request is appended to <file> as a fixed 32-byte record behind a
+   32-byte header, through a buffer flushed every TRACE_BUFFER records and at the end of the run.
+   Tools/trace_reader.cpp prints and diffs these files. Without SCHED_TRACE, traceDecision
+   returns at once */
+#define TRACE_VERSION 1
+#define TRACE_BUFFER 4096
+#define TRACE_NONE UINT32_MAX
+typedef struct {
+    char magic[8];          // "SCHTRACE"
+    uint32_t version; 
+    uint32_t recordSize; 
+    char algorithm[16]; 
+} TraceHeader_t;
+
+typedef struct {
+    uint64_t time; 
+    uint32_t machine; 
+    uint32_t vm; 
+    uint32_t task; 
+    uint32_t arg;           // S-state or P-state requested, VM type, or migration source machine
+    uint8_t kind; 
+    uint8_t reason; 
+    uint8_t reserved[6]; 
+} TraceRecord_t;
+static_assert(sizeof(TraceRecord_t) == 32, "trace records are 32 bytes"); 
+
+enum { TRACE_PLACE, TRACE_MIGRATE, TRACE_SET_STATE, TRACE_SET_PERF, TRACE_VM_ATTACH, TRACE_VM_SHUTDOWN };
+enum { REASON_INIT, REASON_PLACE, REASON_FALLBACK, REASON_MEMORY_WARNING, REASON_SLA_WARNING, REASON_CONSOLIDATE, 
+       REASON_IDLE, REASON_DEMAND, REASON_GOVERNOR, REASON_RECLAIM, REASON_SHUTDOWN, REASON_FORECAST, REASON_SLACK };
+
+FILE *traceFile = NULL; 
+TraceRecord_t traceBuffer[TRACE_BUFFER]; 
+unsigned traceCount = 0; 
+Time_t currentTime = 0;     // time of the callback being handled
+
+void openTrace();
+void closeTrace();
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg);
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason);
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason);
+/* SHARED END trace */
+
+/* SHARED BEGIN catalog */
+/* Machine catalog: static attributes cached once in Init so the hot paths never copy
+   MachineInfo_t. Only s_state and p_state change at runtime; s_state is refreshed from
+   StateChangeComplete and p_state is recorded by setMachinePerformance */
+#define NUM_P_STATES 4
+#define NUM_S_STATES 7
+vector<CPUType_t> catalogCpu;
+vector<unsigned> catalogNumCpus;
+vector<unsigned> catalogMemory;
+vector<bool> catalogGpus;
+vector<unsigned> catalogPerformance;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogPStatePower;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogSStatePower;    // NUM_S_STATES entries per machine, 0 when not reported
+vector<MachineState_t> catalogSState;
+vector<CPUPerformance_t> catalogPState;
+
+void buildCatalog();
+unsigned machinePerformance(MachineId_t mid, unsigned p_state);
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state);
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state);
+/* SHARED END catalog */
+
+/* SHARED BEGIN demand */
+/* MIPS demand model. A task has to retire total_instructions between its arrival and its target
+   completion, so it needs total / (target - arrival) MIPS on average; demandMargin pads that for
+   time lost to sharing a core or to a migration. Every MIPS charge and load figure counts tasks by
+   this demand. A task without a window is charged the flat 1000 MIPS the accounting used before */
+double demandMargin = 1.25; 
+
+unsigned taskMips(const TaskInfo_t &info);
+/* SHARED END demand */
+
+/* SHARED BEGIN gpu */
+/* GPU routing. A GPU-capable task runs gpuSpeedup times faster on a GPU host, so it tries the GPU
+   hosts of its type first. It is still charged its full demand there: it holds a core share for as
+   long as it runs, it just runs for less time. While GPU-capable work is at least gpuReserveShare
+   of a type's arrivals (an EWMA with weight gpuAlpha), tasks that cannot use a GPU take that
+   type's GPU hosts last, keeping them for the work that finishes faster there */
+double gpuSpeedup = 2.0; 
+double gpuAlpha = 0.05; 
+double gpuReserveShare = 0.1; 
+double gpuShare[4];             // GPU-capable share of each CPU type's arrivals
+
+void gpuArrival(const TaskInfo_t &info);
+bool gpuReserved(CPUType_t cpu);
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid);
+/* SHARED END gpu */
+
+/* SHARED BEGIN sla */
+/* SLA tiers. A task of class c only goes where its host stays under slaTarget[c] of its P0
+   capacity once the task is on it, and the headroom that leaves is held back from later tasks
+   for as long as the class has work there. SLA0 and SLA1 start with room in reserve and keep
+   their hosts at P0; SLA2 and SLA3 pack the most efficient hosts full, which can then stay slow.
+   The targets follow GetSLAReport: every slaAdaptInterval the share of each class's tasks that
+   missed since the last look is held against slaGoal, and the target steps toward more headroom
+   when over it and toward denser packing when well under it */
+double slaTarget[4] = {0.6, 0.75, 1.0, 1.0};   // highest host utilization a task of the class accepts
+double slaGoal[4] = {5, 10, 20, 100};           // % of the class's tasks allowed to miss
+double slaStep = 0.05; 
+double slaTargetFloor = 0.3; 
+unsigned slaMinSamples = 20;    // completions needed before a class's target moves
+Time_t slaAdaptInterval = 10000000; 
+Time_t slaLastAdapt = 0; 
+unsigned slaCompleted[4];       // completions seen by TaskComplete
+unsigned slaSeenCompleted[4];   // and the completions and misses at the last adaptation
+double slaSeenMissed[4]; 
+double slaCapacity[4];          // average P0 MIPS of a machine of each type
+vector<unsigned> slaHosted;     // tasks of each class on each machine, 4 entries per machine
+
+void slaInit();
+void slaHost(MachineId_t mid, SLAType_t sla, int count);
+bool slaPinned(MachineId_t mid);
+unsigned slaReserve(MachineId_t mid);
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips);
+bool slaAdapt(Time_t now);
+/* SHARED END sla */
+
+/* SHARED BEGIN forecast */
+/* Arrival forecaster, one per CPU type. Arrivals are counted per forecastInterval and each closed
+   interval feeds an EWMA of the arrival rate, or a Holt-Winters model (level, trend and
+   forecastSeasons seasonal slots) when forecastSeasons is set. Lifetimes and memory per task are
+   smoothed as tasks come and go, so by Little's law the tasks in flight one wake-up from now are
+   rate x lifetime. The wake-up time is measured per type from S0 requests to their
+   StateChangeComplete, forecastLead until the first one lands */
+#define FORECAST_MAX_SEASONS 64
+typedef struct {
+    Time_t intervalStart; 
+    unsigned arrivals;          // in the open interval
+    double level;               // arrivals per interval
+    double trend; 
+    double season[FORECAST_MAX_SEASONS]; 
+    unsigned slot;              // seasonal slot of the open interval
+    double lifetime;            // us from arrival to completion
+    double memory;              // MB per task
+    bool primed; 
+} Forecast_t;
+
+Forecast_t forecasts[4];        // indexed by CPUType_t
+Time_t forecastInterval = 1000000; 
+unsigned forecastSeasons = 0;   // 0 keeps the plain EWMA
+double forecastAlpha = 0.3; 
+double forecastBeta = 0.1; 
+double forecastGamma = 0.2; 
+double forecastHeadroom = 1.2; 
+Time_t forecastLead = 1000000; 
+double wakeLatency[4]; 
+vector<Time_t> wakeRequested;   // time of the pending S0 request, NO_WAKE when none
+double forecastCores[4];        // average cores and memory of a machine of each type
+double forecastMemory[4]; 
+#define NO_WAKE UINT64_MAX
+
+void forecastInit();
+void forecastAdvance(Time_t now);
+void forecastArrival(CPUType_t cpu, const TaskInfo_t &info, Time_t now);
+void forecastCompletion(CPUType_t cpu, const TaskInfo_t &info, Time_t now);
+double forecastRate(const Forecast_t *f, unsigned ahead);
+double forecastTasks(CPUType_t cpu);
+unsigned forecastMachines(CPUType_t cpu);
+void forecastWakeStart(MachineId_t mid);
+void forecastWakeDone(MachineId_t mid, Time_t now);
+/* SHARED END forecast */
+
 unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id);
 
 void Scheduler::Init() {
@@ -52,168 +328,44 @@ void Scheduler::Init() {
     //      Get the number of CPUs
     //      Get if there is a GPU or not
     // 
-    SimOutput("Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()), 0);
-    SimOutput("Scheduler::Init(): Initializing scheduler", 1);
+    SCHED_LOG(0, "Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()));
+    SCHED_LOG(1, "Scheduler::Init(): Initializing scheduler");
     total_machines = Machine_GetTotal(); 
+    buildCatalog(); 
+    forecastInit(); 
+    slaInit(); 
+    warmVMs.resize(Machine_GetTotal() * NUM_VM_TYPES); 
+    numTasks.assign(total_machines, 0); 
+    mipsDemand.assign(total_machines, 0); 
 
     /* Find the number of each machine available */
     for(unsigned i = 0; i < total_machines; i++) {
-        switch (Machine_GetCPUType(MachineId_t(i))) {
+        switch (catalogCpu[MachineId_t(i)]) {
             case X86:
                 numX86Machines++; 
-                x86Tasks.insert(x86Tasks.begin() + insert_sorted_ee(&x86Machines, i), 0);
+                insert_sorted_ee(&x86Machines, i); 
                 break; 
             case ARM:
                 numArmMachines++; 
-                armTasks.insert(armTasks.begin() + insert_sorted_ee(&armMachines, i), 0);  
+                insert_sorted_ee(&armMachines, i); 
                 break; 
             case POWER:
                 numPowerMachines++;
-                powerTasks.insert(powerTasks.begin() + insert_sorted_ee(&powerMachines, i), 0); 
+                insert_sorted_ee(&powerMachines, i); 
                 break; 
             default:
                 numRiscvMachines++;
-                riscvTasks.insert(riscvTasks.begin() + insert_sorted_ee(&riscvMachines, i), 0);  
+                insert_sorted_ee(&riscvMachines, i); 
                 break; 
         }
     }
 
-    if(x86Machines.size() >= 4) {
-        x86QuarterSize = x86Machines.size() / 4;
-    } else {
-        x86QuarterSize = -1; 
-    }
-
-    if(armMachines.size() >= 4) {
-        armQuarterSize = armMachines.size() / 4;
-    } else {
-        armQuarterSize = -1; 
-    }
-
-    if(powerMachines.size() >= 4) {
-        powerQuarterSize = powerMachines.size() / 4;
-    } else {
-        powerQuarterSize = -1; 
-    }
-
-    if(riscvMachines.size() >= 4) {
-        riscvQuarterSize = riscvMachines.size() / 4;
-    } else {
-        riscvQuarterSize = -1; 
-    }
-
-    /* Turn on a quarter of all machine types, for the others turn them off*/
-    if(x86QuarterSize == -1) {
-        for(int i = 0; i < x86Machines.size(); i++) {
-            Machine_SetState(x86Machines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-            }
-        }
-    } else {
-        for(int i = 0; i < x86QuarterSize; i++) {
-            Machine_SetState(x86Machines.at(i), S0);
-            for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-            }
-        }
-
-        for(int i = x86QuarterSize; i < 2 * x86QuarterSize; i++) {
-            Machine_SetState(x86Machines.at(i), S1); 
-        }
-
-        for(int i = 2 * x86QuarterSize; i < 3 * x86QuarterSize; i++) {
-            Machine_SetState(x86Machines.at(i), S3); 
-        }
-
-        for(int i = 3 * x86QuarterSize; i < x86Machines.size(); i++) {
-            Machine_SetState(x86Machines.at(i), S5); 
-        }
-    }
-
-    if(armQuarterSize == -1) {
-        for(int i = 0; i < armMachines.size(); i++) {
-            Machine_SetState(armMachines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-            }
-        }
-    } else {
-        for(int i = 0; i < armQuarterSize; i++) {
-            Machine_SetState(armMachines.at(i), S0);
-            for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-            }
-        }
-
-        for(int i = armQuarterSize; i < 2 * armQuarterSize; i++) {
-            Machine_SetState(armMachines.at(i), S1); 
-        }
-
-        for(int i = 2 * armQuarterSize; i < 3 * armQuarterSize; i++) {
-            Machine_SetState(armMachines.at(i), S3); 
-        }
-
-        for(int i = 3 * armQuarterSize; i < armMachines.size(); i++) {
-            Machine_SetState(armMachines.at(i), S5); 
-        }
-    }
-
-    if(powerQuarterSize == -1) {
-        for(int i = 0; i < powerMachines.size(); i++) {
-            Machine_SetState(powerMachines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-            }
-        }
-    } else {
-        for(int i = 0; i < powerQuarterSize; i++) {
-            Machine_SetState(powerMachines.at(i), S0);
-            for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-            }
-        }
-
-        for(int i = powerQuarterSize; i < 2 * powerQuarterSize; i++) {
-            Machine_SetState(powerMachines.at(i), S1); 
-        }
-
-        for(int i = 2 * powerQuarterSize; i < 3 * powerQuarterSize; i++) {
-            Machine_SetState(powerMachines.at(i), S3); 
-        }
-
-        for(int i = 3 * powerQuarterSize; i < powerMachines.size(); i++) {
-            Machine_SetState(powerMachines.at(i), S5); 
-        }
-    }
-
-    if(riscvQuarterSize == -1) {
-        for(int i = 0; i < riscvMachines.size(); i++) {
-            Machine_SetState(riscvMachines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-            }
-        }
-    } else {
-        for(int i = 0; i < riscvQuarterSize; i++) {
-            Machine_SetState(riscvMachines.at(i), S0);
-            for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-            }
-        }
-
-        for(int i = riscvQuarterSize; i < 2 * riscvQuarterSize; i++) {
-            Machine_SetState(riscvMachines.at(i), S1); 
-        }
-
-        for(int i = 2 * riscvQuarterSize; i < 3 * riscvQuarterSize; i++) {
-            Machine_SetState(riscvMachines.at(i), S3); 
-        }
-
-        for(int i = 3 * riscvQuarterSize; i < riscvMachines.size(); i++) {
-            Machine_SetState(riscvMachines.at(i), S5); 
-        }
-    }
+    /* Wake the first group of every type and stagger the rest down the ladder */
+    requestedState.assign(total_machines, S0i1);    // nothing requested yet
+    ladderInit(&ladders[X86], &x86Machines); 
+    ladderInit(&ladders[ARM], &armMachines); 
+    ladderInit(&ladders[POWER], &powerMachines); 
+    ladderInit(&ladders[RISCV], &riscvMachines); 
 }
 
 void Scheduler::MigrationComplete(Time_t time, VMId_t vm_id) {
@@ -241,93 +393,75 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
 
     TaskInfo_t info = GetTaskInfo (task_id); 
     CPUType_t cpu = info.required_cpu; 
-    VMType_t os = info.required_vm; 
 
-    SimOutput("Handling task " + to_string(task_id), 1); 
+    SCHED_LOG(1, "Handling task " + to_string(task_id)); 
     checks++; 
-
-    /* Figure out which list of machines to use */
-    vector<MachineId_t> list;
-    vector<unsigned> *taskList; 
-    int quarter; 
-    int quarterSize; 
-    switch (cpu) {
-        case X86:
-            list = x86Machines;
-            taskList = &x86Tasks; 
-            quarter = x86ActiveQuarter; 
-            quarterSize = x86QuarterSize;  
-            break; 
-        case ARM:
-            list = armMachines; 
-            taskList = &armTasks; 
-            quarter = armActiveQuarter; 
-            quarterSize = armQuarterSize; 
-            break;
-        case POWER:
-            list = powerMachines; 
-            taskList = &powerTasks; 
-            quarter = powerActiveQuarter; 
-            quarterSize = powerQuarterSize; 
-            break;
-        default:
-            list = riscvMachines; 
-            taskList = &riscvTasks; 
-            quarter = riscvActiveQuarter; 
-            quarterSize = riscvQuarterSize; 
-            break;
-    }
-
-    /* Go through the list and find the machine with the fewest tasks */
-    uint32_t fewest = INT32_MAX;
-    MachineId_t fewestIndex = 0;
-    if(quarterSize != -1) {
-        for(int i = 0; i < quarter * quarterSize; i++) {
-            if((*taskList).at(i) < fewest && Machine_GetInfo(list.at(i)).s_state == S0) {
-                fewest = (*taskList).at(i); 
-                fewestIndex = i;
-            }
+    forecastArrival(cpu, info, now); 
+    gpuArrival(info); 
+
+    /* Figure out which ladder to use */
+    Ladder_t *ladder = &ladders[cpu]; 
+    vector<MachineId_t> *list = ladder->machines; 
+
+    /* Go through the groups taking work and find the machine with the least demand on it, and the
+       first one in efficiency order with room for the task beyond its SLA reserve. SLA0/SLA1 take
+       the least loaded machine; SLA2/SLA3 pack into the first one with room. Both picks are made
+       twice, over every machine and over the hosts gpuPreferred puts first, and the second wins
+       when it has room for the task */
+    SLAType_t sla = info.required_sla; 
+    unsigned mips = taskMips(info); 
+    uint32_t fewest[2] = {INT32_MAX, INT32_MAX};
+    int fewestIndex[2] = {0, -1};
+    bool fewestFits[2] = {false, false}; 
+    int packIndex[2] = {-1, -1}; 
+    unsigned serving = ladderServing(ladder); 
+    for(int i = 0; i < serving; i++) {
+        MachineId_t curr = (*list).at(i); 
+        if(catalogSState[curr] != S0) {
+            continue; 
         }
-    } else {
-        for(int i = 0; i < list.size(); i++) {
-            if((*taskList).at(i) < fewest && Machine_GetInfo(list.at(i)).s_state == S0) {
-                fewest = (*taskList).at(i); 
-                fewestIndex = i;
+        signed room = signed(machinePerformance(curr, 0) * catalogNumCpus[curr]) - signed(mipsDemand[curr] + slaReserve(curr)); 
+        bool fits = room >= signed(slaNeed(sla, cpu, mips)); 
+        for(int tier = 0; tier < (gpuPreferred(info, curr) ? 2 : 1); tier++) {
+            if(mipsDemand[curr] < fewest[tier]) {
+                fewest[tier] = mipsDemand[curr]; 
+                fewestIndex[tier] = i;
+                fewestFits[tier] = fits; 
+            }
+            if(packIndex[tier] == -1 && fits) {
+                packIndex[tier] = i; 
             }
         }
     }
 
-    (*taskList).at(fewestIndex) = (*taskList).at(fewestIndex) + 1;
-    MachineId_t mid = list.at(fewestIndex); 
+    /* The preferred hosts' pick stands when it has room, and when no machine has room at all */
+    int tier = (sla <= SLA1) ? (fewestFits[1] ? 1 : 0) : (packIndex[1] != -1 ? 1 : 0); 
+    if(tier == 0 && fewestIndex[1] != -1 && packIndex[0] == -1) {
+        tier = 1; 
+    }
+    MachineId_t mid = (*list).at((sla <= SLA1 || packIndex[tier] == -1) ? fewestIndex[tier] : packIndex[tier]); 
+    numTasks[mid]++;
+    mipsDemand[mid] += mips; 
+    ladder->tasks++; 
+    slaHost(mid, sla, 1); 
     taskMap[task_id] = mid;
 
-    /* Add the task to the selected machine */
-    if(vmMap.find(fewestIndex) == vmMap.end()) {
-        /* Machine has no VMs */
-        vmMap[mid] = {}; 
-        VMId_t vid = VM_Create(info.required_vm, info.required_cpu); 
-        vms.push_back(vid);
-        vmMap[mid].push_back(vid); 
-        VM_Attach(vid, mid); 
-        VM_AddTask(vid, task_id, info.priority); 
-        return; 
-    } else {
-        vector<VMId_t> vmIds = vmMap[mid];
-        for(int i = 0; i < vmIds.size(); i++) {
-            VMInfo_t vInfo = VM_GetInfo(vmIds.at(i));
-            if(vInfo.vm_type == info.required_vm) {
-                VM_AddTask(vmIds.at(i), task_id, info.priority); 
-                return; 
-            }
+    /* Add the task to the machine's VM of the required type, taking one from the warm pool if none is running */
+    VMId_t vid = VMId_t(-1); 
+    for(VMId_t running: vmMap[mid]) {
+        if(vmType[running] == info.required_vm) {
+            vid = running; 
+            break; 
         }
-
-        /* Required VM is not present */
-        VMId_t vid = VM_Create(info.required_vm, info.required_cpu); 
-        vms.push_back(vid); 
-        VM_Attach(vid, mid); 
-        VM_AddTask(vid, task_id, info.priority); 
-        return; 
     }
+    if(vid == VMId_t(-1)) {
+        vid = acquireVM(mid, info.required_vm, info.required_cpu); 
+        vmMap[mid].push_back(vid); 
+    }
+    vmTasks[vid]++; 
+    taskToVM[task_id] = vid; 
+    VM_AddTask(vid, task_id, info.priority); 
+    traceDecision(TRACE_PLACE, REASON_PLACE, mid, vid, task_id, info.required_vm); 
 }
 
 void Scheduler::PeriodicCheck(Time_t now) {
@@ -336,6 +470,12 @@ void Scheduler::PeriodicCheck(Time_t now) {
     // Unlike the other invocations of the scheduler, this one doesn't report any specific event
     // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
     checks++; 
+    reclaimIdleVMs(now); 
+    forecastAdvance(now); 
+    slaAdapt(now); 
+    for(int i = 0; i < 4; i++) {
+        ladderCheck(&ladders[i], now); 
+    }
 }
 
 void Scheduler::Shutdown(Time_t time) {
@@ -343,12 +483,13 @@ void Scheduler::Shutdown(Time_t time) {
     // Report about the total energy consumed
     // Report about the SLA compliance
     // Shutdown everything to be tidy :-)
-    SimOutput("Shutting Down", 0); 
+    SCHED_LOG(0, "Shutting Down"); 
     for(auto & vm: vms) {
         VM_Shutdown(vm);
     }
-    SimOutput("SimulationComplete(): Finished!", 4);
-    SimOutput("SimulationComplete(): Time is " + to_string(time), 4);
+    shutdownVMs(); 
+    SCHED_LOG(4, "SimulationComplete(): Finished!");
+    SCHED_LOG(4, "SimulationComplete(): Time is " + to_string(time));
 }
 
 void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
@@ -358,43 +499,27 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 
     // SimOutput("Finishing Task " + to_string(task_id), 1); 
 
-    TaskInfo_t info = GetTaskInfo (task_id); 
-    CPUType_t cpu = info.required_cpu; 
-    VMType_t os = info.required_vm; 
-
     // SimOutput("Task Completed", 0); 
 
-    /* Figure out which list of machines to use */
-    vector<MachineId_t> list; 
-    vector<unsigned> *taskList; 
-    switch (cpu) {
-        case X86:
-            list = x86Machines; 
-            taskList = &x86Tasks; 
-            break; 
-        case ARM:
-            list = armMachines;
-            taskList = &armTasks;  
-            break;
-        case POWER:
-            list = powerMachines;
-            taskList = &powerTasks;  
-            break;
-        default:
-            list = riscvMachines; 
-            taskList = &riscvTasks; 
-            break;
-    }
-
     /* Reduce Task Count for Machine */
     MachineId_t mid = taskMap[task_id]; 
-    for(int i = 0; i < list.size(); i++) {
-        if(list.at(i) == mid) {
-            (*taskList).at(i) = (*taskList).at(i) - 1; 
-            break; 
-        }
+    numTasks[mid]--; 
+    ladders[catalogCpu[mid]].tasks--; 
+    TaskInfo_t info = GetTaskInfo(task_id); 
+    mipsDemand[mid] -= taskMips(info); 
+    forecastCompletion(catalogCpu[mid], info, now); 
+    slaHost(mid, info.required_sla, -1); 
+    slaCompleted[info.required_sla]++; 
+
+    /* Once its last task is done the VM goes back to the warm pool */
+    VMId_t vid = taskToVM[task_id]; 
+    taskToVM.erase(task_id); 
+    vmTasks[vid]--; 
+    if(vmTasks[vid] == 0) {
+        vmMap[mid].erase(std::remove(vmMap[mid].begin(), vmMap[mid].end(), vid), vmMap[mid].end()); 
+        releaseVM(vid, now); 
     }
-    SimOutput("Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now), 1);
+    SCHED_LOG(1, "Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now));
 }
 
 // Public interface below
@@ -402,158 +527,60 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 static Scheduler Scheduler;
 
 void InitScheduler() {
-    SimOutput("InitScheduler(): Initializing scheduler", 4);
+    CallbackTimer timer(CB_INIT); 
+    openTrace(); 
+    SCHED_LOG(4, "InitScheduler(): Initializing scheduler");
     Scheduler.Init();
 }
 
 void HandleNewTask(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time), 4);
+    CallbackTimer timer(CB_NEW_TASK); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time));
     Scheduler.NewTask(time, task_id);
 }
 
 void HandleTaskCompletion(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time), 4);
+    CallbackTimer timer(CB_TASK_COMPLETE); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time));
     Scheduler.TaskComplete(time, task_id);
 }
 
 void MemoryWarning(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_MEMORY_WARNING); 
+    currentTime = time; 
     // The simulator is alerting you that machine identified by machine_id is overcommitted
-    SimOutput("MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time), 4);
+    SCHED_LOG(4, "MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time));
     // SimOutput("Trying to activate more machine with checks " + to_string(checks), 0); 
     checks++;
     /* Expand number of machines if check treshold has been passed */
     if(checks >= checkTreshold) {
         // SimOutput("Activiating New Section of Machines!", 0); 
-        MachineInfo_t info = Machine_GetInfo(machine_id);
         checks = 0; 
-        switch (info.cpu) {
-            case X86:
-                x86ActiveQuarter = (x86ActiveQuarter < 4) ? x86ActiveQuarter + 1 : 4; 
-                if(x86ActiveQuarter == 2) {
-                    for(int i = x86QuarterSize; i < x86QuarterSize * 2; i++) {
-                        Machine_SetState(x86Machines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(x86ActiveQuarter == 3) {
-                    for(int i = x86QuarterSize * 2; i < x86QuarterSize * 3; i++) {
-                        Machine_SetState(x86Machines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(x86ActiveQuarter == 4) {
-                    for(int i = x86QuarterSize * 3; i < x86Machines.size(); i++) {
-                        Machine_SetState(x86Machines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-                        }
-                    }
-                }
-                break; 
-            case ARM:
-                armActiveQuarter = (armActiveQuarter < 4) ? armActiveQuarter + 1 : 4; 
-                if(armActiveQuarter == 2) {
-                    for(int i = armQuarterSize; i < armQuarterSize * 2; i++) {
-                        Machine_SetState(armMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(armActiveQuarter == 3) {
-                    for(int i = armQuarterSize * 2; i < armQuarterSize * 3; i++) {
-                        Machine_SetState(armMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(armActiveQuarter == 4) {
-                    for(int i = armQuarterSize * 3; i < armMachines.size(); i++) {
-                        Machine_SetState(armMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                break;
-            case POWER:
-                powerActiveQuarter = (powerActiveQuarter < 4) ? powerActiveQuarter + 1 : 4; 
-                checks = 0;
-                if(powerActiveQuarter == 2) {
-                    for(int i = powerQuarterSize; i < powerQuarterSize * 2; i++) {
-                        Machine_SetState(powerMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(powerActiveQuarter == 3) {
-                    for(int i = powerQuarterSize * 2; i < powerQuarterSize * 3; i++) {
-                        Machine_SetState(powerMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(powerActiveQuarter == 4) {
-                    for(int i = powerQuarterSize * 3; i < powerMachines.size(); i++) {
-                        Machine_SetState(powerMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                break; 
-            default:
-                riscvActiveQuarter = (riscvActiveQuarter < 4) ? riscvActiveQuarter + 1 : 4; 
-                if(riscvActiveQuarter == 2) {
-                    for(int i = riscvQuarterSize; i < riscvQuarterSize * 2; i++) {
-                        Machine_SetState(riscvMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(riscvActiveQuarter == 3) {
-                    for(int i = riscvQuarterSize * 2; i < riscvQuarterSize * 3; i++) {
-                        Machine_SetState(riscvMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(riscvActiveQuarter == 4) {
-                    for(int i = riscvQuarterSize * 3; i < riscvMachines.size(); i++) {
-                        Machine_SetState(riscvMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                checks = 0; 
-        }
+        ladderPromote(&ladders[catalogCpu[machine_id]], time, REASON_MEMORY_WARNING); 
     }
 }
 
 void MigrationDone(Time_t time, VMId_t vm_id) {
+    CallbackTimer timer(CB_MIGRATION_DONE); 
+    currentTime = time; 
     // The function is called on to alert you that migration is complete
-    SimOutput("MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time), 4);
+    SCHED_LOG(4, "MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time));
     Scheduler.MigrationComplete(time, vm_id);
     migrating = false;
 }
 
 void SchedulerCheck(Time_t time) {
+    CallbackTimer timer(CB_SCHEDULER_CHECK); 
+    currentTime = time; 
     // This function is called periodically by the simulator, no specific event
-    SimOutput("SchedulerCheck(): SchedulerCheck() called at " + to_string(time), 4);
+    SCHED_LOG(4, "SchedulerCheck(): SchedulerCheck() called at " + to_string(time));
     Scheduler.PeriodicCheck(time);
 }
 
 void SimulationComplete(Time_t time) {
+    currentTime = time; 
     // This function is called before the simulation terminates Add whatever you feel like.
     cout << "SLA violation report" << endl;
     cout << "SLA0: " << GetSLAReport(SLA0) << "%" << endl;
@@ -561,12 +588,16 @@ void SimulationComplete(Time_t time) {
     cout << "SLA2: " << GetSLAReport(SLA2) << "%" << endl;     // SLA3 do not have SLA violation issues
     cout << "Total Energy " << Machine_GetClusterEnergy() << "KW-Hour" << endl;
     cout << "Simulation run finished in " << double(time)/1000000 << " seconds" << endl;
-    SimOutput("SimulationComplete(): Simulation finished at time " + to_string(time), 4);
+    reportLatency();
+    SCHED_LOG(4, "SimulationComplete(): Simulation finished at time " + to_string(time));
     
     Scheduler.Shutdown(time);
+    closeTrace();
 }
 
 void SLAWarning(Time_t time, TaskId_t task_id) {
+    CallbackTimer timer(CB_SLA_WARNING); 
+    currentTime = time; 
 
     MachineId_t machine_id = taskMap[task_id]; 
     // SimOutput("Trying to activate more machine with checks " + to_string(checks), 0); 
@@ -574,125 +605,207 @@ void SLAWarning(Time_t time, TaskId_t task_id) {
     /* Expand number of machines if check treshold has been passed */
     if(checks >= checkTreshold) {
         // SimOutput("Activiating New Section of Machines!", 0);
-        MachineInfo_t info = Machine_GetInfo(machine_id);
         checks = 0; 
-                switch (info.cpu) {
-            case X86:
-                x86ActiveQuarter = (x86ActiveQuarter < 4) ? x86ActiveQuarter + 1 : 4; 
-                if(x86ActiveQuarter == 2) {
-                    for(int i = x86QuarterSize; i < x86QuarterSize * 2; i++) {
-                        Machine_SetState(x86Machines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(x86ActiveQuarter == 3) {
-                    for(int i = x86QuarterSize * 2; i < x86QuarterSize * 3; i++) {
-                        Machine_SetState(x86Machines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(x86ActiveQuarter == 4) {
-                    for(int i = x86QuarterSize * 3; i < x86Machines.size(); i++) {
-                        Machine_SetState(x86Machines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(x86Machines.at(i), j, P0); 
-                        }
-                    }
-                }
-                break; 
-            case ARM:
-                armActiveQuarter = (armActiveQuarter < 4) ? armActiveQuarter + 1 : 4; 
-                if(armActiveQuarter == 2) {
-                    for(int i = armQuarterSize; i < armQuarterSize * 2; i++) {
-                        Machine_SetState(armMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(armActiveQuarter == 3) {
-                    for(int i = armQuarterSize * 2; i < armQuarterSize * 3; i++) {
-                        Machine_SetState(armMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(armActiveQuarter == 4) {
-                    for(int i = armQuarterSize * 3; i < armMachines.size(); i++) {
-                        Machine_SetState(armMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(armMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                break;
-            case POWER:
-                powerActiveQuarter = (powerActiveQuarter < 4) ? powerActiveQuarter + 1 : 4; 
-                checks = 0;
-                if(powerActiveQuarter == 2) {
-                    for(int i = powerQuarterSize; i < powerQuarterSize * 2; i++) {
-                        Machine_SetState(powerMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(powerActiveQuarter == 3) {
-                    for(int i = powerQuarterSize * 2; i < powerQuarterSize * 3; i++) {
-                        Machine_SetState(powerMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(powerActiveQuarter == 4) {
-                    for(int i = powerQuarterSize * 3; i < powerMachines.size(); i++) {
-                        Machine_SetState(powerMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(powerMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                break; 
-            default:
-                riscvActiveQuarter = (riscvActiveQuarter < 4) ? riscvActiveQuarter + 1 : 4; 
-                if(riscvActiveQuarter == 2) {
-                    for(int i = riscvQuarterSize; i < riscvQuarterSize * 2; i++) {
-                        Machine_SetState(riscvMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-                        }
-                    }
-                } 
-                if(riscvActiveQuarter == 3) {
-                    for(int i = riscvQuarterSize * 2; i < riscvQuarterSize * 3; i++) {
-                        Machine_SetState(riscvMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                if(riscvActiveQuarter == 4) {
-                    for(int i = riscvQuarterSize * 3; i < riscvMachines.size(); i++) {
-                        Machine_SetState(riscvMachines.at(i), S0);
-                        for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                            Machine_SetCorePerformance(riscvMachines.at(i), j, P0); 
-                        }
-                    }
-                }
-                checks = 0; 
-        }
+        ladderPromote(&ladders[catalogCpu[machine_id]], time, REASON_SLA_WARNING); 
     }
 }
 
 void StateChangeComplete(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_STATE_CHANGE); 
+    currentTime = time; 
     // Called in response to an earlier request to change the state of a machine
-    // SimOutput("Machine " + to_string(machine_id) + " has changed to state " + to_string(Machine_GetInfo(machine_id).s_state), 0); 
+    catalogSState[machine_id] = Machine_GetInfo(machine_id).s_state; 
+    forecastWakeDone(machine_id, time); 
+    // SimOutput("Machine " + to_string(machine_id) + " has changed to state " + to_string(catalogSState[machine_id]), 0); 
+}
+
+/* Cut the list into groups; a type with fewer machines than groups keeps them all in one group */
+void ladderInit(Ladder_t *ladder, vector<MachineId_t> *machines) {
+    ladder->machines = machines; 
+    ladder->groupEnd.clear(); 
+    if((*machines).size() < LADDER_GROUPS) {
+        ladder->groupEnd.push_back((*machines).size()); 
+    } else {
+        double share = 0; 
+        for(int k = 0; k < LADDER_GROUPS - 1; k++) {
+            share += ladderShare[k]; 
+            ladder->groupEnd.push_back(unsigned((*machines).size() * share)); 
+        }
+        ladder->groupEnd.push_back((*machines).size()); 
+    }
+    ladder->groupCores.assign(ladder->groupEnd.size(), 0); 
+    for(unsigned k = 0; k < ladder->groupEnd.size(); k++) {
+        for(unsigned i = (k == 0) ? 0 : ladder->groupEnd[k - 1]; i < ladder->groupEnd[k]; i++) {
+            ladder->groupCores[k] += catalogNumCpus[(*machines).at(i)]; 
+        }
+    }
+    ladder->activeGroups = 1; 
+    ladder->tasks = 0; 
+    ladder->draining = false; 
+    ladder->lastChange = 0; 
+    ladder->quietSince = 0; 
+    ladderApply(ladder, REASON_INIT); 
+}
+
+MachineState_t ladderTarget(const Ladder_t *ladder, unsigned group) {
+    if(group < ladder->activeGroups) {
+        return S0; 
+    }
+    unsigned step = group - ladder->activeGroups; 
+    return ladderStandby[(step < 2) ? step : 2]; 
+}
+
+/* Move every machine whose group changed rung to the group's state */
+void ladderApply(Ladder_t *ladder, uint8_t reason) {
+    ladder->activeCores = 0; 
+    for(unsigned k = 0; k < ladder->groupEnd.size(); k++) {
+        MachineState_t target = ladderTarget(ladder, k); 
+        if(target == S0) {
+            ladder->activeCores += ladder->groupCores[k]; 
+        }
+        for(unsigned i = (k == 0) ? 0 : ladder->groupEnd[k - 1]; i < ladder->groupEnd[k]; i++) {
+            MachineId_t mid = (*ladder->machines).at(i); 
+            if(requestedState[mid] == target) {
+                continue; 
+            }
+            requestedState[mid] = target; 
+            setMachineState(mid, target, reason); 
+            if(target == S0) {
+                setMachinePerformance(mid, P0, reason); 
+            }
+        }
+    }
+}
+
+/* Number of machines, from the front of the list, that new tasks may go to */
+unsigned ladderServing(const Ladder_t *ladder) {
+    unsigned groups = ladder->activeGroups - (ladder->draining ? 1 : 0); 
+    return ladder->groupEnd[groups - 1]; 
+}
+
+void ladderPromote(Ladder_t *ladder, Time_t now, uint8_t reason) {
+    ladder->quietSince = 0; 
+    if(ladder->draining) {
+        /* The top group is still awake, just let it take work again */
+        ladder->draining = false; 
+        ladder->lastChange = now; 
+        return; 
+    }
+    if(ladder->activeGroups < ladder->groupEnd.size()) {
+        ladder->activeGroups++; 
+        ladder->lastChange = now; 
+        ladderApply(ladder, reason); 
+    }
+}
+
+/* Periodic demand check: promote when hot, drain and demote the top group after a quiet spell */
+void ladderCheck(Ladder_t *ladder, Time_t now) {
+    if(ladder->activeCores > 0 && ladder->tasks > ladderHigh * ladder->activeCores) {
+        ladderPromote(ladder, now, REASON_DEMAND); 
+        return; 
+    }
+    /* Promote ahead of the arrivals the forecaster expects by the time the group is up,
+       and don't drain a group they will need */
+    double expected = forecastTasks(CPUType_t(ladder - ladders)); 
+    if(ladder->activeCores > 0 && expected > ladderHigh * ladder->activeCores) {
+        ladderPromote(ladder, now, REASON_FORECAST); 
+        return; 
+    }
+    if(ladder->activeGroups <= 1) {
+        return; 
+    }
+    unsigned top = ladder->activeGroups - 1; 
+    if(std::max(double(ladder->tasks), expected) > ladderLow * (ladder->activeCores - ladder->groupCores[top])) {
+        ladder->quietSince = 0; 
+        ladder->draining = false; 
+        return; 
+    }
+    if(ladder->quietSince == 0) {
+        ladder->quietSince = now; 
+    }
+    if(!ladder->draining) {
+        if(now - ladder->quietSince >= ladderHold && now - ladder->lastChange >= ladderHold) {
+            ladder->draining = true; 
+        }
+        return; 
+    }
+    for(unsigned i = ladder->groupEnd[top - 1]; i < ladder->groupEnd[top]; i++) {
+        if(numTasks[(*ladder->machines).at(i)] > 0) {
+            return; 
+        }
+    }
+    ladder->activeGroups--; 
+    ladder->draining = false; 
+    ladder->quietSince = 0; 
+    ladder->lastChange = now; 
+    ladderApply(ladder, REASON_IDLE); 
+}
+
+/* Hand out the most recently idled VM of this type on the machine, or create and attach one */
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu) {
+    vector<VMId_t> &pool = warmVMs[mid * NUM_VM_TYPES + type]; 
+    for(int i = int(pool.size()) - 1; i >= 0; i--) {
+        VMId_t vid = pool[i]; 
+        pool.erase(pool.begin() + i); 
+        vmIdle[vid] = false; 
+        return vid; 
+    }
+    VMId_t vid = VM_Create(type, cpu); 
+    trackVM(vid); 
+    vmHost[vid] = mid; 
+    vmType[vid] = type; 
+    vmLive[vid] = true; 
+    VM_Attach(vid, mid); 
+    traceDecision(TRACE_VM_ATTACH, REASON_PLACE, mid, vid, TRACE_NONE, type); 
+    return vid; 
+}
+
+void releaseVM(VMId_t vid, Time_t now) {
+    vmIdle[vid] = true; 
+    vmIdleSince[vid] = now; 
+    warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]].push_back(vid); 
+    idleVMs.push_back(std::make_pair(now, vid)); 
+}
+
+/* Entries for VMs that were handed out again since they were queued are skipped */
+void reclaimIdleVMs(Time_t now) {
+    while(!idleVMs.empty() && idleVMs.front().first + vmIdleLimit <= now) {
+        Time_t since = idleVMs.front().first; 
+        VMId_t vid = idleVMs.front().second; 
+        idleVMs.pop_front(); 
+        if(!vmIdle[vid] || vmIdleSince[vid] != since) {
+            continue; 
+        }
+        vector<VMId_t> &pool = warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]]; 
+        pool.erase(std::remove(pool.begin(), pool.end(), vid), pool.end()); 
+        vmIdle[vid] = false; 
+        vmLive[vid] = false; 
+        VM_Shutdown(vid); 
+        traceDecision(TRACE_VM_SHUTDOWN, REASON_RECLAIM, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+    }
+}
+
+void shutdownVMs() {
+    for(unsigned vid = 0; vid < vmLive.size(); vid++) {
+        if(vmLive[vid]) {
+            VM_Shutdown(vid); 
+            vmLive[vid] = false; 
+            traceDecision(TRACE_VM_SHUTDOWN, REASON_SHUTDOWN, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+        }
+    }
+}
+
+/* Make room for a freshly created VM in the per-VM tables */
+void trackVM(VMId_t vid) {
+    if(vid >= vmTasks.size()) {
+        vmTasks.resize(vid + 1, 0); 
+        vmHost.resize(vid + 1); 
+        vmType.resize(vid + 1); 
+        vmIdleSince.resize(vid + 1, 0); 
+        vmIdle.resize(vid + 1, false); 
+        vmLive.resize(vid + 1, false); 
+    }
+    vmTasks[vid] = 0; 
 }
 
 unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id) {
@@ -702,12 +815,10 @@ unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id) {
         return 0; 
     }
 
-    MachineInfo_t newInfo = Machine_GetInfo (id); 
-    double new_ee = newInfo.performance.at(0) / newInfo.p_states.at(0); 
+    double new_ee = machinePerformance(id, 0) / machinePStatePower(id, 0); 
 
     for (unsigned i = 0; i < (*mList).size(); i++) {
-        MachineInfo_t info = Machine_GetInfo((*mList).at(i));
-        double ee = info.performance.at(0) / info.p_states.at(0); 
+        double ee = machinePerformance((*mList).at(i), 0) / machinePStatePower((*mList).at(i), 0); 
         if (new_ee > ee) {
             (*mList).insert((*mList).begin() + i, id); 
             return i; 
@@ -717,3 +828,396 @@ unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id) {
     (*mList).push_back(id); 
     return (*mList).size() - 1; 
 }
+
+/* SHARED BEGIN latency-impl */
+void histRecord(LatencyHist_t *hist, uint64_t ns) {
+    unsigned bucket = ns; 
+    if(ns >= (1u << HIST_SUB_BITS)) {
+        unsigned shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS; 
+        bucket = ((shift + 1) << HIST_SUB_BITS) + ((ns >> shift) & ((1u << HIST_SUB_BITS) - 1)); 
+    }
+    hist->buckets[bucket]++; 
+    hist->count++; 
+    hist->total += ns; 
+    if(ns > hist->max) {
+        hist->max = ns; 
+    }
+}
+
+/* Lower edge of the bucket holding the q-th fraction of the samples */
+uint64_t histPercentile(const LatencyHist_t *hist, double q) {
+    uint64_t rank = uint64_t(q * hist->count); 
+    uint64_t seen = 0; 
+    for(unsigned bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += hist->buckets[bucket]; 
+        if(seen > rank) {
+            if(bucket < (1u << HIST_SUB_BITS)) {
+                return bucket; 
+            }
+            unsigned shift = (bucket >> HIST_SUB_BITS) - 1; 
+            return uint64_t((1u << HIST_SUB_BITS) + (bucket & ((1u << HIST_SUB_BITS) - 1))) << shift; 
+        }
+    }
+    return hist->max; 
+}
+
+void reportLatency() {
+    cout << "Scheduler overhead (ns)" << endl;
+    for(unsigned i = 0; i < CB_COUNT; i++) {
+        const LatencyHist_t *hist = &callbackLatency[i]; 
+        if(hist->count == 0) {
+            continue; 
+        }
+        cout << hist->name << ": calls " << hist->count << " total " << hist->total 
+             << " p50 " << histPercentile(hist, 0.5) << " p99 " << histPercentile(hist, 0.99) 
+             << " max " << hist->max << endl;
+    }
+}
+/* SHARED END latency-impl */
+
+/* SHARED BEGIN trace-impl */
+void openTrace() {
+    const char *path = getenv("SCHED_TRACE"); 
+    if(path == NULL || traceFile != NULL) {
+        return; 
+    }
+    traceFile = fopen(path, "wb"); 
+    if(traceFile == NULL) {
+        SCHED_LOG(0, string("Cannot open trace file ") + path); 
+        return; 
+    }
+    TraceHeader_t header; 
+    memset(&header, 0, sizeof(header)); 
+    memcpy(header.magic, "SCHTRACE", 8); 
+    header.version = TRACE_VERSION; 
+    header.recordSize = sizeof(TraceRecord_t); 
+    strncpy(header.algorithm, SCHED_NAME, sizeof(header.algorithm) - 1); 
+    fwrite(&header, sizeof(header), 1, traceFile); 
+}
+
+void closeTrace() {
+    if(traceFile == NULL) {
+        return; 
+    }
+    fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+    traceCount = 0; 
+    fclose(traceFile); 
+    traceFile = NULL; 
+}
+
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg) {
+    if(traceFile == NULL) {
+        return; 
+    }
+    TraceRecord_t &record = traceBuffer[traceCount++]; 
+    record.time = currentTime; 
+    record.machine = mid; 
+    record.vm = vid; 
+    record.task = tid; 
+    record.kind = kind; 
+    record.reason = reason; 
+    record.arg = arg; 
+    memset(record.reserved, 0, sizeof(record.reserved)); 
+    if(traceCount == TRACE_BUFFER) {
+        fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+        traceCount = 0; 
+    }
+}
+/* SHARED END trace-impl */
+
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason) {
+    if(state == S0) {
+        forecastWakeStart(mid); 
+    }
+    Machine_SetState(mid, state); 
+    traceDecision(TRACE_SET_STATE, reason, mid, TRACE_NONE, TRACE_NONE, state); 
+}
+
+/* Every core of the machine to the same P-state */
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason) {
+    for(unsigned j = 0; j < catalogNumCpus[mid]; j++) {
+        Machine_SetCorePerformance(mid, j, p_state); 
+    }
+    traceDecision(TRACE_SET_PERF, reason, mid, TRACE_NONE, TRACE_NONE, p_state); 
+    catalogPState[mid] = p_state; 
+}
+
+/* SHARED BEGIN forecast-impl */
+void forecastInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        forecasts[c] = Forecast_t(); 
+        wakeLatency[c] = forecastLead; 
+        forecastCores[c] = 0; 
+        forecastMemory[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        forecastCores[catalogCpu[i]] += catalogNumCpus[i]; 
+        forecastMemory[catalogCpu[i]] += catalogMemory[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            forecastCores[c] /= machines[c]; 
+            forecastMemory[c] /= machines[c]; 
+        }
+    }
+    wakeRequested.assign(Machine_GetTotal(), NO_WAKE); 
+}
+
+/* Close every interval that has ended, empty ones included */
+void forecastAdvance(Time_t now) {
+    unsigned seasons = std::min(forecastSeasons, unsigned(FORECAST_MAX_SEASONS)); 
+    for(int c = 0; c < 4; c++) {
+        Forecast_t *f = &forecasts[c]; 
+        unsigned closed = 0; 
+        while(now >= f->intervalStart + forecastInterval) {
+            double x = f->arrivals; 
+            f->arrivals = 0; 
+            f->intervalStart += forecastInterval; 
+            if(!f->primed) {
+                f->level = x; 
+                f->primed = true; 
+            } else if(seasons == 0) {
+                f->level = forecastAlpha * x + (1 - forecastAlpha) * f->level; 
+            } else {
+                double season = f->season[f->slot]; 
+                double level = forecastAlpha * (x - season) + (1 - forecastAlpha) * (f->level + f->trend); 
+                f->trend = forecastBeta * (level - f->level) + (1 - forecastBeta) * f->trend; 
+                f->season[f->slot] = forecastGamma * (x - level) + (1 - forecastGamma) * season; 
+                f->level = level; 
+                f->slot = (f->slot + 1) % seasons; 
+            }
+            /* After a long gap the model has decayed to the empty intervals; skip the rest */
+            if(++closed == 4 * (seasons + 1) + 16) {
+                f->intervalStart = now - (now % forecastInterval); 
+            }
+        }
+    }
+}
+
+void forecastArrival(CPUType_t cpu, const TaskInfo_t &info, Time_t now) {
+    forecastAdvance(now); 
+    Forecast_t *f = &forecasts[cpu]; 
+    f->arrivals++; 
+    if(f->lifetime == 0) {
+        f->lifetime = info.target_completion - info.arrival;    // the SLA window until a task finishes
+        f->memory = info.required_memory; 
+    }
+    f->memory = forecastAlpha * info.required_memory + (1 - forecastAlpha) * f->memory; 
+}
+
+void forecastCompletion(CPUType_t cpu, const TaskInfo_t &info, Time_t now) {
+    Forecast_t *f = &forecasts[cpu]; 
+    f->lifetime = forecastAlpha * (now - info.arrival) + (1 - forecastAlpha) * f->lifetime; 
+}
+
+/* Arrivals expected in the interval `ahead` intervals after the open one */
+double forecastRate(const Forecast_t *f, unsigned ahead) {
+    unsigned seasons = std::min(forecastSeasons, unsigned(FORECAST_MAX_SEASONS)); 
+    if(seasons == 0) {
+        return f->level; 
+    }
+    return std::max(0.0, f->level + ahead * f->trend + f->season[(f->slot + ahead) % seasons]); 
+}
+
+/* Tasks expected in flight once a machine woken now is up */
+double forecastTasks(CPUType_t cpu) {
+    const Forecast_t *f = &forecasts[cpu]; 
+    if(!f->primed) {
+        return 0; 
+    }
+    unsigned ahead = unsigned(std::ceil(wakeLatency[cpu] / forecastInterval)) + 1; 
+    double rate = std::max(forecastRate(f, 0), forecastRate(f, ahead)) / forecastInterval; 
+    return rate * f->lifetime; 
+}
+
+/* Machines of the type that should be powered to absorb the forecast, by cores and by memory */
+unsigned forecastMachines(CPUType_t cpu) {
+    if(forecastCores[cpu] == 0) {
+        return 0; 
+    }
+    double tasks = forecastTasks(cpu); 
+    double machines = std::max(tasks / forecastCores[cpu], tasks * forecasts[cpu].memory / forecastMemory[cpu]); 
+    return unsigned(std::ceil(machines * forecastHeadroom)); 
+}
+
+void forecastWakeStart(MachineId_t mid) {
+    if(catalogSState[mid] != S0 && wakeRequested[mid] == NO_WAKE) {
+        wakeRequested[mid] = currentTime; 
+    }
+}
+
+void forecastWakeDone(MachineId_t mid, Time_t now) {
+    if(wakeRequested[mid] == NO_WAKE) {
+        return; 
+    }
+    if(catalogSState[mid] == S0) {
+        CPUType_t cpu = catalogCpu[mid]; 
+        wakeLatency[cpu] = forecastAlpha * (now - wakeRequested[mid]) + (1 - forecastAlpha) * wakeLatency[cpu]; 
+    }
+    wakeRequested[mid] = NO_WAKE; 
+}
+/* SHARED END forecast-impl */
+
+/* SHARED BEGIN demand-impl */
+unsigned taskMips(const TaskInfo_t &info) {
+    if(info.target_completion <= info.arrival) {
+        return 1000; 
+    }
+    double mips = demandMargin * double(info.total_instructions) / double(info.target_completion - info.arrival); 
+    return std::max(1u, unsigned(std::ceil(mips))); 
+}
+/* SHARED END demand-impl */
+
+/* SHARED BEGIN gpu-impl */
+void gpuArrival(const TaskInfo_t &info) {
+    gpuShare[info.required_cpu] = gpuAlpha * (info.gpu_capable ? 1.0 : 0.0) + (1 - gpuAlpha) * gpuShare[info.required_cpu]; 
+}
+
+bool gpuReserved(CPUType_t cpu) {
+    return gpuShare[cpu] >= gpuReserveShare; 
+}
+
+/* Whether the machine is the kind of host the task should try first */
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid) {
+    if(info.gpu_capable) {
+        return catalogGpus[mid]; 
+    }
+    return !(catalogGpus[mid] && gpuReserved(info.required_cpu)); 
+}
+/* SHARED END gpu-impl */
+
+/* SHARED BEGIN sla-impl */
+void slaInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        slaCompleted[c] = 0; 
+        slaSeenCompleted[c] = 0; 
+        slaSeenMissed[c] = 0; 
+        slaCapacity[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        slaCapacity[catalogCpu[i]] += machinePerformance(MachineId_t(i), 0) * catalogNumCpus[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            slaCapacity[c] /= machines[c]; 
+        }
+    }
+    slaHosted.assign(Machine_GetTotal() * 4, 0); 
+}
+
+/* Count a task of the class onto (count 1) or off (count -1) a machine */
+void slaHost(MachineId_t mid, SLAType_t sla, int count) {
+    slaHosted[mid * 4 + sla] += count; 
+}
+
+/* Machines with SLA0 or SLA1 work stay at P0 */
+bool slaPinned(MachineId_t mid) {
+    return slaHosted[mid * 4 + SLA0] > 0 || slaHosted[mid * 4 + SLA1] > 0; 
+}
+
+/* MIPS held back on a machine for the tightest class it hosts */
+unsigned slaReserve(MachineId_t mid) {
+    double target = 1.0; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        if(slaHosted[mid * 4 + c] > 0) {
+            target = std::min(target, slaTarget[c]); 
+        }
+    }
+    return unsigned((1 - target) * machinePerformance(mid, 0) * catalogNumCpus[mid]); 
+}
+
+/* MIPS a new task of the class needs free on a machine of the type: its own demand and its headroom */
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips) {
+    return mips + unsigned((1 - slaTarget[sla]) * slaCapacity[cpu]); 
+}
+
+/* Move the targets of the classes whose recent miss rate is off their goal; true if any moved */
+bool slaAdapt(Time_t now) {
+    if(now - slaLastAdapt < slaAdaptInterval) {
+        return false; 
+    }
+    slaLastAdapt = now; 
+    bool changed = false; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        unsigned window = slaCompleted[c] - slaSeenCompleted[c]; 
+        if(window < slaMinSamples) {
+            continue; 
+        }
+        double missed = GetSLAReport(SLAType_t(c)) * slaCompleted[c] / 100; 
+        double rate = 100 * (missed - slaSeenMissed[c]) / window; 
+        slaSeenCompleted[c] = slaCompleted[c]; 
+        slaSeenMissed[c] = missed; 
+        double target = slaTarget[c]; 
+        if(rate > slaGoal[c]) {
+            target = std::max(slaTargetFloor, target - slaStep); 
+        } else if(rate < slaGoal[c] / 2) {
+            target = std::min(1.0, target + slaStep); 
+        }
+        if(target != slaTarget[c]) {
+            SCHED_LOG(2, "SLA" + to_string(c) + " missed " + to_string(rate) + "%, utilization target now " + to_string(target)); 
+            slaTarget[c] = target; 
+            changed = true; 
+        }
+    }
+    return changed; 
+}
+/* SHARED END sla-impl */
+
+/* SHARED BEGIN logging-impl */
+/* Runtime log level from SCHED_VERBOSE, SCHED_LOG_MAX when it is unset */
+int initLogLevel() {
+    const char *level = getenv("SCHED_VERBOSE"); 
+    return (level != NULL) ? atoi(level) : SCHED_LOG_MAX; 
+}
+/* SHARED END logging-impl */
+
+/* SHARED BEGIN catalog-impl */
+void buildCatalog() {
+    unsigned total = Machine_GetTotal(); 
+    catalogCpu.resize(total); 
+    catalogNumCpus.resize(total); 
+    catalogMemory.resize(total); 
+    catalogGpus.resize(total); 
+    catalogPerformance.assign(total * NUM_P_STATES, 0); 
+    catalogPStatePower.assign(total * NUM_P_STATES, 0); 
+    catalogSStatePower.assign(total * NUM_S_STATES, 0); 
+    catalogSState.resize(total); 
+    catalogPState.resize(total); 
+
+    for(unsigned i = 0; i < total; i++) {
+        MachineInfo_t info = Machine_GetInfo(MachineId_t(i)); 
+        catalogCpu[i] = info.cpu; 
+        catalogNumCpus[i] = info.num_cpus; 
+        catalogMemory[i] = info.memory_size; 
+        catalogGpus[i] = info.gpus; 
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.performance.size(); p++) {
+            catalogPerformance[i * NUM_P_STATES + p] = info.performance[p]; 
+        }
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.p_states.size(); p++) {
+            catalogPStatePower[i * NUM_P_STATES + p] = info.p_states[p]; 
+        }
+        /* s_states is not always populated, missing entries stay at 0 */
+        for(unsigned s = 0; s < NUM_S_STATES && s < info.s_states.size(); s++) {
+            catalogSStatePower[i * NUM_S_STATES + s] = info.s_states[s]; 
+        }
+        catalogSState[i] = info.s_state; 
+        catalogPState[i] = info.p_state; 
+    }
+}
+
+unsigned machinePerformance(MachineId_t mid, unsigned p_state) {
+    return catalogPerformance[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state) {
+    return catalogPStatePower[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state) {
+    return catalogSStatePower[mid * NUM_S_STATES + s_state]; 
+}
+/* SHARED END catalog-impl */
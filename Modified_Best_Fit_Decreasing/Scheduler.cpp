@@ -7,10 +7,42 @@
 
 #include "Scheduler.hpp"
 #include <unordered_map>
+#include <cstdio>
+#include <chrono>
+#include <deque>
 #include <cmath>
 #include <cstdlib>
-#include <ctime>
 #include <algorithm>
+#include <map>
+#include <set>
+#include <queue>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Name of this scheduler in its decision trace */
+#define SCHED_NAME "MBFD"
+
+/* SHARED BEGIN logging */
+/* Scheduler logging. SCHED_LOG(level, message) only evaluates message, and so only builds the
+   string, when level is within both SCHED_LOG_MAX (compile time, -DSCHED_LOG_MAX=0 compiles every
+   message above 0 out) and schedLogLevel (runtime, taken from the SCHED_VERBOSE environment
+   variable). Both default to 4, which passes everything on to SimOutput as before */
+#ifndef SCHED_LOG_MAX
+#define SCHED_LOG_MAX 4
+#endif
+#define SCHED_LOG(level, message) \
+    do { \
+        if((level) <= SCHED_LOG_MAX && (level) <= schedLogLevel) { \
+            SimOutput((message), (level)); \
+        } \
+    } while(0)
+
+int initLogLevel(); 
+int schedLogLevel = initLogLevel(); 
+/* SHARED END logging */
 
 static bool migrating = false;
 static unsigned total_machines;
@@ -28,22 +60,370 @@ unsigned activex86 = 0;
 unsigned activeArm = 0;
 unsigned activePower = 0;
 unsigned activeRiscv = 0; 
+unsigned forecastApplied[4] = {0, 0, 0, 0};     // forecastMachines() last handed to updateMachines
 
 std::unordered_map<MachineId_t, vector<VMId_t>> vmMap;
 std::unordered_map<TaskId_t, MachineId_t> taskMap;
 std::unordered_map<TaskId_t, VMId_t> taskToVM; 
-std::unordered_map<MachineId_t, unsigned> remainingMips; 
-std::unordered_map<VMId_t, bool> isMigrating; 
-std::unordered_map<MachineId_t, unsigned> numTasks; 
-std::unordered_map<MachineId_t, unsigned> remainingMemory; 
-
-vector<MachineId_t> turningOff; 
 
+/* Warm VM pool. A VM whose work is done stays attached to its machine in
+   warmVMs[machine * NUM_VM_TYPES + type] and goes to the next task of that type placed there,
+   so arrivals skip VM_Create/VM_Attach. VMs left idle for vmIdleLimit are shut down from
+   SchedulerCheck, oldest first */
+#define NUM_VM_TYPES 4
+vector<vector<VMId_t>> warmVMs; 
+std::deque<std::pair<Time_t, VMId_t>> idleVMs;     // in release order
+vector<MachineId_t> vmHost;     // per-VM entries below are indexed by VMId_t
+vector<VMType_t> vmType; 
+vector<Time_t> vmIdleSince; 
+vector<bool> vmIdle; 
+vector<bool> vmLive; 
+Time_t vmIdleLimit = 5000000; 
+
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu);
+void releaseVM(VMId_t vid, Time_t now);
+void reclaimIdleVMs(Time_t now);
+void shutdownVMs();
+void moveVM(VMId_t vid, MachineId_t target);
+void migrateVM(VMId_t vid, MachineId_t source, MachineId_t target, uint8_t reason);
+
+/* Accounting table indexed directly by MachineId_t, sized once in Init. The capacity arrays read
+   by every feasibility check are kept apart from the colder per-machine counters */
+vector<unsigned> remainingMips; 
+vector<int32_t> tierMips;   // remainingMips less the SLA reserve of the machine's tasks
+vector<unsigned> remainingMemory; 
+vector<unsigned> numTasks; 
+vector<bool> isMigrating;   // indexed by VMId_t, grown as VMs are created
+vector<int32_t> eeRank;     // position of each machine in its energy-efficiency ordered list
+
+vector<bool> turningOff;    // sent to S1, until its StateChangeComplete
+
+/* Arrivals wait in a batch until it is batchQuantum old (0 means until time moves on), holds
+   batchLimit tasks, or the next SchedulerCheck, then are placed together. Every callback runs
+   flushDue, so a batched task waits at most batchQuantum past its arrival plus the gap to
+   the scheduler's next callback, which is never longer than the SchedulerCheck period. SLA0
+   tasks are too short to wait even that and are placed as they arrive */
+vector<std::pair<TaskId_t, TaskInfo_t>> pendingTasks; 
+Time_t batchStart = 0; 
+Time_t batchQuantum = 0; 
+unsigned batchLimit = 64; 
+double typeMemory[4];       // average memory of a machine of each type, to size batched tasks
+
+/* Tasks that found no S0 machine of their type at all. One machine of the type is woken for them
+   and they are placed, by the usual rules, from the StateChangeComplete that brings it up */
+vector<std::pair<TaskId_t, TaskInfo_t>> parkedTasks[4]; 
+
+/* Capacity index: the placeable machines of each CPU type with MIPS to spare beyond their SLA
+   reserve, bucketed by indexPower, each bucket ordered by remaining memory. A lookup walks the few
+   distinct power levels and does one lower_bound per level, then steps past the rare machine
+   with the memory but not the MIPS, so placement is O(log n) in the machine count. Each type has
+   one index for its plain hosts and one for its GPU hosts, so GPU routing can ask either first */
+typedef std::map<unsigned, std::set<std::pair<unsigned, MachineId_t>>> CapacityIndex_t;
+CapacityIndex_t x86Index[2];     // [0] plain hosts, [1] GPU hosts
+CapacityIndex_t armIndex[2];
+CapacityIndex_t powerIndex[2];
+CapacityIndex_t riscvIndex[2];
+std::unordered_map<MachineId_t, std::pair<unsigned, unsigned>> indexKey; 
+
+
+/* SHARED BEGIN latency */
+/* Scheduler overhead: wall time spent in each entry point, recorded by a CallbackTimer at the top
+   of the callback into a log-linear histogram (every power of two of nanoseconds split into 8
+   linear buckets, so a percentile is within 12.5%) and reported from SimulationComplete */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+typedef struct {
+    const char *name; 
+    uint64_t count = 0; 
+    uint64_t total = 0; 
+    uint64_t max = 0; 
+    uint64_t buckets[HIST_BUCKETS] = {}; 
+} LatencyHist_t;
+
+enum { CB_INIT, CB_NEW_TASK, CB_TASK_COMPLETE, CB_MEMORY_WARNING, CB_SLA_WARNING, CB_MIGRATION_DONE, 
+       CB_SCHEDULER_CHECK, CB_STATE_CHANGE, CB_COUNT };
+LatencyHist_t callbackLatency[CB_COUNT] = {
+    {"InitScheduler"}, {"HandleNewTask"}, {"HandleTaskCompletion"}, {"MemoryWarning"}, {"SLAWarning"}, 
+    {"MigrationDone"}, {"SchedulerCheck"}, {"StateChangeComplete"}
+};
+
+void histRecord(LatencyHist_t *hist, uint64_t ns);
+uint64_t histPercentile(const LatencyHist_t *hist, double q);
+void reportLatency();
+
+struct CallbackTimer {
+    unsigned which; 
+    std::chrono::steady_clock::time_point start; 
+    CallbackTimer(unsigned which) : which(which), start(std::chrono::steady_clock::now()) {}
+    ~CallbackTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start; 
+        histRecord(&callbackLatency[which], std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()); 
+    }
+};
+/* SHARED END latency */
+
+/* SHARED BEGIN trace */
+/* Decision trace. With SCHED_TRACE=<file> set, every placement, migration, VM attach/shutdown,
+   power-state and P-state request is appended to <file> as a fixed 32-byte record behind a
+   32-byte header, through a buffer flushed every TRACE_BUFFER records and at the end of the run.
+   Tools/trace_reader.cpp prints and diffs these files. Without SCHED_TRACE, traceDecision
+   returns at once */
+#define TRACE_VERSION 1
+#define TRACE_BUFFER 4096
+#define TRACE_NONE UINT32_MAX
+typedef struct {
+    char magic[8];          // "SCHTRACE"
+    uint32_t version; 
+    uint32_t recordSize; 
+    char algorithm[16]; 
+} TraceHeader_t;
+
+typedef struct {
+    uint64_t time; 
+    uint32_t machine; 
+    uint32_t vm; 
+    uint32_t task; 
+    uint32_t arg;           // S-state or P-state requested, VM type, or migration source machine
+    uint8_t kind; 
+    uint8_t reason; 
+    uint8_t reserved[6]; 
+} TraceRecord_t;
+static_assert(sizeof(TraceRecord_t) == 32, "trace records are 32 bytes"); 
+
+enum { TRACE_PLACE, TRACE_MIGRATE, TRACE_SET_STATE, TRACE_SET_PERF, TRACE_VM_ATTACH, TRACE_VM_SHUTDOWN };
+enum { REASON_INIT, REASON_PLACE, REASON_FALLBACK, REASON_MEMORY_WARNING, REASON_SLA_WARNING, REASON_CONSOLIDATE, 
+       REASON_IDLE, REASON_DEMAND, REASON_GOVERNOR, REASON_RECLAIM, REASON_SHUTDOWN, REASON_FORECAST, REASON_SLACK };
+
+FILE *traceFile = NULL; 
+TraceRecord_t traceBuffer[TRACE_BUFFER]; 
+unsigned traceCount = 0; 
+Time_t currentTime = 0;     // time of the callback being handled
+
+void openTrace();
+void closeTrace();
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg);
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason);
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason);
+/* SHARED END trace */
+
+/* SHARED BEGIN catalog */
+/* Machine catalog: static attributes cached once in Init so the hot paths never copy
+   MachineInfo_t. Only s_state and p_state change at runtime; s_state is refreshed from
+   StateChangeComplete and p_state is recorded by setMachinePerformance */
+#define NUM_P_STATES 4
+#define NUM_S_STATES 7
+vector<CPUType_t> catalogCpu;
+vector<unsigned> catalogNumCpus;
+vector<unsigned> catalogMemory;
+vector<bool> catalogGpus;
+vector<unsigned> catalogPerformance;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogPStatePower;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogSStatePower;    // NUM_S_STATES entries per machine, 0 when not reported
+vector<MachineState_t> catalogSState;
+vector<CPUPerformance_t> catalogPState;
+
+void buildCatalog();
+unsigned machinePerformance(MachineId_t mid, unsigned p_state);
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state);
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state);
+/* SHARED END catalog */
+
+/* SHARED BEGIN demand */
+/* MIPS demand model. A task has to retire total_instructions between its arrival and its target
+   completion, so it needs total / (target - arrival) MIPS on average; demandMargin pads that for
+   time lost to sharing a core or to a migration. Every MIPS charge and load figure counts tasks by
+   this demand. A task without a window is charged the flat 1000 MIPS the accounting used before */
+double demandMargin = 1.25; 
+
+unsigned taskMips(const TaskInfo_t &info);
+/* SHARED END demand */
+
+/* SHARED BEGIN gpu */
+/* GPU routing. A GPU-capable task runs gpuSpeedup times faster on a GPU host, so it tries the GPU
+   hosts of its type first. It is still charged its full demand there: it holds a core share for as
+   long as it runs, it just runs for less time. While GPU-capable work is at least gpuReserveShare
+   of a type's arrivals (an EWMA with weight gpuAlpha), tasks that cannot use a GPU take that
+   type's GPU hosts last, keeping them for the work that finishes faster there */
+double gpuSpeedup = 2.0; 
+double gpuAlpha = 0.05; 
+double gpuReserveShare = 0.1; 
+double gpuShare[4];             // GPU-capable share of each CPU type's arrivals
+
+void gpuArrival(const TaskInfo_t &info);
+bool gpuReserved(CPUType_t cpu);
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid);
+/* SHARED END gpu */
+
+/* SHARED BEGIN gpu-rank */
+/* Placement ranks for candidate scans. A GPU-capable task ranks hosts by efficiency times its
+   speedup, which puts a GPU host first unless a plain one is more efficient by more than the
+   speedup; other tasks rank by efficiency, with the GPU hosts after the plain ones while they are
+   reserved */
+vector<int32_t> gpuRank;        // placement score of each machine for GPU-capable tasks
+vector<int32_t> plainRank;      // and for other tasks while GPU hosts are held back
+
+void gpuInit();
+const int32_t *placementRank(const TaskInfo_t &info);
+/* SHARED END gpu-rank */
+
+/* SHARED BEGIN sla */
+/* SLA tiers. A task of class c only goes where its host stays under slaTarget[c] of its P0
+   capacity once the task is on it, and the headroom that leaves is held back from later tasks
+   for as long as the class has work there. SLA0 and SLA1 start with room in reserve and keep
+   their hosts at P0; SLA2 and SLA3 pack the most efficient hosts full, which can then stay slow.
+   The targets follow GetSLAReport: every slaAdaptInterval the share of each class's tasks that
+   missed since the last look is held against slaGoal, and the target steps toward more headroom
+   when over it and toward denser packing when well under it */
+double slaTarget[4] = {0.6, 0.75, 1.0, 1.0};   // highest host utilization a task of the class accepts
+double slaGoal[4] = {5, 10, 20, 100};           // % of the class's tasks allowed to miss
+double slaStep = 0.05; 
+double slaTargetFloor = 0.3; 
+unsigned slaMinSamples = 20;    // completions needed before a class's target moves
+Time_t slaAdaptInterval = 10000000; 
+Time_t slaLastAdapt = 0; 
+unsigned slaCompleted[4];       // completions seen by TaskComplete
+unsigned slaSeenCompleted[4];   // and the completions and misses at the last adaptation
+double slaSeenMissed[4]; 
+double slaCapacity[4];          // average P0 MIPS of a machine of each type
+vector<unsigned> slaHosted;     // tasks of each class on each machine, 4 entries per machine
+
+void slaInit();
+void slaHost(MachineId_t mid, SLAType_t sla, int count);
+bool slaPinned(MachineId_t mid);
+unsigned slaReserve(MachineId_t mid);
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips);
+bool slaAdapt(Time_t now);
+/* SHARED END sla */
+
+/* SHARED BEGIN slack */
+/* Deadline slack. A running task's slack is the time it can still lose before it misses its target,
+   target - now - remaining / rate, where rate is its host's per-core MIPS at the host's P-state
+   shared out once the host runs more tasks than it has cores. Each task sits in slackHeap under the
+   time its slack, at the current rate, runs down to slackMargin of its SLA window, so a
+   SchedulerCheck pops only the tasks at risk and re-estimates them from their remaining
+   instructions. One that really is short is rescued, by bringing its host up to P0 or moving it to
+   a quicker machine, and looked at again slackRetry later. A task is filed when it lands on a
+   host, and the host's other tasks are re-filed only when their rate drops: the host slows down,
+   or takes on more tasks than it has cores. The entries that leaves behind are told apart by
+   sequence number and skipped. SLA3 has no target, so its tasks only count as co-tenants */
+typedef std::pair<Time_t, std::pair<uint64_t, TaskId_t>> SlackEntry_t;  // (due, (sequence, task))
+std::priority_queue<SlackEntry_t, vector<SlackEntry_t>, std::greater<SlackEntry_t>> slackHeap; 
+std::unordered_map<TaskId_t, SlackEntry_t> slackLive;    // the current entry of each filed task
+vector<std::set<TaskId_t>> slackOn;     // running tasks on each machine
+uint64_t slackSequence = 0; 
+double slackMargin = 0.1;       // of the task's SLA window, target - arrival
+Time_t slackRetry = 500000;     // before a rescued task is looked at again
+
+void slackInit();
+void slackAdd(TaskId_t tid, MachineId_t mid, Time_t now);
+void slackRemove(TaskId_t tid, MachineId_t mid);
+void slackMove(TaskId_t tid, MachineId_t from, MachineId_t to, Time_t now);
+double slackRate(MachineId_t mid, unsigned tasks);
+double slackSpare(const TaskInfo_t &info, MachineId_t mid, Time_t now);
+void slackFile(TaskId_t tid, Time_t due);
+void slackTouch(MachineId_t mid, Time_t now);
+void slackCheck(Time_t now);
+/* SHARED END slack */
+void slackRescue(TaskId_t tid, MachineId_t mid, Time_t now);
+
+/* SHARED BEGIN rescue */
+/* Graduated SLA rescue. A task an SLAWarning reports as late is first raised to HIGH_PRIORITY
+   and the co-located tasks of less strict classes are lowered to LOW_PRIORITY, which moves the
+   host's cycles toward it at no cost in power. Every rescueWait the task's progress since the last
+   look is projected to its finish, and while that still misses the target the rescue goes one
+   step further: the host is brought up to P0, then the task's VM alone is migrated. A demoted task
+   gets its own priority back once every rescue that lowered it is over */
+enum { RESCUE_PRIORITY, RESCUE_BOOST, RESCUE_MIGRATE };
+typedef struct {
+    unsigned stage; 
+    Time_t since;               // time of the last look
+    uint64_t remaining;         // instructions left at the last look
+    vector<TaskId_t> demoted; 
+} Rescue_t;
+std::unordered_map<TaskId_t, Rescue_t> rescues; 
+std::unordered_map<TaskId_t, std::pair<unsigned, Priority_t>> demotions;   // rescues holding the task down, its own priority
+Time_t rescueWait = 500000; 
+
+void rescueStart(TaskId_t tid, Time_t now);
+void rescueCheck(Time_t now);
+void rescueFinish(TaskId_t tid);
+/* SHARED END rescue */
+bool rescueBoost(TaskId_t tid, MachineId_t mid, Time_t now);
+bool rescueMigrate(TaskId_t tid, MachineId_t mid, Time_t now);
+
+/* SHARED BEGIN forecast */
+/* Arrival forecaster, one per CPU type. Arrivals are counted per forecastInterval and each closed
+   interval feeds an EWMA of the arrival rate, or a Holt-Winters model (level, trend and
+   forecastSeasons seasonal slots) when forecastSeasons is set. Lifetimes and memory per task are
+   smoothed as tasks come and go, so by Little's law the tasks in flight one wake-up from now are
+   rate x lifetime. The wake-up time is measured per type from S0 requests to their
+   StateChangeComplete, forecastLead until the first one lands */
+#define FORECAST_MAX_SEASONS 64
+typedef struct {
+    Time_t intervalStart; 
+    unsigned arrivals;          // in the open interval
+    double level;               // arrivals per interval
+    double trend; 
+    double season[FORECAST_MAX_SEASONS]; 
+    unsigned slot;              // seasonal slot of the open interval
+    double lifetime;            // us from arrival to completion
+    double memory;              // MB per task
+    bool primed; 
+} Forecast_t;
+
+Forecast_t forecasts[4];        // indexed by CPUType_t
+Time_t forecastInterval = 1000000; 
+unsigned forecastSeasons = 0;   // 0 keeps the plain EWMA
+double forecastAlpha = 0.3; 
+double forecastBeta = 0.1; 
+double forecastGamma = 0.2; 
+double forecastHeadroom = 1.2; 
+Time_t forecastLead = 1000000; 
+double wakeLatency[4]; 
+vector<Time_t> wakeRequested;   // time of the pending S0 request, NO_WAKE when none
+double forecastCores[4];        // average cores and memory of a machine of each type
+double forecastMemory[4]; 
+#define NO_WAKE UINT64_MAX
+
+void forecastInit();
+void forecastAdvance(Time_t now);
+void forecastArrival(CPUType_t cpu, const TaskInfo_t &info, Time_t now);
+void forecastCompletion(CPUType_t cpu, const TaskInfo_t &info, Time_t now);
+double forecastRate(const Forecast_t *f, unsigned ahead);
+double forecastTasks(CPUType_t cpu);
+unsigned forecastMachines(CPUType_t cpu);
+void forecastWakeStart(MachineId_t mid);
+void forecastWakeDone(MachineId_t mid, Time_t now);
+/* SHARED END forecast */
+
+/* SHARED BEGIN kernel */
+/* Feasibility kernel over candidate machines laid out as parallel arrays indexed by MachineId_t.
+   eligible[i] holds the machine's CPU type + 1 while it can take work and 0 otherwise */
+#define ELIGIBLE(cpu) uint8_t((cpu) + 1)
+vector<uint8_t> eligible;
+
+int feasibleArgmin(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                   uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask);
+/* SHARED END kernel */
 
 unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id);
 bool hasEnoughResource(MachineId_t mid, TaskId_t tid); 
-unsigned estimatedPower(MachineId_t mid, TaskId_t tid); 
+unsigned estimatedPower(MachineId_t mid, unsigned mips); 
+unsigned indexPower(MachineId_t mid); 
 void updateMachines(CPUType_t type);
+void trackVM(VMId_t vid);
+CapacityIndex_t* capacityIndex(CPUType_t type, bool gpus);
+void reindexMachine(MachineId_t mid);
+MachineId_t indexLookup(CapacityIndex_t *index, unsigned memory, unsigned mips, const int32_t *room, MachineId_t skip, std::pair<unsigned, unsigned> *key);
+MachineId_t findBestMachine(const TaskInfo_t &info, unsigned mips);
+MachineId_t findMigrationTarget(CPUType_t type, MachineId_t source, unsigned memory, unsigned mips);
+void placeTask(TaskId_t task_id, const TaskInfo_t &info);
+vector<MachineId_t>* typeMachines(CPUType_t type);
+void wakeForParked(CPUType_t cpu);
+void unparkTasks(MachineId_t mid);
+void flushBatch();
+void flushDue(Time_t now);
+double batchSize(const TaskInfo_t &info);
 
 void Scheduler::Init() {
     // Find the parameters of the clusters
@@ -54,15 +434,28 @@ void Scheduler::Init() {
     //      Get the number of CPUs
     //      Get if there is a GPU or not
     // 
-    SimOutput("Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()), 0);
-    SimOutput("Scheduler::Init(): Initializing scheduler", 1);
+    SCHED_LOG(0, "Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()));
+    SCHED_LOG(1, "Scheduler::Init(): Initializing scheduler");
     total_machines = Machine_GetTotal(); 
-
-    std::srand(std::time(0));
+    buildCatalog(); 
+    forecastInit(); 
+    slaInit(); 
+    slackInit(); 
+    gpuInit(); 
+    warmVMs.resize(Machine_GetTotal() * NUM_VM_TYPES); 
+
+    std::srand(1); /* fixed seed, so repeated runs agree */
+    remainingMips.resize(total_machines); 
+    tierMips.resize(total_machines); 
+    remainingMemory.resize(total_machines); 
+    numTasks.resize(total_machines); 
+    eeRank.resize(total_machines); 
+    eligible.assign(total_machines, 0); 
+    turningOff.assign(total_machines, false); 
 
     /* Find the number of each machine available */
     for(unsigned i = 0; i < total_machines; i++) {
-        switch (Machine_GetCPUType(MachineId_t(i))) {
+        switch (catalogCpu[MachineId_t(i)]) {
             case X86:
                 numX86Machines++; 
                 insert_sorted_ee(&x86Machines, MachineId_t(i)); 
@@ -80,56 +473,68 @@ void Scheduler::Init() {
                 insert_sorted_ee(&riscvMachines, MachineId_t(i)); 
                 break; 
         }
-        remainingMips[MachineId_t(i)] = Machine_GetInfo(MachineId_t(i)).performance[0] * Machine_GetInfo(MachineId_t(i)).num_cpus; 
-        remainingMemory[MachineId_t(i)] = (Machine_GetInfo(MachineId_t(i)).memory_size) * 0.95; 
+        remainingMips[MachineId_t(i)] = machinePerformance(MachineId_t(i), 0) * catalogNumCpus[MachineId_t(i)]; 
+        remainingMemory[MachineId_t(i)] = (catalogMemory[MachineId_t(i)]) * 0.95; 
         numTasks[MachineId_t(i)] = 0; 
+        typeMemory[catalogCpu[MachineId_t(i)]] += catalogMemory[MachineId_t(i)]; 
+    }
+    unsigned counts[4] = {numX86Machines, numArmMachines, numPowerMachines, numRiscvMachines}; 
+    for(int c = 0; c < 4; c++) {
+        if(counts[c] > 0) {
+            typeMemory[c] /= counts[c]; 
+        }
     }
 
     /* Turn on 1/4 of the machines of each type */
     for(int i = 0; i < numX86Machines; i++) {
         /* TO BE UPDATED FOR TURNING ON/OFF */
         if(i <= numX86Machines) {
-            Machine_SetState(x86Machines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(x86Machines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(x86Machines.at(i), j, P3); 
-            }
+            setMachineState(x86Machines.at(i), S0, REASON_INIT); 
+            setMachinePerformance(x86Machines.at(i), P3, REASON_INIT); 
         } else {
-            Machine_SetState(x86Machines.at(i), S5); 
+            setMachineState(x86Machines.at(i), S5, REASON_INIT); 
         }
     }
     for(int i = 0; i < numArmMachines; i++) {
         /* TO BE UPDATED FOR TURNING ON/OFF */
         if(i <= numArmMachines) {
-            Machine_SetState(armMachines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(armMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(armMachines.at(i), j, P3); 
-            }
+            setMachineState(armMachines.at(i), S0, REASON_INIT); 
+            setMachinePerformance(armMachines.at(i), P3, REASON_INIT); 
         } else {
-            Machine_SetState(armMachines.at(i), S5); 
+            setMachineState(armMachines.at(i), S5, REASON_INIT); 
         }
     }
     for(int i = 0; i < numPowerMachines; i++) {
         /* TO BE UPDATED FOR TURNING ON/OFF */
         if(i <= numPowerMachines) {
-            Machine_SetState(powerMachines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(powerMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(powerMachines.at(i), j, P3); 
-            }
+            setMachineState(powerMachines.at(i), S0, REASON_INIT); 
+            setMachinePerformance(powerMachines.at(i), P3, REASON_INIT); 
         } else {
-            Machine_SetState(powerMachines.at(i), S5); 
+            setMachineState(powerMachines.at(i), S5, REASON_INIT); 
         }
     }
     for(int i = 0; i < numRiscvMachines; i++) {
         /* TO BE UPDATED FOR TURNING ON/OFF */
         if(i < numRiscvMachines) {
-            Machine_SetState(riscvMachines.at(i), S0); 
-            for(int j = 0; j < Machine_GetInfo(riscvMachines.at(i)).num_cpus; j++) {
-                Machine_SetCorePerformance(riscvMachines.at(i), j, P3); 
-            }
+            setMachineState(riscvMachines.at(i), S0, REASON_INIT); 
+            setMachinePerformance(riscvMachines.at(i), P3, REASON_INIT); 
         } else {
-            Machine_SetState(riscvMachines.at(i), S5); 
+            setMachineState(riscvMachines.at(i), S5, REASON_INIT); 
+        }
+    }
+
+    /* Lists are in their final order, so every machine's rank is fixed from here on */
+    vector<MachineId_t> *lists[] = {&x86Machines, &armMachines, &powerMachines, &riscvMachines}; 
+    for(vector<MachineId_t> *list: lists) {
+        for(unsigned i = 0; i < (*list).size(); i++) {
+            eeRank[(*list).at(i)] = i; 
         }
     }
+
+    /* Build the capacity index now that every machine has its starting state */
+    for(unsigned i = 0; i < total_machines; i++) {
+        reindexMachine(MachineId_t(i)); 
+    }
 }
 
 void Scheduler::MigrationComplete(Time_t time, VMId_t vm_id) {
@@ -156,73 +561,173 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
     //
     // Other possibilities as desired
 
-    TaskInfo_t info = GetTaskInfo (task_id); 
-    CPUType_t cpu = info.required_cpu; 
-    VMType_t os = info.required_vm; 
+    /* Hold the task until the batch is due, then pack the whole batch in decreasing order */
+    flushDue(now); 
+    TaskInfo_t info = GetTaskInfo(task_id); 
+    forecastArrival(info.required_cpu, info, now); 
+    gpuArrival(info); 
+    if(info.required_sla == SLA0) {
+        placeTask(task_id, info); 
+        return; 
+    }
+    if(pendingTasks.empty()) {
+        batchStart = now; 
+    }
+    pendingTasks.push_back(std::make_pair(task_id, info)); 
+    if(pendingTasks.size() >= batchLimit) {
+        flushBatch(); 
+    }
+}
 
-    SimOutput("Handling task " + to_string(task_id), 1); 
+void Scheduler::PeriodicCheck(Time_t now) {
+    // This method should be called from SchedulerCheck()
+    // SchedulerCheck is called periodically by the simulator to allow you to monitor, make decisions, adjustments, etc.
+    // Unlike the other invocations of the scheduler, this one doesn't report any specific event
+    // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
+    flushBatch(); 
+    reclaimIdleVMs(now); 
+    slackCheck(now); 
+    rescueCheck(now); 
+    if(slaAdapt(now)) {
+        for(unsigned i = 0; i < total_machines; i++) {
+            reindexMachine(MachineId_t(i)); 
+        }
+    }
 
-    /* Figure out which list of machines to use */
-    vector<MachineId_t> list;
-    switch (cpu) {
-        case X86:
-            list = x86Machines;
-            break; 
-        case ARM:
-            list = armMachines; 
-            break;
-        case POWER:
-            list = powerMachines; 
-            break;
-        default:
-            list = riscvMachines; 
-            break;
+    /* Wake idle machines as soon as a type's forecast rises; it falling is left to TaskComplete */
+    forecastAdvance(now); 
+    CPUType_t types[] = {X86, ARM, POWER, RISCV}; 
+    for(CPUType_t type: types) {
+        unsigned want = forecastMachines(type); 
+        if(want > forecastApplied[type]) {
+            updateMachines(type); 
+        }
+        forecastApplied[type] = want; 
+    }
+}
+
+void Scheduler::Shutdown(Time_t time) {
+    // Do your final reporting and bookkeeping here.
+    // Report about the total energy consumed
+    // Report about the SLA compliance
+    // Shutdown everything to be tidy :-)
+    SCHED_LOG(0, "Shutting Down"); 
+    for(auto & vm: vms) {
+        VM_Shutdown(vm);
     }
+    shutdownVMs(); 
+    SCHED_LOG(4, "SimulationComplete(): Finished!");
+    SCHED_LOG(4, "SimulationComplete(): Time is " + to_string(time));
+}
 
-    /* Go through the list and the best machine based on the MBFD algorithm */ 
-    uint32_t minPower = INT32_MAX; 
+void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 
-    MachineId_t chosen = -1; 
-    unsigned size = list.size(); 
-    for(int i = 0; i < size; i++) {
-        if(hasEnoughResource(list.at(i), task_id) 
-            && std::find(turningOff.begin(), turningOff.end(), list.at(i)) == turningOff.end()
-            && Machine_GetInfo(list.at(i)).s_state == S0) {
-            unsigned estPower = estimatedPower(list.at(i), task_id); 
-            if(estPower < minPower) {
-                minPower = estPower; 
-                chosen = list.at(i); 
-            }
+    // Do any bookkeeping necessary for the data structures
+    // Decide if a machine is to be turned off, slowed down, or VMs to be migrated according to your policy
+    // This is an opportunity to make any adjustments to optimize performance/energy
+
+    SCHED_LOG(1, "Finishing Task " + to_string(task_id)); 
+    flushDue(now); 
+    TaskInfo_t info = GetTaskInfo (task_id); 
+    CPUType_t cpu = info.required_cpu; 
+    forecastCompletion(cpu, info, now); 
+
+    MachineId_t mid = taskMap[task_id];
+    VMId_t toRemove = taskToVM[task_id]; 
+    vector<VMId_t> *machine_vms = &vmMap[vmHost[toRemove]];
+
+    remainingMemory[mid] += info.required_memory; 
+    remainingMips[mid] += taskMips(info); 
+    numTasks[mid]--; 
+    slaHost(mid, info.required_sla, -1); 
+    slaCompleted[info.required_sla]++; 
+    slackRemove(task_id, mid); 
+    rescueFinish(task_id); 
+
+    if(numTasks[mid] == 0) {
+        switch (info.required_cpu) {
+            case X86:
+                activex86--; 
+                break; 
+            case ARM:
+                activeArm--;
+                break; 
+            case POWER:
+                activePower--; 
+                break; 
+            case RISCV:
+                activeRiscv--; 
+                break; 
+            default:
+                break; 
         }
+        updateMachines(info.required_cpu); 
     }
+    reindexMachine(mid); 
+
+    /* The VM goes back to the warm pool, still attached to its machine */
+    (*machine_vms).erase(std::remove((*machine_vms).begin(), (*machine_vms).end(), toRemove), (*machine_vms).end()); 
+    releaseVM(toRemove, now); 
+    taskToVM.erase(task_id); 
+    taskMap.erase(task_id); 
+
 
-    SimOutput("Chosen machine: " + to_string(chosen), 1);
+    SCHED_LOG(4, "Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now));
+}
+
+/* Put one task on the best machine for it and update the bookkeeping */
+void placeTask(TaskId_t task_id, const TaskInfo_t &info) {
+    CPUType_t cpu = info.required_cpu; 
 
-    while (chosen == -1) {
-        int random = std::rand();
-        int min = 0, max = list.size() - 1;
-        int random_number = min + (random % (max - min + 1));
-        chosen = list.at(random_number); 
+    SCHED_LOG(1, "Handling task " + to_string(task_id)); 
+
+    /* Find the best machine based on the MBFD algorithm: lowest power, tightest memory fit, among the
+       machines that keep the headroom the task's SLA class asks for, GPU hosts first or last as GPU
+       routing wants. When nothing has room on those terms any machine that can run the task will do */ 
+    SLAType_t sla = info.required_sla; 
+    unsigned mips = taskMips(info); 
+    MachineId_t chosen = findBestMachine(info, slaNeed(sla, cpu, mips)); 
+    if(chosen == -1) {
+        chosen = feasibleArgmin((const int32_t *)remainingMips.data(), remainingMemory.data(), placementRank(info), eligible.data(), 
+                                ELIGIBLE(cpu), total_machines, mips, info.required_memory, NULL); 
+    }
 
-        if(Machine_GetInfo(chosen).s_state != S0 
-            || std::find(turningOff.begin(), turningOff.end(), chosen) != turningOff.end()) {
-            chosen = -1; 
+    SCHED_LOG(1, "Chosen machine: " + to_string(chosen));
+
+    /* No machine has room: fall back on an S0 machine of the right type, scanning from a random one */
+    uint8_t reason = REASON_PLACE; 
+    if(chosen == -1) {
+        reason = REASON_FALLBACK; 
+        vector<MachineId_t> *list = typeMachines(cpu); 
+        unsigned size = (*list).size(); 
+        unsigned start = size ? std::rand() % size : 0; 
+        for(unsigned i = 0; i < size && chosen == -1; i++) {
+            MachineId_t mid = (*list).at((start + i) % size); 
+            if(catalogSState[mid] == S0 && !turningOff[mid]) {
+                chosen = mid; 
+            }
         }
     }
 
+    /* Not even that: hold the task until a machine of its type is woken for it */
+    if(chosen == -1) {
+        parkedTasks[cpu].push_back(std::make_pair(task_id, info)); 
+        wakeForParked(cpu); 
+        return; 
+    }
+
     /* Put the task on the machine */
     if(vmMap.find(chosen) == vmMap.end()) {
         vmMap[chosen] = {}; 
     }
-    VMId_t vid = VM_Create(info.required_vm, info.required_cpu); 
-    isMigrating[vid] = false; 
+    VMId_t vid = acquireVM(chosen, info.required_vm, info.required_cpu); 
     vmMap[chosen].push_back(vid); 
     taskToVM[task_id] = vid; 
     taskMap[task_id] = chosen; 
-    VM_Attach(vid, chosen); 
     VM_AddTask(vid, task_id, info.priority); 
-    if(remainingMips[chosen] >= 1000) {
-        remainingMips[chosen] -= 1000; 
+    traceDecision(TRACE_PLACE, reason, chosen, vid, task_id, info.required_vm); 
+    if(remainingMips[chosen] >= mips) {
+        remainingMips[chosen] -= mips; 
     } else {
         remainingMips[chosen] = 0; 
     }
@@ -231,7 +736,11 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
     } else {
         remainingMemory[chosen] = 0; 
     }
-    if(numTasks[chosen] == 0) {
+    slaHost(chosen, sla, 1); 
+
+    /* Count the task before updateMachines runs so the machine isn't taken for an idle one */
+    numTasks[chosen]++; 
+    if(numTasks[chosen] == 1) {
         switch (info.required_cpu) {
             case X86:
                 activex86++; 
@@ -250,10 +759,16 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
         }
         updateMachines(info.required_cpu); 
     }
-    numTasks[chosen]++; 
+    reindexMachine(chosen); 
+    slackAdd(task_id, chosen, currentTime); 
 
-    /* Adjust P-State as needed */
-    unsigned mipsNeeded = Machine_GetInfo(chosen).performance[0] - remainingMips[chosen]; 
+    /* Adjust P-State as needed, SLA0/SLA1 hosts run at P0 */
+    if(slaPinned(chosen)) {
+        setMachinePerformance(chosen, P0, REASON_DEMAND); 
+        return; 
+    }
+    unsigned capacity = machinePerformance(chosen, 0) * catalogNumCpus[chosen]; 
+    unsigned mipsNeeded = capacity - std::min(capacity, remainingMips[chosen]); 
     CPUPerformance_t pState; 
     for(int i = 3; i >= 0; i--) {
 
@@ -274,81 +789,87 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
                 break; 
         }
 
-        if(Machine_GetInfo(chosen).performance[i] >= mipsNeeded) {
-            for(int j = 0; j < Machine_GetInfo(chosen).num_cpus; j++) {
-                Machine_SetCorePerformance(chosen, j, pState); 
-            }
+        if(machinePerformance(chosen, i) * catalogNumCpus[chosen] >= mipsNeeded) {
+            setMachinePerformance(chosen, pState, REASON_DEMAND); 
             break; 
         }
     }
 }
 
-void Scheduler::PeriodicCheck(Time_t now) {
-    // This method should be called from SchedulerCheck()
-    // SchedulerCheck is called periodically by the simulator to allow you to monitor, make decisions, adjustments, etc.
-    // Unlike the other invocations of the scheduler, this one doesn't report any specific event
-    // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
+vector<MachineId_t>* typeMachines(CPUType_t type) {
+    switch(type) {
+        case X86:
+            return &x86Machines; 
+        case ARM:
+            return &armMachines; 
+        case POWER:
+            return &powerMachines; 
+        default:
+            return &riscvMachines; 
+    }
 }
 
-void Scheduler::Shutdown(Time_t time) {
-    // Do your final reporting and bookkeeping here.
-    // Report about the total energy consumed
-    // Report about the SLA compliance
-    // Shutdown everything to be tidy :-)
-    SimOutput("Shutting Down", 0); 
-    for(auto & vm: vms) {
-        VM_Shutdown(vm);
+/* Wake one sleeping machine of the type for its held tasks, unless one is already on its way up */
+void wakeForParked(CPUType_t cpu) {
+    MachineId_t wake = -1; 
+    for(MachineId_t mid: *typeMachines(cpu)) {
+        if(wakeRequested[mid] != NO_WAKE) {
+            return; 
+        }
+        if(wake == -1 && catalogSState[mid] != S0) {
+            wake = mid; 
+        }
+    }
+    if(wake != -1) {
+        setMachineState(wake, S0, REASON_FALLBACK); 
     }
-    SimOutput("SimulationComplete(): Finished!", 4);
-    SimOutput("SimulationComplete(): Time is " + to_string(time), 4);
 }
 
-void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
-
-    // Do any bookkeeping necessary for the data structures
-    // Decide if a machine is to be turned off, slowed down, or VMs to be migrated according to your policy
-    // This is an opportunity to make any adjustments to optimize performance/energy
-
-    SimOutput("Finishing Task " + to_string(task_id), 1); 
-    TaskInfo_t info = GetTaskInfo (task_id); 
-    CPUType_t cpu = info.required_cpu; 
-    VMType_t os = info.required_vm; 
-
-    MachineId_t mid = taskMap[task_id];
-    vector<VMId_t> *machine_vms = &vmMap[mid];
-    VMId_t toRemove = taskToVM[task_id]; 
-
-    remainingMemory[mid] += info.required_memory; 
-    remainingMips[mid] += 1000; 
-    numTasks[mid]--; 
+/* A machine of the type finished a state change while tasks were held: place them if it came up,
+   otherwise it went down under them and one of the type has to be woken again */
+void unparkTasks(MachineId_t mid) {
+    CPUType_t cpu = catalogCpu[mid]; 
+    if(parkedTasks[cpu].empty()) {
+        return; 
+    }
+    if(catalogSState[mid] != S0) {
+        wakeForParked(cpu); 
+        return; 
+    }
+    vector<std::pair<TaskId_t, TaskInfo_t>> parked; 
+    parked.swap(parkedTasks[cpu]); 
+    for(auto & task: parked) {
+        placeTask(task.first, task.second); 
+    }
+}
 
-    if(numTasks[mid] == 0) {
-        switch (info.required_cpu) {
-            case X86:
-                activex86--; 
-                break; 
-            case ARM:
-                activeArm--;
-                break; 
-            case POWER:
-                activePower--; 
-                break; 
-            case RISCV:
-                activeRiscv--; 
-                break; 
-            default:
-                break; 
+/* Best fit decreasing: the largest tasks claim the tightest fits first, small ones fill the gaps */
+void flushBatch() {
+    std::sort(pendingTasks.begin(), pendingTasks.end(), [](const std::pair<TaskId_t, TaskInfo_t> &a, const std::pair<TaskId_t, TaskInfo_t> &b) {
+        double sizeA = batchSize(a.second); 
+        double sizeB = batchSize(b.second); 
+        if(sizeA != sizeB) {
+            return sizeA > sizeB; 
         }
-        updateMachines(info.required_cpu); 
+        return a.first < b.first; 
+    });
+    for(auto & pending: pendingTasks) {
+        placeTask(pending.first, pending.second); 
     }
+    pendingTasks.clear(); 
+}
 
-    if(!isMigrating[toRemove]) {
-        VM_Shutdown(toRemove); 
-        (*machine_vms).erase(std::remove((*machine_vms).begin(), (*machine_vms).end(), toRemove), (*machine_vms).end()); 
+void flushDue(Time_t now) {
+    if(!pendingTasks.empty() && now > batchStart + batchQuantum) {
+        flushBatch(); 
     }
-    
+}
 
-    SimOutput("Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now), 4);
+/* A task's size is its larger share of an average machine of its type, in memory or MIPS */
+double batchSize(const TaskInfo_t &info) {
+    double memory = info.required_memory / std::max(typeMemory[info.required_cpu], 1.0); 
+    double mips = taskMips(info) / std::max(slaCapacity[info.required_cpu], 1.0); 
+    return std::max(memory, mips); 
 }
 
 // Public interface below
@@ -356,23 +877,32 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 static Scheduler Scheduler;
 
 void InitScheduler() {
-    SimOutput("InitScheduler(): Initializing scheduler", 4);
+    CallbackTimer timer(CB_INIT); 
+    openTrace(); 
+    SCHED_LOG(4, "InitScheduler(): Initializing scheduler");
     Scheduler.Init();
 }
 
 void HandleNewTask(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time), 4);
+    CallbackTimer timer(CB_NEW_TASK); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time));
     Scheduler.NewTask(time, task_id);
 }
 
 void HandleTaskCompletion(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time), 4);
+    CallbackTimer timer(CB_TASK_COMPLETE); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time));
     Scheduler.TaskComplete(time, task_id);
 }
 
 void MemoryWarning(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_MEMORY_WARNING); 
+    currentTime = time; 
     // The simulator is alerting you that machine identified by machine_id is overcommitted
-    SimOutput("MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time), 0);
+    SCHED_LOG(0, "MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time));
+    flushDue(time); 
 
     /* Get a list of all tasks */
     vector<TaskId_t> tasks; 
@@ -393,94 +923,37 @@ void MemoryWarning(Time_t time, MachineId_t machine_id) {
     });
     
 
-    /* Get the list of machines that can be migrated to */
-    vector<MachineId_t> list;
-    CPUType_t cpu = Machine_GetInfo(machine_id).cpu; 
-    switch (cpu) {
-        case X86:
-            list = x86Machines; 
-            break; 
-        case ARM:
-            list = armMachines;
-            break;
-        case POWER:
-            list = powerMachines;
-            break;
-        default:
-            list = riscvMachines; 
-            break;
-    }    
-
-    unsigned listSize = list.size(); 
+    /* Move each VM to the most efficient machine of the same type that can hold it */
+    CPUType_t cpu = catalogCpu[machine_id]; 
     for(int i = 0; i < machine_vms.size(); i++) {
-        for(int j = 0; j < listSize; j++) {
-            if( list.at(j) != machine_id 
-                && Machine_GetInfo(list.at(j)).s_state == S0
-                && std::find(turningOff.begin(), turningOff.end(), list.at(j)) == turningOff.end()
-                && !isMigrating[machine_vms.at(i)] && VM_GetInfo(machine_vms.at(i)).active_tasks.size() != 0
-                && hasEnoughResource(list.at(j), VM_GetInfo(machine_vms.at(i)).active_tasks.at(0))) {
-                remainingMips[machine_id] += 1000;
-                remainingMips[list.at(j)] -= 1000;
-                remainingMemory[machine_id] += GetTaskMemory(VM_GetInfo(machine_vms.at(i)).active_tasks.at(0)); 
-                remainingMemory[list.at(j)] -= GetTaskMemory(VM_GetInfo(machine_vms.at(i)).active_tasks.at(0)); 
-                numTasks[machine_id]--; 
-                if(numTasks[machine_id] == 0) {
-                    switch(cpu) {
-                        case X86:
-                            activex86--; 
-                            break;
-                        case ARM:
-                            activeArm--;
-                            break;
-                        case POWER:
-                            activePower--;
-                            break; 
-                        case RISCV:
-                            activeRiscv--;
-                            break;
-                        default:
-                            break; 
-                    }
-                }
-                if(numTasks[list.at(j)] == 0) {
-                    switch(cpu) {
-                        case X86:
-                            activex86++; 
-                            break;
-                        case ARM:
-                            activeArm++;
-                            break;
-                        case POWER:
-                            activePower++;
-                            break; 
-                        case RISCV:
-                            activeRiscv++;
-                            break;
-                        default:
-                            break; 
-                    }
-                }
-                numTasks[list.at(j)]++;
-                updateMachines(cpu); 
-                isMigrating[machine_vms.at(i)] = true; 
-                VM_Migrate(machine_vms.at(i), list.at(j)); 
-                j = list.size(); 
-            }
+        if(isMigrating[machine_vms.at(i)] || VM_GetInfo(machine_vms.at(i)).active_tasks.size() == 0) {
+            continue; 
         }
+        TaskInfo_t tinfo = GetTaskInfo(VM_GetInfo(machine_vms.at(i)).active_tasks.at(0)); 
+        MachineId_t target = findMigrationTarget(cpu, machine_id, tinfo.required_memory, taskMips(tinfo)); 
+        if(target == -1) {
+            continue; 
+        }
+        migrateVM(machine_vms.at(i), machine_id, target, REASON_MEMORY_WARNING); 
     }
 }
 
 void MigrationDone(Time_t time, VMId_t vm_id) {
+    CallbackTimer timer(CB_MIGRATION_DONE); 
+    currentTime = time; 
     // The function is called on to alert you that migration is complete
-    SimOutput("MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time), 4);
+    SCHED_LOG(4, "MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time));
+    flushDue(time); 
     isMigrating[vm_id] = false; 
     Scheduler.MigrationComplete(time, vm_id);
     migrating = false;   
 } 
 
 void SchedulerCheck(Time_t time) {
+    CallbackTimer timer(CB_SCHEDULER_CHECK); 
+    currentTime = time; 
     // This function is called periodically by the simulator, no specific event
-    SimOutput("SchedulerCheck(): SchedulerCheck() called at " + to_string(time), 4);
+    SCHED_LOG(4, "SchedulerCheck(): SchedulerCheck() called at " + to_string(time));
     Scheduler.PeriodicCheck(time);
     static unsigned counts = 0;
     counts++;
@@ -491,6 +964,7 @@ void SchedulerCheck(Time_t time) {
 }
 
 void SimulationComplete(Time_t time) {
+    currentTime = time; 
     // This function is called before the simulation terminates Add whatever you feel like.
     cout << "SLA violation report" << endl;
     cout << "SLA0: " << GetSLAReport(SLA0) << "%" << endl;
@@ -498,120 +972,34 @@ void SimulationComplete(Time_t time) {
     cout << "SLA2: " << GetSLAReport(SLA2) << "%" << endl;     // SLA3 do not have SLA violation issues
     cout << "Total Energy " << Machine_GetClusterEnergy() << "KW-Hour" << endl;
     cout << "Simulation run finished in " << double(time)/1000000 << " seconds" << endl;
-    SimOutput("SimulationComplete(): Simulation finished at time " + to_string(time), 4);
+    reportLatency();
+    SCHED_LOG(4, "SimulationComplete(): Simulation finished at time " + to_string(time));
     
     Scheduler.Shutdown(time);
+    closeTrace();
 }
 
 void SLAWarning(Time_t time, TaskId_t task_id) {
-    /* Get a list of all tasks */
-    MachineId_t machine_id = taskMap[task_id]; 
-    vector<TaskId_t> tasks; 
-    vector<VMId_t> machine_vms = vmMap[machine_id]; 
-    for(int i = 0; i < machine_vms.size(); i++) {
-        VMInfo_t vinfo = VM_GetInfo(machine_vms.at(i)); 
-        for(int j = 0; j < vinfo.active_tasks.size(); j++) {
-            tasks.push_back(vinfo.active_tasks.at(j)); 
-        }
-    }
-
-    /* Sort the list of tasks by their memory usage*/
-    std::sort(machine_vms.begin(), machine_vms.end(), [](VMId_t a, VMId_t b) {
-        if(VM_GetInfo(a).active_tasks.size() == 0 || VM_GetInfo(b).active_tasks.size() == 0) {
-            return false; 
-        } 
-        return GetTaskMemory(VM_GetInfo(a).active_tasks.at(0)) > GetTaskMemory(VM_GetInfo(b).active_tasks.at(0)); // Sort in descending order
-    });
-    
-
-    /* Get the list of machines that can be migrated to */
-    vector<MachineId_t> list;
-    CPUType_t cpu = Machine_GetInfo(machine_id).cpu; 
-    switch (cpu) {
-        case X86:
-            list = x86Machines; 
-            break; 
-        case ARM:
-            list = armMachines;
-            break;
-        case POWER:
-            list = powerMachines;
-            break;
-        default:
-            list = riscvMachines; 
-            break;
-    }    
-
-    unsigned listSize = list.size(); 
-    for(int i = 0; i < machine_vms.size(); i++) {
-        for(int j = 0; j < listSize; j++) {
-            if( list.at(j) != machine_id 
-                && Machine_GetInfo(list.at(j)).s_state == S0
-                && std::find(turningOff.begin(), turningOff.end(), list.at(j)) == turningOff.end()
-                && !isMigrating[machine_vms.at(i)] && VM_GetInfo(machine_vms.at(i)).active_tasks.size() != 0
-                && hasEnoughResource(list.at(j), VM_GetInfo(machine_vms.at(i)).active_tasks.at(0))) {
-                remainingMips[machine_id] += 1000;
-                remainingMips[list.at(j)] -= 1000;
-                remainingMemory[machine_id] += GetTaskMemory(VM_GetInfo(machine_vms.at(i)).active_tasks.at(0)); 
-                remainingMemory[list.at(j)] -= GetTaskMemory(VM_GetInfo(machine_vms.at(i)).active_tasks.at(0)); 
-                numTasks[machine_id]--; 
-                if(numTasks[machine_id] == 0) {
-                    switch(cpu) {
-                        case X86:
-                            activex86--; 
-                            break;
-                        case ARM:
-                            activeArm--;
-                            break;
-                        case POWER:
-                            activePower--;
-                            break; 
-                        case RISCV:
-                            activeRiscv--;
-                            break;
-                        default:
-                            break; 
-                    }
-                }
-                if(numTasks[list.at(j)] == 0) {
-                    switch(cpu) {
-                        case X86:
-                            activex86++; 
-                            break;
-                        case ARM:
-                            activeArm++;
-                            break;
-                        case POWER:
-                            activePower++;
-                            break; 
-                        case RISCV:
-                            activeRiscv++;
-                            break;
-                        default:
-                            break; 
-                    }
-                }
-                numTasks[list.at(j)]++;
-                updateMachines(cpu); 
-                VM_Migrate(machine_vms.at(i), list.at(j)); 
-                isMigrating[machine_vms.at(i)] = true; 
-                j = list.size(); 
-            }
-        }
-    }
+    CallbackTimer timer(CB_SLA_WARNING); 
+    currentTime = time; 
+    flushDue(time); 
+    /* Rescue the late task alone, one step at a time, instead of emptying its host */
+    rescueStart(task_id, time); 
 }
 
 void StateChangeComplete(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_STATE_CHANGE); 
+    currentTime = time; 
     // Called in response to an earlier request to change the state of a machine
-    SimOutput("Machine " + to_string(machine_id) + " has changed to state " + to_string(Machine_GetInfo(machine_id).s_state), 4); 
-    if(Machine_GetInfo(machine_id).s_state != S0) {
-        for(int i = 0; i < turningOff.size(); i++) {
-            if(turningOff.at(i) == machine_id) {
-                turningOff.erase(turningOff.begin() + i); 
-                i = turningOff.size(); 
-            }
-        } 
+    catalogSState[machine_id] = Machine_GetInfo(machine_id).s_state; 
+    forecastWakeDone(machine_id, time); 
+    SCHED_LOG(4, "Machine " + to_string(machine_id) + " has changed to state " + to_string(catalogSState[machine_id])); 
+    if(catalogSState[machine_id] != S0) {
+        turningOff[machine_id] = false; 
     }
+    reindexMachine(machine_id); 
+    unparkTasks(machine_id); 
+    flushDue(time); 
 }
 
 unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id) {
@@ -621,12 +1009,10 @@ unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id) {
         return 0; 
     }
 
-    MachineInfo_t newInfo = Machine_GetInfo (id); 
-    double new_ee = newInfo.performance.at(0) / newInfo.p_states.at(0); 
+    double new_ee = machinePerformance(id, 0) / machinePStatePower(id, 0); 
 
     for (unsigned i = 0; i < (*mList).size(); i++) {
-        MachineInfo_t info = Machine_GetInfo((*mList).at(i));
-        double ee = info.performance.at(0) / info.p_states.at(0); 
+        double ee = machinePerformance((*mList).at(i), 0) / machinePStatePower((*mList).at(i), 0); 
         if (new_ee > ee) {
             (*mList).insert((*mList).begin() + i, id); 
             return i; 
@@ -639,10 +1025,9 @@ unsigned insert_sorted_ee(vector<MachineId_t>* mList, MachineId_t id) {
 
 /* Mayber Update to Use Tresholds */
 bool hasEnoughResource(MachineId_t mid, TaskId_t tid) {
-    MachineInfo_t minfo = Machine_GetInfo(mid); 
     TaskInfo_t tinfo = GetTaskInfo(tid); 
 
-    unsigned mipsRequired = 1000; 
+    unsigned mipsRequired = taskMips(tinfo); 
     if(remainingMips[mid] < mipsRequired) {
         return false; 
     }
@@ -655,26 +1040,18 @@ bool hasEnoughResource(MachineId_t mid, TaskId_t tid) {
     return true; 
 }
 
-unsigned estimatedPower(MachineId_t mid, TaskId_t tid) {
-    
-    MachineInfo_t minfo = Machine_GetInfo(mid);
-    TaskInfo_t tinfo = GetTaskInfo(tid); 
+/* Power the machine would draw after taking on mips more demand; only depends on the machine's own load */
+unsigned estimatedPower(MachineId_t mid, unsigned mips) {
 
-    int mipsUsed = minfo.p_states.at(0) - remainingMips[mid];
-    mipsUsed += 1000;
-    unsigned energy; 
+    unsigned capacity = machinePerformance(mid, 0) * catalogNumCpus[mid]; 
+    unsigned mipsUsed = capacity - std::min(capacity, remainingMips[mid]) + mips;
 
-    if(minfo.s_states.size() == 0) {
-        /* It seems like the s_states aren't populating in some situations */
-        energy = 0; 
-    } else {
-        energy = minfo.s_states.at(0); 
-    }
-    
+    /* It seems like the s_states aren't populating in some situations, the catalog reports 0 then */
+    unsigned energy = machineSStatePower(mid, S0); 
 
     for(int i = 3; i >= 0; i--) {
-        if(minfo.performance[i] >= mipsUsed) {           
-            energy += minfo.p_states[i]; 
+        if(machinePerformance(mid, i) * catalogNumCpus[mid] >= mipsUsed) {           
+            energy += machinePStatePower(mid, i); 
             break; 
         }
     }
@@ -682,56 +1059,1116 @@ unsigned estimatedPower(MachineId_t mid, TaskId_t tid) {
     return energy; 
 }
 
-/* Turn machines on/off to save energy */
-void updateMachines(CPUType_t type) {
-    double tresholdS0 = 0.75;
-    vector<MachineId_t> list;  
-    unsigned active = 0; 
-    switch(type) {
-        case X86:
-            list = x86Machines; 
-            active = activex86; 
-            break;
-        case ARM:
-            list = armMachines; 
-            active = activeArm; 
-            break;
-        case POWER:
-            list = powerMachines; 
-            active = activePower; 
-            break; 
-        case RISCV:
-            list = riscvMachines;
-            active = activeRiscv; 
-            break; 
-        default:
-            break; 
-    } 
+/* Index key: the power the machine draws one P-state step above the one its current load needs,
+   the most the next task can bring it to. It only changes with the machine's own load */
+unsigned indexPower(MachineId_t mid) {
+    unsigned capacity = machinePerformance(mid, 0) * catalogNumCpus[mid]; 
+    unsigned mipsUsed = capacity - std::min(capacity, remainingMips[mid]); 
+    int state = 3; 
+    while(state > 0 && machinePerformance(mid, state) * catalogNumCpus[mid] < mipsUsed) {
+        state--; 
+    }
+    return machineSStatePower(mid, S0) + machinePStatePower(mid, std::max(state - 1, 0)); 
+}
 
-    unsigned size = list.size();
-    unsigned totalInactive = list.size() - active; 
-    unsigned inactiveNum = 0; 
-    for(int i = 0; i < size; i++) { 
-        MachineId_t mid = list.at(i);
-        MachineInfo_t minfo = Machine_GetInfo(mid); 
-        if(totalInactive <= 8) {
-            if(minfo.s_state != S0) {
-                Machine_SetState(mid, S0); 
-            } 
-        } else {
-            if(numTasks[mid] == 0) {
-                if(inactiveNum < totalInactive * tresholdS0) {
-                    if(minfo.s_state != S0) {
-                        Machine_SetState(mid, S0);
-                    }
-                } else {
-                    if(minfo.s_state != S1) {
-                        Machine_SetState(mid, S1); 
-                        turningOff.push_back(mid); 
-                    }
+/* Hand out the most recently idled VM of this type on the machine, or create and attach one */
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu) {
+    vector<VMId_t> &pool = warmVMs[mid * NUM_VM_TYPES + type]; 
+    for(int i = int(pool.size()) - 1; i >= 0; i--) {
+        VMId_t vid = pool[i]; 
+        if(isMigrating[vid]) {
+            continue; 
+        }
+        pool.erase(pool.begin() + i); 
+        vmIdle[vid] = false; 
+        return vid; 
+    }
+    VMId_t vid = VM_Create(type, cpu); 
+    trackVM(vid); 
+    vmHost[vid] = mid; 
+    vmType[vid] = type; 
+    vmLive[vid] = true; 
+    VM_Attach(vid, mid); 
+    traceDecision(TRACE_VM_ATTACH, REASON_PLACE, mid, vid, TRACE_NONE, type); 
+    return vid; 
+}
+
+void releaseVM(VMId_t vid, Time_t now) {
+    vmIdle[vid] = true; 
+    vmIdleSince[vid] = now; 
+    warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]].push_back(vid); 
+    idleVMs.push_back(std::make_pair(now, vid)); 
+}
+
+/* Entries for VMs that were handed out again since they were queued are skipped */
+void reclaimIdleVMs(Time_t now) {
+    while(!idleVMs.empty() && idleVMs.front().first + vmIdleLimit <= now) {
+        Time_t since = idleVMs.front().first; 
+        VMId_t vid = idleVMs.front().second; 
+        idleVMs.pop_front(); 
+        if(!vmIdle[vid] || vmIdleSince[vid] != since) {
+            continue; 
+        }
+        if(isMigrating[vid]) {
+            /* Look again once the migration has landed */
+            vmIdleSince[vid] = now; 
+            idleVMs.push_back(std::make_pair(now, vid)); 
+            continue; 
+        }
+        vector<VMId_t> &pool = warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]]; 
+        pool.erase(std::remove(pool.begin(), pool.end(), vid), pool.end()); 
+        vmIdle[vid] = false; 
+        vmLive[vid] = false; 
+        VM_Shutdown(vid); 
+        traceDecision(TRACE_VM_SHUTDOWN, REASON_RECLAIM, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+    }
+}
+
+/* Follow a migrating VM and its task to the target machine */
+void moveVM(VMId_t vid, MachineId_t target) {
+    MachineId_t source = vmHost[vid]; 
+    vector<VMId_t> &from = vmMap[source]; 
+    from.erase(std::remove(from.begin(), from.end(), vid), from.end()); 
+    vmMap[target].push_back(vid); 
+    vmHost[vid] = target; 
+    for(TaskId_t task: VM_GetInfo(vid).active_tasks) {
+        taskMap[task] = target; 
+        slackMove(task, source, target, currentTime); 
+    }
+}
+
+/* Migrate a VM and carry its task's share of the accounting from source to target */
+void migrateVM(VMId_t vid, MachineId_t source, MachineId_t target, uint8_t reason) {
+    TaskId_t task = VM_GetInfo(vid).active_tasks.at(0); 
+    CPUType_t cpu = catalogCpu[source]; 
+    unsigned mips = taskMips(GetTaskInfo(task)); 
+    remainingMips[source] += mips;
+    remainingMips[target] -= mips;
+    remainingMemory[source] += GetTaskMemory(task); 
+    remainingMemory[target] -= GetTaskMemory(task); 
+    slaHost(source, RequiredSLA(task), -1); 
+    slaHost(target, RequiredSLA(task), 1); 
+    numTasks[source]--; 
+    if(numTasks[source] == 0) {
+        switch(cpu) {
+            case X86:
+                activex86--; 
+                break;
+            case ARM:
+                activeArm--;
+                break;
+            case POWER:
+                activePower--;
+                break; 
+            case RISCV:
+                activeRiscv--;
+                break;
+            default:
+                break; 
+        }
+    }
+    if(numTasks[target] == 0) {
+        switch(cpu) {
+            case X86:
+                activex86++; 
+                break;
+            case ARM:
+                activeArm++;
+                break;
+            case POWER:
+                activePower++;
+                break; 
+            case RISCV:
+                activeRiscv++;
+                break;
+            default:
+                break; 
+        }
+    }
+    numTasks[target]++;
+    reindexMachine(source); 
+    reindexMachine(target); 
+    updateMachines(cpu); 
+    isMigrating[vid] = true; 
+    VM_Migrate(vid, target); 
+    traceDecision(TRACE_MIGRATE, reason, target, vid, task, source); 
+    moveVM(vid, target); 
+}
+
+void shutdownVMs() {
+    for(unsigned vid = 0; vid < vmLive.size(); vid++) {
+        if(vmLive[vid]) {
+            VM_Shutdown(vid); 
+            vmLive[vid] = false; 
+            traceDecision(TRACE_VM_SHUTDOWN, REASON_SHUTDOWN, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+        }
+    }
+}
+
+/* Make room for a freshly created VM in the per-VM flags */
+void trackVM(VMId_t vid) {
+    if(vid >= isMigrating.size()) {
+        isMigrating.resize(vid + 1, false); 
+        vmHost.resize(vid + 1); 
+        vmType.resize(vid + 1); 
+        vmIdleSince.resize(vid + 1, 0); 
+        vmIdle.resize(vid + 1, false); 
+        vmLive.resize(vid + 1, false); 
+    }
+    isMigrating[vid] = false; 
+}
+
+/* Turn machines on/off to save energy */
+void updateMachines(CPUType_t type) {
+    double tresholdS0 = 0.75;
+    vector<MachineId_t> list;  
+    unsigned active = 0; 
+    switch(type) {
+        case X86:
+            list = x86Machines; 
+            active = activex86; 
+            break;
+        case ARM:
+            list = armMachines; 
+            active = activeArm; 
+            break;
+        case POWER:
+            list = powerMachines; 
+            active = activePower; 
+            break; 
+        case RISCV:
+            list = riscvMachines;
+            active = activeRiscv; 
+            break; 
+        default:
+            break; 
+    } 
+
+    unsigned size = list.size();
+    unsigned totalInactive = list.size() - active; 
+    unsigned inactiveNum = 0; 
+
+    /* Once the forecaster has history, keep only the idle machines its arrivals will need. A type
+       that forecasts no arrivals still keeps one machine in S0 while none of its machines is busy,
+       so its next task has somewhere to go without waiting on a wake-up */
+    double keepOn = totalInactive * tresholdS0; 
+    uint8_t wakeReason = REASON_DEMAND; 
+    if(forecasts[type].primed) {
+        unsigned want = forecastMachines(type); 
+        keepOn = want > active ? want - active : 0; 
+        if(active == 0) {
+            keepOn = std::max(keepOn, 1.0); 
+        }
+        wakeReason = REASON_FORECAST; 
+    }
+    for(int i = 0; i < size; i++) { 
+        MachineId_t mid = list.at(i);
+        if(totalInactive <= 8) {
+            if(catalogSState[mid] != S0) {
+                setMachineState(mid, S0, REASON_DEMAND); 
+            } 
+        } else {
+            if(numTasks[mid] == 0) {
+                if(inactiveNum < keepOn) {
+                    if(catalogSState[mid] != S0) {
+                        setMachineState(mid, S0, wakeReason);
+                    }
+                } else {
+                    if(catalogSState[mid] != S1) {
+                        setMachineState(mid, S1, REASON_IDLE); 
+                        turningOff[mid] = true; 
+                        reindexMachine(mid); 
+                    }
                 }
                 inactiveNum++;     
             }
         }  
     }
 }
+
+CapacityIndex_t* capacityIndex(CPUType_t type, bool gpus) {
+    switch(type) {
+        case X86:
+            return &x86Index[gpus]; 
+        case ARM:
+            return &armIndex[gpus]; 
+        case POWER:
+            return &powerIndex[gpus]; 
+        default:
+            return &riscvIndex[gpus]; 
+    }
+}
+
+/* Re-file a machine after its load or state changed; machines that can't take a task are dropped */
+void reindexMachine(MachineId_t mid) {
+    CapacityIndex_t *index = capacityIndex(catalogCpu[mid], catalogGpus[mid]); 
+    tierMips[mid] = int32_t(remainingMips[mid]) - int32_t(slaReserve(mid)); 
+
+    auto key = indexKey.find(mid); 
+    if(key != indexKey.end()) {
+        auto bucket = (*index).find(key->second.first); 
+        (*bucket).second.erase(std::make_pair(key->second.second, mid)); 
+        if((*bucket).second.empty()) {
+            (*index).erase(bucket); 
+        }
+        indexKey.erase(key); 
+    }
+
+    bool placeable = catalogSState[mid] == S0 && !turningOff[mid]; 
+    eligible[mid] = placeable ? ELIGIBLE(catalogCpu[mid]) : 0; 
+    if(!placeable || tierMips[mid] <= 0) {
+        return; 
+    }
+
+    unsigned power = indexPower(mid); 
+    (*index)[power].insert(std::make_pair(remainingMemory[mid], mid)); 
+    indexKey[mid] = std::make_pair(power, remainingMemory[mid]); 
+}
+
+/* Lowest power first, then the machine other than skip whose remaining memory fits most tightly
+   and whose room is at least mips; key gets the machine's (power, memory) for comparing picks */
+MachineId_t indexLookup(CapacityIndex_t *index, unsigned memory, unsigned mips, const int32_t *room, MachineId_t skip, std::pair<unsigned, unsigned> *key) {
+    for(auto & bucket: *index) {
+        for(auto fit = bucket.second.lower_bound(std::make_pair(memory, MachineId_t(0))); fit != bucket.second.end(); fit++) {
+            if(fit->second != skip && room[fit->second] >= signed(mips)) {
+                *key = std::make_pair(bucket.first, fit->first); 
+                return fit->second; 
+            }
+        }
+    }
+    return -1; 
+}
+
+/* Best indexed machine for a task that leaves mips of its SLA reserve. A GPU-capable task takes a
+   GPU host when one has room and, while GPU hosts are held back, other tasks take one only when no
+   plain host has room; otherwise the two indexes compete on power and fit */
+MachineId_t findBestMachine(const TaskInfo_t &info, unsigned mips) {
+    CPUType_t cpu = info.required_cpu; 
+    std::pair<unsigned, unsigned> gpuKey, plainKey; 
+    MachineId_t gpu = indexLookup(capacityIndex(cpu, true), info.required_memory, mips, tierMips.data(), -1, &gpuKey); 
+    if(info.gpu_capable && gpu != -1) {
+        return gpu; 
+    }
+    MachineId_t plain = indexLookup(capacityIndex(cpu, false), info.required_memory, mips, tierMips.data(), -1, &plainKey); 
+    if(plain == -1 || gpu == -1) {
+        return (plain == -1) ? gpu : plain; 
+    }
+    if(gpuReserved(cpu)) {
+        return plain; 
+    }
+    return (gpuKey < plainKey) ? gpu : plain; 
+}
+
+/* Machine other than the source with room for a migrated task, taken from the capacity index like
+   a placement; only when nothing indexed has room are the rest of the type's machines scanned */
+MachineId_t findMigrationTarget(CPUType_t type, MachineId_t source, unsigned memory, unsigned mips) {
+    std::pair<unsigned, unsigned> gpuKey, plainKey; 
+    const int32_t *room = (const int32_t *)remainingMips.data(); 
+    MachineId_t gpu = indexLookup(capacityIndex(type, true), memory, mips, room, source, &gpuKey); 
+    MachineId_t plain = indexLookup(capacityIndex(type, false), memory, mips, room, source, &plainKey); 
+    if(gpu != -1 || plain != -1) {
+        return (plain == -1 || (gpu != -1 && gpuKey < plainKey)) ? gpu : plain; 
+    }
+    uint8_t saved = eligible[source]; 
+    eligible[source] = 0; 
+    int target = feasibleArgmin((const int32_t *)remainingMips.data(), remainingMemory.data(), eeRank.data(), eligible.data(), 
+                                ELIGIBLE(type), total_machines, mips, memory, NULL); 
+    eligible[source] = saved; 
+    return target; 
+}
+
+/* Bring the late task's host up to P0, false when it already runs there */
+bool rescueBoost(TaskId_t tid, MachineId_t mid, Time_t now) {
+    if(catalogPState[mid] == P0) {
+        return false; 
+    }
+    setMachinePerformance(mid, P0, REASON_SLA_WARNING); 
+    return true; 
+}
+
+/* Move the late task's VM to the most efficient machine of its type with room for it */
+bool rescueMigrate(TaskId_t tid, MachineId_t mid, Time_t now) {
+    VMId_t vid = taskToVM[tid]; 
+    if(isMigrating[vid]) {
+        return false; 
+    }
+    MachineId_t target = findMigrationTarget(catalogCpu[mid], mid, GetTaskMemory(tid), taskMips(GetTaskInfo(tid))); 
+    if(target == -1) {
+        return false; 
+    }
+    migrateVM(vid, mid, target, REASON_SLA_WARNING); 
+    return true; 
+}
+
+/* A task short of slack first gets its host brought up to P0; on a host already there its VM moves
+   to the most efficient machine where it would run quicker, if there is one */
+void slackRescue(TaskId_t tid, MachineId_t mid, Time_t now) {
+    if(catalogPState[mid] != P0) {
+        setMachinePerformance(mid, P0, REASON_SLACK); 
+        return; 
+    }
+    VMId_t vid = taskToVM[tid]; 
+    if(isMigrating[vid]) {
+        return; 
+    }
+    MachineId_t target = findMigrationTarget(catalogCpu[mid], mid, GetTaskMemory(tid), taskMips(GetTaskInfo(tid))); 
+    if(target != -1 && slackRate(target, slackOn[target].size() + 1) > slackRate(mid, slackOn[mid].size())) {
+        migrateVM(vid, mid, target, REASON_SLACK); 
+    }
+}
+
+/* SHARED BEGIN latency-impl */
+void histRecord(LatencyHist_t *hist, uint64_t ns) {
+    unsigned bucket = ns; 
+    if(ns >= (1u << HIST_SUB_BITS)) {
+        unsigned shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS; 
+        bucket = ((shift + 1) << HIST_SUB_BITS) + ((ns >> shift) & ((1u << HIST_SUB_BITS) - 1)); 
+    }
+    hist->buckets[bucket]++; 
+    hist->count++; 
+    hist->total += ns; 
+    if(ns > hist->max) {
+        hist->max = ns; 
+    }
+}
+
+/* Lower edge of the bucket holding the q-th fraction of the samples */
+uint64_t histPercentile(const LatencyHist_t *hist, double q) {
+    uint64_t rank = uint64_t(q * hist->count); 
+    uint64_t seen = 0; 
+    for(unsigned bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += hist->buckets[bucket]; 
+        if(seen > rank) {
+            if(bucket < (1u << HIST_SUB_BITS)) {
+                return bucket; 
+            }
+            unsigned shift = (bucket >> HIST_SUB_BITS) - 1; 
+            return uint64_t((1u << HIST_SUB_BITS) + (bucket & ((1u << HIST_SUB_BITS) - 1))) << shift; 
+        }
+    }
+    return hist->max; 
+}
+
+void reportLatency() {
+    cout << "Scheduler overhead (ns)" << endl;
+    for(unsigned i = 0; i < CB_COUNT; i++) {
+        const LatencyHist_t *hist = &callbackLatency[i]; 
+        if(hist->count == 0) {
+            continue; 
+        }
+        cout << hist->name << ": calls " << hist->count << " total " << hist->total 
+             << " p50 " << histPercentile(hist, 0.5) << " p99 " << histPercentile(hist, 0.99) 
+             << " max " << hist->max << endl;
+    }
+}
+/* SHARED END latency-impl */
+
+/* SHARED BEGIN trace-impl */
+void openTrace() {
+    const char *path = getenv("SCHED_TRACE"); 
+    if(path == NULL || traceFile != NULL) {
+        return; 
+    }
+    traceFile = fopen(path, "wb"); 
+    if(traceFile == NULL) {
+        SCHED_LOG(0, string("Cannot open trace file ") + path); 
+        return; 
+    }
+    TraceHeader_t header; 
+    memset(&header, 0, sizeof(header)); 
+    memcpy(header.magic, "SCHTRACE", 8); 
+    header.version = TRACE_VERSION; 
+    header.recordSize = sizeof(TraceRecord_t); 
+    strncpy(header.algorithm, SCHED_NAME, sizeof(header.algorithm) - 1); 
+    fwrite(&header, sizeof(header), 1, traceFile); 
+}
+
+void closeTrace() {
+    if(traceFile == NULL) {
+        return; 
+    }
+    fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+    traceCount = 0; 
+    fclose(traceFile); 
+    traceFile = NULL; 
+}
+
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg) {
+    if(traceFile == NULL) {
+        return; 
+    }
+    TraceRecord_t &record = traceBuffer[traceCount++]; 
+    record.time = currentTime; 
+    record.machine = mid; 
+    record.vm = vid; 
+    record.task = tid; 
+    record.kind = kind; 
+    record.reason = reason; 
+    record.arg = arg; 
+    memset(record.reserved, 0, sizeof(record.reserved)); 
+    if(traceCount == TRACE_BUFFER) {
+        fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+        traceCount = 0; 
+    }
+}
+/* SHARED END trace-impl */
+
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason) {
+    if(state == S0) {
+        forecastWakeStart(mid); 
+    }
+    Machine_SetState(mid, state); 
+    traceDecision(TRACE_SET_STATE, reason, mid, TRACE_NONE, TRACE_NONE, state); 
+}
+
+/* Every core of the machine to the same P-state */
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason) {
+    for(unsigned j = 0; j < catalogNumCpus[mid]; j++) {
+        Machine_SetCorePerformance(mid, j, p_state); 
+    }
+    traceDecision(TRACE_SET_PERF, reason, mid, TRACE_NONE, TRACE_NONE, p_state); 
+    /* Slowing down brings the host's tasks closer to their targets than they were filed for */
+    bool slower = p_state > catalogPState[mid]; 
+    catalogPState[mid] = p_state; 
+    if(slower) {
+        slackTouch(mid, currentTime); 
+    }
+}
+
+/* SHARED BEGIN forecast-impl */
+void forecastInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        forecasts[c] = Forecast_t(); 
+        wakeLatency[c] = forecastLead; 
+        forecastCores[c] = 0; 
+        forecastMemory[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        forecastCores[catalogCpu[i]] += catalogNumCpus[i]; 
+        forecastMemory[catalogCpu[i]] += catalogMemory[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            forecastCores[c] /= machines[c]; 
+            forecastMemory[c] /= machines[c]; 
+        }
+    }
+    wakeRequested.assign(Machine_GetTotal(), NO_WAKE); 
+}
+
+/* Close every interval that has ended, empty ones included */
+void forecastAdvance(Time_t now) {
+    unsigned seasons = std::min(forecastSeasons, unsigned(FORECAST_MAX_SEASONS)); 
+    for(int c = 0; c < 4; c++) {
+        Forecast_t *f = &forecasts[c]; 
+        unsigned closed = 0; 
+        while(now >= f->intervalStart + forecastInterval) {
+            double x = f->arrivals; 
+            f->arrivals = 0; 
+            f->intervalStart += forecastInterval; 
+            if(!f->primed) {
+                f->level = x; 
+                f->primed = true; 
+            } else if(seasons == 0) {
+                f->level = forecastAlpha * x + (1 - forecastAlpha) * f->level; 
+            } else {
+                double season = f->season[f->slot]; 
+                double level = forecastAlpha * (x - season) + (1 - forecastAlpha) * (f->level + f->trend); 
+                f->trend = forecastBeta * (level - f->level) + (1 - forecastBeta) * f->trend; 
+                f->season[f->slot] = forecastGamma * (x - level) + (1 - forecastGamma) * season; 
+                f->level = level; 
+                f->slot = (f->slot + 1) % seasons; 
+            }
+            /* After a long gap the model has decayed to the empty intervals; skip the rest */
+            if(++closed == 4 * (seasons + 1) + 16) {
+                f->intervalStart = now - (now % forecastInterval); 
+            }
+        }
+    }
+}
+
+void forecastArrival(CPUType_t cpu, const TaskInfo_t &info, Time_t now) {
+    forecastAdvance(now); 
+    Forecast_t *f = &forecasts[cpu]; 
+    f->arrivals++; 
+    if(f->lifetime == 0) {
+        f->lifetime = info.target_completion - info.arrival;    // the SLA window until a task finishes
+        f->memory = info.required_memory; 
+    }
+    f->memory = forecastAlpha * info.required_memory + (1 - forecastAlpha) * f->memory; 
+}
+
+void forecastCompletion(CPUType_t cpu, const TaskInfo_t &info, Time_t now) {
+    Forecast_t *f = &forecasts[cpu]; 
+    f->lifetime = forecastAlpha * (now - info.arrival) + (1 - forecastAlpha) * f->lifetime; 
+}
+
+/* Arrivals expected in the interval `ahead` intervals after the open one */
+double forecastRate(const Forecast_t *f, unsigned ahead) {
+    unsigned seasons = std::min(forecastSeasons, unsigned(FORECAST_MAX_SEASONS)); 
+    if(seasons == 0) {
+        return f->level; 
+    }
+    return std::max(0.0, f->level + ahead * f->trend + f->season[(f->slot + ahead) % seasons]); 
+}
+
+/* Tasks expected in flight once a machine woken now is up */
+double forecastTasks(CPUType_t cpu) {
+    const Forecast_t *f = &forecasts[cpu]; 
+    if(!f->primed) {
+        return 0; 
+    }
+    unsigned ahead = unsigned(std::ceil(wakeLatency[cpu] / forecastInterval)) + 1; 
+    double rate = std::max(forecastRate(f, 0), forecastRate(f, ahead)) / forecastInterval; 
+    return rate * f->lifetime; 
+}
+
+/* Machines of the type that should be powered to absorb the forecast, by cores and by memory */
+unsigned forecastMachines(CPUType_t cpu) {
+    if(forecastCores[cpu] == 0) {
+        return 0; 
+    }
+    double tasks = forecastTasks(cpu); 
+    double machines = std::max(tasks / forecastCores[cpu], tasks * forecasts[cpu].memory / forecastMemory[cpu]); 
+    return unsigned(std::ceil(machines * forecastHeadroom)); 
+}
+
+void forecastWakeStart(MachineId_t mid) {
+    if(catalogSState[mid] != S0 && wakeRequested[mid] == NO_WAKE) {
+        wakeRequested[mid] = currentTime; 
+    }
+}
+
+void forecastWakeDone(MachineId_t mid, Time_t now) {
+    if(wakeRequested[mid] == NO_WAKE) {
+        return; 
+    }
+    if(catalogSState[mid] == S0) {
+        CPUType_t cpu = catalogCpu[mid]; 
+        wakeLatency[cpu] = forecastAlpha * (now - wakeRequested[mid]) + (1 - forecastAlpha) * wakeLatency[cpu]; 
+    }
+    wakeRequested[mid] = NO_WAKE; 
+}
+/* SHARED END forecast-impl */
+
+/* SHARED BEGIN demand-impl */
+unsigned taskMips(const TaskInfo_t &info) {
+    if(info.target_completion <= info.arrival) {
+        return 1000; 
+    }
+    double mips = demandMargin * double(info.total_instructions) / double(info.target_completion - info.arrival); 
+    return std::max(1u, unsigned(std::ceil(mips))); 
+}
+/* SHARED END demand-impl */
+
+/* SHARED BEGIN gpu-impl */
+void gpuArrival(const TaskInfo_t &info) {
+    gpuShare[info.required_cpu] = gpuAlpha * (info.gpu_capable ? 1.0 : 0.0) + (1 - gpuAlpha) * gpuShare[info.required_cpu]; 
+}
+
+bool gpuReserved(CPUType_t cpu) {
+    return gpuShare[cpu] >= gpuReserveShare; 
+}
+
+/* Whether the machine is the kind of host the task should try first */
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid) {
+    if(info.gpu_capable) {
+        return catalogGpus[mid]; 
+    }
+    return !(catalogGpus[mid] && gpuReserved(info.required_cpu)); 
+}
+/* SHARED END gpu-impl */
+
+/* SHARED BEGIN gpu-rank-impl */
+/* Ranks only order machines of one type against each other, so one order over all of them will do */
+void gpuInit() {
+    unsigned total = Machine_GetTotal(); 
+    vector<MachineId_t> order(total); 
+    vector<double> efficiency(total); 
+    for(unsigned i = 0; i < total; i++) {
+        order[i] = MachineId_t(i); 
+        efficiency[i] = double(machinePerformance(MachineId_t(i), 0)) / std::max(1u, machinePStatePower(MachineId_t(i), 0)); 
+    }
+    std::sort(order.begin(), order.end(), [&](MachineId_t a, MachineId_t b) {
+        double ea = efficiency[a] * (catalogGpus[a] ? gpuSpeedup : 1.0); 
+        double eb = efficiency[b] * (catalogGpus[b] ? gpuSpeedup : 1.0); 
+        return (ea != eb) ? ea > eb : a < b; 
+    });
+    gpuRank.resize(total); 
+    for(unsigned i = 0; i < total; i++) {
+        gpuRank[order[i]] = i; 
+    }
+    std::sort(order.begin(), order.end(), [&](MachineId_t a, MachineId_t b) {
+        if(catalogGpus[a] != catalogGpus[b]) {
+            return !catalogGpus[a]; 
+        }
+        return (efficiency[a] != efficiency[b]) ? efficiency[a] > efficiency[b] : a < b; 
+    });
+    plainRank.resize(total); 
+    for(unsigned i = 0; i < total; i++) {
+        plainRank[order[i]] = i; 
+    }
+}
+
+const int32_t *placementRank(const TaskInfo_t &info) {
+    if(info.gpu_capable) {
+        return gpuRank.data(); 
+    }
+    return gpuReserved(info.required_cpu) ? plainRank.data() : eeRank.data(); 
+}
+/* SHARED END gpu-rank-impl */
+
+/* SHARED BEGIN sla-impl */
+void slaInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        slaCompleted[c] = 0; 
+        slaSeenCompleted[c] = 0; 
+        slaSeenMissed[c] = 0; 
+        slaCapacity[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        slaCapacity[catalogCpu[i]] += machinePerformance(MachineId_t(i), 0) * catalogNumCpus[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            slaCapacity[c] /= machines[c]; 
+        }
+    }
+    slaHosted.assign(Machine_GetTotal() * 4, 0); 
+}
+
+/* Count a task of the class onto (count 1) or off (count -1) a machine */
+void slaHost(MachineId_t mid, SLAType_t sla, int count) {
+    slaHosted[mid * 4 + sla] += count; 
+}
+
+/* Machines with SLA0 or SLA1 work stay at P0 */
+bool slaPinned(MachineId_t mid) {
+    return slaHosted[mid * 4 + SLA0] > 0 || slaHosted[mid * 4 + SLA1] > 0; 
+}
+
+/* MIPS held back on a machine for the tightest class it hosts */
+unsigned slaReserve(MachineId_t mid) {
+    double target = 1.0; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        if(slaHosted[mid * 4 + c] > 0) {
+            target = std::min(target, slaTarget[c]); 
+        }
+    }
+    return unsigned((1 - target) * machinePerformance(mid, 0) * catalogNumCpus[mid]); 
+}
+
+/* MIPS a new task of the class needs free on a machine of the type: its own demand and its headroom */
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips) {
+    return mips + unsigned((1 - slaTarget[sla]) * slaCapacity[cpu]); 
+}
+
+/* Move the targets of the classes whose recent miss rate is off their goal; true if any moved */
+bool slaAdapt(Time_t now) {
+    if(now - slaLastAdapt < slaAdaptInterval) {
+        return false; 
+    }
+    slaLastAdapt = now; 
+    bool changed = false; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        unsigned window = slaCompleted[c] - slaSeenCompleted[c]; 
+        if(window < slaMinSamples) {
+            continue; 
+        }
+        double missed = GetSLAReport(SLAType_t(c)) * slaCompleted[c] / 100; 
+        double rate = 100 * (missed - slaSeenMissed[c]) / window; 
+        slaSeenCompleted[c] = slaCompleted[c]; 
+        slaSeenMissed[c] = missed; 
+        double target = slaTarget[c]; 
+        if(rate > slaGoal[c]) {
+            target = std::max(slaTargetFloor, target - slaStep); 
+        } else if(rate < slaGoal[c] / 2) {
+            target = std::min(1.0, target + slaStep); 
+        }
+        if(target != slaTarget[c]) {
+            SCHED_LOG(2, "SLA" + to_string(c) + " missed " + to_string(rate) + "%, utilization target now " + to_string(target)); 
+            slaTarget[c] = target; 
+            changed = true; 
+        }
+    }
+    return changed; 
+}
+/* SHARED END sla-impl */
+
+/* SHARED BEGIN slack-impl */
+void slackInit() {
+    slackOn.assign(Machine_GetTotal(), std::set<TaskId_t>()); 
+}
+
+/* File a task that just landed on the machine; its co-tenants only need re-filing once the machine
+   runs more tasks than it has cores and their share of it shrinks */
+void slackAdd(TaskId_t tid, MachineId_t mid, Time_t now) {
+    slackOn[mid].insert(tid); 
+    if(slackOn[mid].size() > catalogNumCpus[mid]) {
+        slackTouch(mid, now); 
+        return; 
+    }
+    TaskInfo_t info = GetTaskInfo(tid); 
+    if(info.required_sla != SLA3) {
+        slackFile(tid, now + Time_t(std::max(0.0, slackSpare(info, mid, now)))); 
+    }
+}
+
+/* A finished task leaves its heap entries behind to be skipped */
+void slackRemove(TaskId_t tid, MachineId_t mid) {
+    slackOn[mid].erase(tid); 
+    slackLive.erase(tid); 
+}
+
+void slackMove(TaskId_t tid, MachineId_t from, MachineId_t to, Time_t now) {
+    slackOn[from].erase(tid); 
+    slackAdd(tid, to, now); 
+}
+
+/* MIPS each of `tasks` tasks gets on the machine at its current P-state */
+double slackRate(MachineId_t mid, unsigned tasks) {
+    double rate = machinePerformance(mid, catalogPState[mid]); 
+    if(tasks > catalogNumCpus[mid]) {
+        rate = rate * catalogNumCpus[mid] / tasks; 
+    }
+    return std::max(rate, 1.0); 
+}
+
+/* Slack above the margin in us, negative once the task is at risk */
+double slackSpare(const TaskInfo_t &info, MachineId_t mid, Time_t now) {
+    double rate = slackRate(mid, slackOn[mid].size()); 
+    if(info.gpu_capable && catalogGpus[mid]) {
+        rate *= gpuSpeedup; 
+    }
+    double left = info.remaining_instructions / rate; 
+    double window = double(info.target_completion) - double(info.arrival); 
+    return double(info.target_completion) - double(now) - left - slackMargin * window; 
+}
+
+/* Once stale entries outnumber live ones the heap is rebuilt from slackLive */
+void slackFile(TaskId_t tid, Time_t due) {
+    SlackEntry_t entry = std::make_pair(due, std::make_pair(++slackSequence, tid)); 
+    slackLive[tid] = entry; 
+    slackHeap.push(entry); 
+    if(slackHeap.size() > 2 * slackLive.size() + 1024) {
+        vector<SlackEntry_t> live; 
+        live.reserve(slackLive.size()); 
+        for(auto & entry: slackLive) {
+            live.push_back(entry.second); 
+        }
+        slackHeap = std::priority_queue<SlackEntry_t, vector<SlackEntry_t>, std::greater<SlackEntry_t>>(
+            std::greater<SlackEntry_t>(), std::move(live)); 
+    }
+}
+
+/* Re-file the tasks of a machine that just got slower for them */
+void slackTouch(MachineId_t mid, Time_t now) {
+    for(TaskId_t tid: slackOn[mid]) {
+        TaskInfo_t info = GetTaskInfo(tid); 
+        if(info.required_sla != SLA3) {
+            slackFile(tid, now + Time_t(std::max(0.0, slackSpare(info, mid, now)))); 
+        }
+    }
+}
+
+/* Pop the tasks whose slack is due to run out, rescue the ones that really are short and file
+   every one again for its next look */
+void slackCheck(Time_t now) {
+    while(!slackHeap.empty() && slackHeap.top().first <= now) {
+        SlackEntry_t entry = slackHeap.top(); 
+        slackHeap.pop(); 
+        TaskId_t tid = entry.second.second; 
+        auto live = slackLive.find(tid); 
+        if(live == slackLive.end() || live->second != entry) {
+            continue; 
+        }
+        MachineId_t mid = taskMap[tid]; 
+        double spare = slackSpare(GetTaskInfo(tid), mid, now); 
+        if(spare >= 1) {
+            slackFile(tid, now + Time_t(spare)); 
+            continue; 
+        }
+        SCHED_LOG(2, "Task " + to_string(tid) + " on machine " + to_string(mid) + " is " 
+                     + to_string(Time_t(-spare)) + "us past its slack margin"); 
+        slackRescue(tid, mid, now); 
+        slackFile(tid, now + slackRetry); 
+    }
+}
+/* SHARED END slack-impl */
+
+/* SHARED BEGIN rescue-impl */
+/* First step of a rescue; a task already being rescued is left to rescueCheck */
+void rescueStart(TaskId_t tid, Time_t now) {
+    auto host = taskMap.find(tid); 
+    if(host == taskMap.end() || rescues.count(tid) != 0) {
+        return; 
+    }
+    TaskInfo_t info = GetTaskInfo(tid); 
+    Rescue_t &rescue = rescues[tid]; 
+    rescue.stage = RESCUE_PRIORITY; 
+    rescue.since = now; 
+    rescue.remaining = info.remaining_instructions; 
+    SetTaskPriority(tid, HIGH_PRIORITY); 
+    for(VMId_t vid: vmMap[host->second]) {
+        for(TaskId_t other: VM_GetInfo(vid).active_tasks) {
+            if(other == tid || RequiredSLA(other) <= info.required_sla || rescues.count(other) != 0) {
+                continue; 
+            }
+            auto held = demotions.find(other); 
+            if(held == demotions.end()) {
+                demotions[other] = std::make_pair(1u, Priority_t(GetTaskPriority(other))); 
+                SetTaskPriority(other, LOW_PRIORITY); 
+            } else {
+                held->second.first++; 
+            }
+            rescue.demoted.push_back(other); 
+        }
+    }
+    SCHED_LOG(2, "Rescuing task " + to_string(tid) + " on machine " + to_string(host->second) + ", " 
+                 + to_string(rescue.demoted.size()) + " co-located tasks lowered"); 
+}
+
+/* Take the next step for every rescue whose last one has not caught the task up */
+void rescueCheck(Time_t now) {
+    for(auto & entry: rescues) {
+        Rescue_t &rescue = entry.second; 
+        if(rescue.stage == RESCUE_MIGRATE || now < rescue.since + rescueWait) {
+            continue; 
+        }
+        TaskInfo_t info = GetTaskInfo(entry.first); 
+        double rate = double(rescue.remaining - info.remaining_instructions) / double(now - rescue.since); 
+        bool late = rate <= 0 || now + info.remaining_instructions / rate > info.target_completion; 
+        rescue.since = now; 
+        rescue.remaining = info.remaining_instructions; 
+        if(!late) {
+            continue; 
+        }
+        MachineId_t mid = taskMap[entry.first]; 
+        if(rescue.stage == RESCUE_PRIORITY) {
+            rescue.stage = RESCUE_BOOST; 
+            if(rescueBoost(entry.first, mid, now)) {
+                continue; 
+            }
+        }
+        /* Already at P0, or the boost was not enough: move the task, or try again next look */
+        if(rescueMigrate(entry.first, mid, now)) {
+            rescue.stage = RESCUE_MIGRATE; 
+        }
+    }
+}
+
+/* Called as a task completes: ends its rescue, and its demotion if it was lowered for another's */
+void rescueFinish(TaskId_t tid) {
+    demotions.erase(tid); 
+    auto it = rescues.find(tid); 
+    if(it == rescues.end()) {
+        return; 
+    }
+    for(TaskId_t other: it->second.demoted) {
+        auto held = demotions.find(other); 
+        if(held == demotions.end() || --held->second.first > 0) {
+            continue; 
+        }
+        if(rescues.count(other) == 0) {
+            SetTaskPriority(other, held->second.second); 
+        }
+        demotions.erase(held); 
+    }
+    rescues.erase(it); 
+}
+/* SHARED END rescue-impl */
+
+/* SHARED BEGIN logging-impl */
+/* Runtime log level from SCHED_VERBOSE, SCHED_LOG_MAX when it is unset */
+int initLogLevel() {
+    const char *level = getenv("SCHED_VERBOSE"); 
+    return (level != NULL) ? atoi(level) : SCHED_LOG_MAX; 
+}
+/* SHARED END logging-impl */
+
+/* SHARED BEGIN catalog-impl */
+void buildCatalog() {
+    unsigned total = Machine_GetTotal(); 
+    catalogCpu.resize(total); 
+    catalogNumCpus.resize(total); 
+    catalogMemory.resize(total); 
+    catalogGpus.resize(total); 
+    catalogPerformance.assign(total * NUM_P_STATES, 0); 
+    catalogPStatePower.assign(total * NUM_P_STATES, 0); 
+    catalogSStatePower.assign(total * NUM_S_STATES, 0); 
+    catalogSState.resize(total); 
+    catalogPState.resize(total); 
+
+    for(unsigned i = 0; i < total; i++) {
+        MachineInfo_t info = Machine_GetInfo(MachineId_t(i)); 
+        catalogCpu[i] = info.cpu; 
+        catalogNumCpus[i] = info.num_cpus; 
+        catalogMemory[i] = info.memory_size; 
+        catalogGpus[i] = info.gpus; 
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.performance.size(); p++) {
+            catalogPerformance[i * NUM_P_STATES + p] = info.performance[p]; 
+        }
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.p_states.size(); p++) {
+            catalogPStatePower[i * NUM_P_STATES + p] = info.p_states[p]; 
+        }
+        /* s_states is not always populated, missing entries stay at 0 */
+        for(unsigned s = 0; s < NUM_S_STATES && s < info.s_states.size(); s++) {
+            catalogSStatePower[i * NUM_S_STATES + s] = info.s_states[s]; 
+        }
+        catalogSState[i] = info.s_state; 
+        catalogPState[i] = info.p_state; 
+    }
+}
+
+unsigned machinePerformance(MachineId_t mid, unsigned p_state) {
+    return catalogPerformance[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state) {
+    return catalogPStatePower[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state) {
+    return catalogSStatePower[mid * NUM_S_STATES + s_state]; 
+}
+/* SHARED END catalog-impl */
+
+/* SHARED BEGIN kernel-impl */
+/* Scalar check of candidates i..n-1, folded into the best found so far */
+int feasibleTail(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                 uint8_t want, unsigned i, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask,
+                 int best, int32_t bestScore) {
+    for(; i < n; i++) {
+        if(eligible[i] == want && mips[i] >= mipsNeeded && memory[i] >= memoryNeeded) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(1) << (i % 64); 
+            }
+            if(score[i] < bestScore || best == -1) {
+                bestScore = score[i]; 
+                best = i; 
+            }
+        }
+    }
+    return best; 
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+int feasibleAvx2(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                 uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    int32_t bestScore = INT32_MAX; 
+    int best = -1; 
+    unsigned i = 0; 
+    const __m256i needMips = _mm256_set1_epi32(mipsNeeded - 1); 
+    const __m256i needMemory = _mm256_set1_epi32(memoryNeeded); 
+    const __m256i wanted = _mm256_set1_epi32(want); 
+    const __m256i step = _mm256_set1_epi32(8); 
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); 
+    __m256i laneBest = _mm256_set1_epi32(INT32_MAX); 
+    __m256i laneIndex = _mm256_set1_epi32(-1); 
+    for(; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)(mips + i)); 
+        __m256i mem = _mm256_loadu_si256((const __m256i *)(memory + i)); 
+        __m256i el = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(eligible + i))); 
+        __m256i ok = _mm256_cmpgt_epi32(m, needMips); 
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_max_epu32(mem, needMemory), mem)); 
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(el, wanted)); 
+        unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(ok)); 
+        if(bits != 0) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(bits) << (i % 64); 
+            }
+            __m256i s = _mm256_loadu_si256((const __m256i *)(score + i)); 
+            __m256i better = _mm256_and_si256(ok, _mm256_cmpgt_epi32(laneBest, s)); 
+            laneBest = _mm256_blendv_epi8(laneBest, s, better); 
+            laneIndex = _mm256_blendv_epi8(laneIndex, lane, better); 
+        }
+        lane = _mm256_add_epi32(lane, step); 
+    }
+    int32_t scores[8]; 
+    int32_t indices[8]; 
+    _mm256_storeu_si256((__m256i *)scores, laneBest); 
+    _mm256_storeu_si256((__m256i *)indices, laneIndex); 
+    for(int l = 0; l < 8; l++) {
+        if(indices[l] != -1 && (best == -1 || scores[l] < bestScore || (scores[l] == bestScore && indices[l] < best))) {
+            bestScore = scores[l]; 
+            best = indices[l]; 
+        }
+    }
+    return feasibleTail(mips, memory, score, eligible, want, i, n, mipsNeeded, memoryNeeded, mask, best, bestScore); 
+}
+
+__attribute__((target("sse4.1")))
+int feasibleSse41(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                  uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    int32_t bestScore = INT32_MAX; 
+    int best = -1; 
+    unsigned i = 0; 
+    const __m128i needMips = _mm_set1_epi32(mipsNeeded - 1); 
+    const __m128i needMemory = _mm_set1_epi32(memoryNeeded); 
+    const __m128i wanted = _mm_set1_epi32(want); 
+    const __m128i step = _mm_set1_epi32(4); 
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3); 
+    __m128i laneBest = _mm_set1_epi32(INT32_MAX); 
+    __m128i laneIndex = _mm_set1_epi32(-1); 
+    for(; i + 4 <= n; i += 4) {
+        int32_t packed; 
+        memcpy(&packed, eligible + i, sizeof(packed)); 
+        __m128i m = _mm_loadu_si128((const __m128i *)(mips + i)); 
+        __m128i mem = _mm_loadu_si128((const __m128i *)(memory + i)); 
+        __m128i el = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)); 
+        __m128i ok = _mm_cmpgt_epi32(m, needMips); 
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_max_epu32(mem, needMemory), mem)); 
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(el, wanted)); 
+        unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(ok)); 
+        if(bits != 0) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(bits) << (i % 64); 
+            }
+            __m128i s = _mm_loadu_si128((const __m128i *)(score + i)); 
+            __m128i better = _mm_and_si128(ok, _mm_cmpgt_epi32(laneBest, s)); 
+            laneBest = _mm_blendv_epi8(laneBest, s, better); 
+            laneIndex = _mm_blendv_epi8(laneIndex, lane, better); 
+        }
+        lane = _mm_add_epi32(lane, step); 
+    }
+    int32_t scores[4]; 
+    int32_t indices[4]; 
+    _mm_storeu_si128((__m128i *)scores, laneBest); 
+    _mm_storeu_si128((__m128i *)indices, laneIndex); 
+    for(int l = 0; l < 4; l++) {
+        if(indices[l] != -1 && (best == -1 || scores[l] < bestScore || (scores[l] == bestScore && indices[l] < best))) {
+            bestScore = scores[l]; 
+            best = indices[l]; 
+        }
+    }
+    return feasibleTail(mips, memory, score, eligible, want, i, n, mipsNeeded, memoryNeeded, mask, best, bestScore); 
+}
+#endif
+
+/* Checks n candidates in one pass: a candidate is feasible when eligible[i] == want and it has
+   at least mipsNeeded MIPS and memoryNeeded memory left. Sets bit i of mask (if given) for every
+   feasible candidate and returns the feasible one with the lowest score (scores stay below
+   INT32_MAX), lowest index on ties, or -1. On x86 the widest version the CPU runs is picked once:
+   AVX2 handles 8 candidates per step, SSE4.1 handles 4, and the tail runs scalar */
+int feasibleArgmin(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                   uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    if(mask != NULL) {
+        (*mask).assign((n + 63) / 64, 0); 
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    static const int level = __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("sse4.1") ? 1 : 0); 
+    if(level == 2) {
+        return feasibleAvx2(mips, memory, score, eligible, want, n, mipsNeeded, memoryNeeded, mask); 
+    }
+    if(level == 1) {
+        return feasibleSse41(mips, memory, score, eligible, want, n, mipsNeeded, memoryNeeded, mask); 
+    }
+#endif
+    return feasibleTail(mips, memory, score, eligible, want, 0, n, mipsNeeded, memoryNeeded, mask, -1, INT32_MAX); 
+}
+/* SHARED END kernel-impl */
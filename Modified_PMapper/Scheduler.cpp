@@ -7,6 +7,10 @@
 
 #include "Scheduler.hpp"
 #include <unordered_map>
+#include <cstdio>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
 #include <cmath>
 #include <limits.h>
 #include <algorithm>
@@ -14,65 +18,481 @@
 #include <vector>
 #include <iterator>
 #include <random>
+#include <set>
+#include <queue>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-vector<MachineId_t> x86Machines;
-vector<MachineId_t> armMachines;
-vector<MachineId_t> powerMachines;
-vector<MachineId_t> riscvMachines;
+/* Name of this scheduler in its decision trace */
+#define SCHED_NAME "PMapper"
 
-vector<MachineId_t> x86OffMachines;
-vector<MachineId_t> x86OnMachines;
-vector<MachineId_t> armOffMachines;
-vector<MachineId_t> armOnMachines;
-vector<MachineId_t> powerOffMachines;
-vector<MachineId_t> powerOnMachines;
-vector<MachineId_t> riscvOffMachines;
-vector<MachineId_t> riscvOnMachines;
+/* SHARED BEGIN logging */
+/* Scheduler logging. SCHED_LOG(level, message) only evaluates message, and so only builds the
+   string, when level is within both SCHED_LOG_MAX (compile time, -DSCHED_LOG_MAX=0 compiles every
+   message above 0 out) and schedLogLevel (runtime, taken from the SCHED_VERBOSE environment
+   variable). Both default to 4, which passes everything on to SimOutput as before */
+#ifndef SCHED_LOG_MAX
+#define SCHED_LOG_MAX 4
+#endif
+#define SCHED_LOG(level, message) \
+    do { \
+        if((level) <= SCHED_LOG_MAX && (level) <= schedLogLevel) { \
+            SimOutput((message), (level)); \
+        } \
+    } while(0)
+
+int initLogLevel(); 
+int schedLogLevel = initLogLevel(); 
+/* SHARED END logging */
+
+/* Machine pools ordered by decreasing energy efficiency (ties by id). The efficiency of every
+   machine is precomputed in Init, so insert and erase by id are O(log n) and iteration walks
+   the pool from the most to the least efficient machine */
+typedef std::set<std::pair<double, MachineId_t>> MachinePool_t;
+vector<double> machineEE;
+
+MachinePool_t x86Machines;
+MachinePool_t armMachines;
+MachinePool_t powerMachines;
+MachinePool_t riscvMachines;
+
+MachinePool_t x86OffMachines;
+MachinePool_t x86OnMachines;
+MachinePool_t armOffMachines;
+MachinePool_t armOnMachines;
+MachinePool_t powerOffMachines;
+MachinePool_t powerOnMachines;
+MachinePool_t riscvOffMachines;
+MachinePool_t riscvOnMachines;
 
 unsigned currAssign = 0;
-unsigned currSleep = 3;
 bool SLA_warning = false;
 
 std::unordered_map<MachineId_t, vector<VMId_t>> vmMap;
 std::unordered_map<TaskId_t, MachineId_t> taskMap;
-std::unordered_map<MachineId_t, signed> remainingMips; 
-std::unordered_map<MachineId_t, unsigned> remainingMemory; 
-std::unordered_map<VMId_t, bool> isMigrating; 
-std::unordered_map<MachineId_t, unsigned> idleCounter;
+std::unordered_map<TaskId_t, VMId_t> taskToVM;
+
+/* Warm VM pool. A VM whose work is done stays attached to its machine in
+   warmVMs[machine * NUM_VM_TYPES + type] and goes to the next task of that type placed there,
+   so arrivals skip VM_Create/VM_Attach. VMs left idle for vmIdleLimit are shut down from
+   SchedulerCheck, oldest first */
+#define NUM_VM_TYPES 4
+vector<vector<VMId_t>> warmVMs; 
+std::deque<std::pair<Time_t, VMId_t>> idleVMs;     // in release order
+vector<MachineId_t> vmHost;     // per-VM entries below are indexed by VMId_t
+vector<VMType_t> vmType; 
+vector<Time_t> vmIdleSince; 
+vector<bool> vmIdle; 
+vector<bool> vmLive; 
+Time_t vmIdleLimit = 5000000; 
+
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu);
+void releaseVM(VMId_t vid, Time_t now);
+void reclaimIdleVMs(Time_t now);
+void shutdownVMs();
+void migrateTask(TaskId_t tid, MachineId_t from, MachineId_t to, uint8_t reason, Time_t now);
+
+/* Shadow index of the tasks on each machine ordered by estimated instructions left, so the best
+   task to migrate is the last entry instead of a VM_GetInfo/GetTaskInfo sweep. Tasks sharing a
+   machine advance at the same rate, so each one is keyed on its remaining work plus the machine's
+   workDone counter at insert time: the order never changes and only workDone needs refreshing,
+   which advanceWork does at each SchedulerCheck from the P0 rate and task count */
+typedef std::set<std::pair<uint64_t, TaskId_t>> TaskIndex_t;
+vector<TaskIndex_t> taskIndex;
+vector<uint64_t> workDone;
+std::unordered_map<TaskId_t, uint64_t> taskWorkKey;
+Time_t lastWorkUpdate = 0;
+
+/* Accounting table indexed directly by MachineId_t, sized once in Init. The capacity arrays read
+   by every feasibility check are kept apart from the colder per-machine counters */
+vector<signed> remainingMips; 
+vector<unsigned> remainingMemory; 
+vector<int32_t> tierMips;   // remainingMips less the SLA reserve of the machine's tasks
+vector<bool> isMigrating;   // indexed by VMId_t, grown as VMs are created
+vector<int32_t> eeRank;     // position of each machine in its energy-efficiency ordered pool
+
+/* SHARED BEGIN latency */
+/* Scheduler overhead: wall time spent in each entry point, recorded by a CallbackTimer at the top
+   of the callback into a log-linear histogram (every power of two of nanoseconds split into 8
+   linear buckets, so a percentile is within 12.5%) and reported from SimulationComplete */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+typedef struct {
+    const char *name; 
+    uint64_t count = 0; 
+    uint64_t total = 0; 
+    uint64_t max = 0; 
+    uint64_t buckets[HIST_BUCKETS] = {}; 
+} LatencyHist_t;
+
+enum { CB_INIT, CB_NEW_TASK, CB_TASK_COMPLETE, CB_MEMORY_WARNING, CB_SLA_WARNING, CB_MIGRATION_DONE, 
+       CB_SCHEDULER_CHECK, CB_STATE_CHANGE, CB_COUNT };
+LatencyHist_t callbackLatency[CB_COUNT] = {
+    {"InitScheduler"}, {"HandleNewTask"}, {"HandleTaskCompletion"}, {"MemoryWarning"}, {"SLAWarning"}, 
+    {"MigrationDone"}, {"SchedulerCheck"}, {"StateChangeComplete"}
+};
+
+void histRecord(LatencyHist_t *hist, uint64_t ns);
+uint64_t histPercentile(const LatencyHist_t *hist, double q);
+void reportLatency();
+
+struct CallbackTimer {
+    unsigned which; 
+    std::chrono::steady_clock::time_point start; 
+    CallbackTimer(unsigned which) : which(which), start(std::chrono::steady_clock::now()) {}
+    ~CallbackTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start; 
+        histRecord(&callbackLatency[which], std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()); 
+    }
+};
+/* SHARED END latency */
+
+/* SHARED BEGIN trace */
+/* Decision trace. With SCHED_TRACE=<file> set, every placement, migration, VM attach/shutdown,
+   power-state and P-state request is appended to <file> as a fixed 32-byte record behind a
+   32-byte header, through a buffer flushed every TRACE_BUFFER records and at the end of the run.
+   Tools/trace_reader.cpp prints and diffs these files. Without SCHED_TRACE, traceDecision
+   returns at once */
+#define TRACE_VERSION 1
+#define TRACE_BUFFER 4096
+#define TRACE_NONE UINT32_MAX
+typedef struct {
+    char magic[8];          // "SCHTRACE"
+    uint32_t version; 
+    uint32_t recordSize; 
+    char algorithm[16]; 
+} TraceHeader_t;
+
+typedef struct {
+    uint64_t time; 
+    uint32_t machine; 
+    uint32_t vm; 
+    uint32_t task; 
+    uint32_t arg;           // S-state or P-state requested, VM type, or migration source machine
+    uint8_t kind; 
+    uint8_t reason; 
+    uint8_t reserved[6]; 
+} TraceRecord_t;
+static_assert(sizeof(TraceRecord_t) == 32, "trace records are 32 bytes"); 
+
+enum { TRACE_PLACE, TRACE_MIGRATE, TRACE_SET_STATE, TRACE_SET_PERF, TRACE_VM_ATTACH, TRACE_VM_SHUTDOWN };
+enum { REASON_INIT, REASON_PLACE, REASON_FALLBACK, REASON_MEMORY_WARNING, REASON_SLA_WARNING, REASON_CONSOLIDATE, 
+       REASON_IDLE, REASON_DEMAND, REASON_GOVERNOR, REASON_RECLAIM, REASON_SHUTDOWN, REASON_FORECAST, REASON_SLACK };
+
+FILE *traceFile = NULL; 
+TraceRecord_t traceBuffer[TRACE_BUFFER]; 
+unsigned traceCount = 0; 
+Time_t currentTime = 0;     // time of the callback being handled
+
+void openTrace();
+void closeTrace();
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg);
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason);
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason);
+/* SHARED END trace */
+
+/* SHARED BEGIN catalog */
+/* Machine catalog: static attributes cached once in Init so the hot paths never copy
+   MachineInfo_t. Only s_state and p_state change at runtime; s_state is refreshed from
+   StateChangeComplete and p_state is recorded by setMachinePerformance */
+#define NUM_P_STATES 4
+#define NUM_S_STATES 7
+vector<CPUType_t> catalogCpu;
+vector<unsigned> catalogNumCpus;
+vector<unsigned> catalogMemory;
+vector<bool> catalogGpus;
+vector<unsigned> catalogPerformance;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogPStatePower;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogSStatePower;    // NUM_S_STATES entries per machine, 0 when not reported
+vector<MachineState_t> catalogSState;
+vector<CPUPerformance_t> catalogPState;
+
+void buildCatalog();
+unsigned machinePerformance(MachineId_t mid, unsigned p_state);
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state);
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state);
+/* SHARED END catalog */
+
+/* SHARED BEGIN demand */
+/* MIPS demand model. A task has to retire total_instructions between its arrival and its target
+   completion, so it needs total / (target - arrival) MIPS on average; demandMargin pads that for
+   time lost to sharing a core or to a migration. Every MIPS charge and load figure counts tasks by
+   this demand. A task without a window is charged the flat 1000 MIPS the accounting used before */
+double demandMargin = 1.25; 
+
+unsigned taskMips(const TaskInfo_t &info);
+/* SHARED END demand */
+
+/* SHARED BEGIN gpu */
+/* GPU routing. A GPU-capable task runs gpuSpeedup times faster on a GPU host, so it tries the GPU
+   hosts of its type first. It is still charged its full demand there: it holds a core share for as
+   long as it runs, it just runs for less time. While GPU-capable work is at least gpuReserveShare
+   of a type's arrivals (an EWMA with weight gpuAlpha), tasks that cannot use a GPU take that
+   type's GPU hosts last, keeping them for the work that finishes faster there */
+double gpuSpeedup = 2.0; 
+double gpuAlpha = 0.05; 
+double gpuReserveShare = 0.1; 
+double gpuShare[4];             // GPU-capable share of each CPU type's arrivals
 
-unsigned insertSortedEE(vector<MachineId_t>* mList, MachineId_t id);
+void gpuArrival(const TaskInfo_t &info);
+bool gpuReserved(CPUType_t cpu);
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid);
+/* SHARED END gpu */
+
+/* SHARED BEGIN gpu-rank */
+/* Placement ranks for candidate scans. A GPU-capable task ranks hosts by efficiency times its
+   speedup, which puts a GPU host first unless a plain one is more efficient by more than the
+   speedup; other tasks rank by efficiency, with the GPU hosts after the plain ones while they are
+   reserved */
+vector<int32_t> gpuRank;        // placement score of each machine for GPU-capable tasks
+vector<int32_t> plainRank;      // and for other tasks while GPU hosts are held back
+
+void gpuInit();
+const int32_t *placementRank(const TaskInfo_t &info);
+/* SHARED END gpu-rank */
+
+/* SHARED BEGIN sla */
+/* SLA tiers. A task of class c only goes where its host stays under slaTarget[c] of its P0
+   capacity once the task is on it, and the headroom that leaves is held back from later tasks
+   for as long as the class has work there. SLA0 and SLA1 start with room in reserve and keep
+   their hosts at P0; SLA2 and SLA3 pack the most efficient hosts full, which can then stay slow.
+   The targets follow GetSLAReport: every slaAdaptInterval the share of each class's tasks that
+   missed since the last look is held against slaGoal, and the target steps toward more headroom
+   when over it and toward denser packing when well under it */
+double slaTarget[4] = {0.6, 0.75, 1.0, 1.0};   // highest host utilization a task of the class accepts
+double slaGoal[4] = {5, 10, 20, 100};           // % of the class's tasks allowed to miss
+double slaStep = 0.05; 
+double slaTargetFloor = 0.3; 
+unsigned slaMinSamples = 20;    // completions needed before a class's target moves
+Time_t slaAdaptInterval = 10000000; 
+Time_t slaLastAdapt = 0; 
+unsigned slaCompleted[4];       // completions seen by TaskComplete
+unsigned slaSeenCompleted[4];   // and the completions and misses at the last adaptation
+double slaSeenMissed[4]; 
+double slaCapacity[4];          // average P0 MIPS of a machine of each type
+vector<unsigned> slaHosted;     // tasks of each class on each machine, 4 entries per machine
+
+void slaInit();
+void slaHost(MachineId_t mid, SLAType_t sla, int count);
+bool slaPinned(MachineId_t mid);
+unsigned slaReserve(MachineId_t mid);
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips);
+bool slaAdapt(Time_t now);
+/* SHARED END sla */
+
+/* SHARED BEGIN slack */
+/* Deadline slack. A running task's slack is the time it can still lose before it misses its target,
+   target - now - remaining / rate, where rate is its host's per-core MIPS at the host's P-state
+   shared out once the host runs more tasks than it has cores. Each task sits in slackHeap under the
+   time its slack, at the current rate, runs down to slackMargin of its SLA window, so a
+   SchedulerCheck pops only the tasks at risk and re-estimates them from their remaining
+   instructions. One that really is short is rescued, by bringing its host up to P0 or moving it to
+   a quicker machine, and looked at again slackRetry later. A task is filed when it lands on a
+   host, and the host's other tasks are re-filed only when their rate drops: the host slows down,
+   or takes on more tasks than it has cores. The entries that leaves behind are told apart by
+   sequence number and skipped. SLA3 has no target, so its tasks only count as co-tenants */
+typedef std::pair<Time_t, std::pair<uint64_t, TaskId_t>> SlackEntry_t;  // (due, (sequence, task))
+std::priority_queue<SlackEntry_t, vector<SlackEntry_t>, std::greater<SlackEntry_t>> slackHeap; 
+std::unordered_map<TaskId_t, SlackEntry_t> slackLive;    // the current entry of each filed task
+vector<std::set<TaskId_t>> slackOn;     // running tasks on each machine
+uint64_t slackSequence = 0; 
+double slackMargin = 0.1;       // of the task's SLA window, target - arrival
+Time_t slackRetry = 500000;     // before a rescued task is looked at again
+
+void slackInit();
+void slackAdd(TaskId_t tid, MachineId_t mid, Time_t now);
+void slackRemove(TaskId_t tid, MachineId_t mid);
+void slackMove(TaskId_t tid, MachineId_t from, MachineId_t to, Time_t now);
+double slackRate(MachineId_t mid, unsigned tasks);
+double slackSpare(const TaskInfo_t &info, MachineId_t mid, Time_t now);
+void slackFile(TaskId_t tid, Time_t due);
+void slackTouch(MachineId_t mid, Time_t now);
+void slackCheck(Time_t now);
+/* SHARED END slack */
+void slackRescue(TaskId_t tid, MachineId_t mid, Time_t now);
+
+/* SHARED BEGIN forecast */
+/* Arrival forecaster, one per CPU type. Arrivals are counted per forecastInterval and each closed
+   interval feeds an EWMA of the arrival rate, or a Holt-Winters model (level, trend and
+   forecastSeasons seasonal slots) when forecastSeasons is set. Lifetimes and memory per task are
+   smoothed as tasks come and go, so by Little's law the tasks in flight one wake-up from now are
+   rate x lifetime. The wake-up time is measured per type from S0 requests to their
+   StateChangeComplete, forecastLead until the first one lands */
+#define FORECAST_MAX_SEASONS 64
+typedef struct {
+    Time_t intervalStart; 
+    unsigned arrivals;          // in the open interval
+    double level;               // arrivals per interval
+    double trend; 
+    double season[FORECAST_MAX_SEASONS]; 
+    unsigned slot;              // seasonal slot of the open interval
+    double lifetime;            // us from arrival to completion
+    double memory;              // MB per task
+    bool primed; 
+} Forecast_t;
+
+Forecast_t forecasts[4];        // indexed by CPUType_t
+Time_t forecastInterval = 1000000; 
+unsigned forecastSeasons = 0;   // 0 keeps the plain EWMA
+double forecastAlpha = 0.3; 
+double forecastBeta = 0.1; 
+double forecastGamma = 0.2; 
+double forecastHeadroom = 1.2; 
+Time_t forecastLead = 1000000; 
+double wakeLatency[4]; 
+vector<Time_t> wakeRequested;   // time of the pending S0 request, NO_WAKE when none
+double forecastCores[4];        // average cores and memory of a machine of each type
+double forecastMemory[4]; 
+#define NO_WAKE UINT64_MAX
+
+void forecastInit();
+void forecastAdvance(Time_t now);
+void forecastArrival(CPUType_t cpu, const TaskInfo_t &info, Time_t now);
+void forecastCompletion(CPUType_t cpu, const TaskInfo_t &info, Time_t now);
+double forecastRate(const Forecast_t *f, unsigned ahead);
+double forecastTasks(CPUType_t cpu);
+unsigned forecastMachines(CPUType_t cpu);
+void forecastWakeStart(MachineId_t mid);
+void forecastWakeDone(MachineId_t mid, Time_t now);
+/* SHARED END forecast */
+
+/* Sleep-state selection. Every SetState is timed to its StateChangeComplete, per machine and per
+   state, both going down (S0 to the state) and coming back up (the state to S0). A machine that
+   hasn't made a trip yet borrows the average of its CPU type, and a state no machine of the type
+   has tried is priced at the type's slowest measured trip in that direction, and never below
+   forecastLead, so an untried deep state is not mistaken for a cheap one. Sleeping in state s
+   instead of idling in S0 pays off once the machine stays down longer than the break-even time
+       t_be = (t_down + t_up) x (P_transition - P_s) / (P_S0 - P_s)
+   which is just the round trip while transitions draw idle power. A machine idle for idleHold
+   goes to the deepest state whose t_be fits the idle time predicted for it: the EWMA of its past
+   idle periods less the time it has already been idle, and never less than that time */
+#define NOT_IDLE UINT64_MAX
+vector<double> sleepDown;       // NUM_S_STATES entries per machine, us, negative until measured
+vector<double> sleepUp; 
+double typeSleepDown[4][NUM_S_STATES]; 
+double typeSleepUp[4][NUM_S_STATES]; 
+vector<Time_t> sleepRequested;  // pending SetState, NOT_IDLE when none
+vector<MachineState_t> sleepFrom; 
+vector<MachineState_t> sleepTo; 
+vector<Time_t> idleSince;       // NOT_IDLE while the machine has work
+vector<double> idlePeriod;      // EWMA of the machine's finished idle periods, 0 before the first
+Time_t idleHold = 50000000;     // the old 500 checks at a 100 ms check period
+double sleepAlpha = 0.5; 
+double sleepTransitionPower = 1.0;  // draw during a transition, as a multiple of S0 idle power
+
+void sleepInit();
+void sleepRequest(MachineId_t mid, MachineState_t state);
+void sleepDone(MachineId_t mid, Time_t now);
+void sleepSample(double *sample, double *typeSample, double latency);
+double sleepPrior(const double *typeSample);
+double sleepRoundTrip(MachineId_t mid, unsigned s_state);
+double breakEven(MachineId_t mid, unsigned s_state);
+MachineState_t sleepState(MachineId_t mid, Time_t now);
+void idleStart(MachineId_t mid, Time_t now);
+void idleEnd(MachineId_t mid, Time_t now);
+
+/* SHARED BEGIN kernel */
+/* Feasibility kernel over candidate machines laid out as parallel arrays indexed by MachineId_t.
+   eligible[i] holds the machine's CPU type + 1 while it can take work and 0 otherwise */
+#define ELIGIBLE(cpu) uint8_t((cpu) + 1)
+vector<uint8_t> eligible;
+
+int feasibleArgmin(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                   uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask);
+/* SHARED END kernel */
+
+/* Indexed binary heap of machines keyed on getCurrUtilization. pos[id] is the slot holding
+   machine id, or -1 when it is not in the heap, so a machine is re-keyed or dropped in O(log n).
+   The max heaps hold every on machine (ties go to the more efficient one) and the min heaps hold
+   the S0 machines that are running something (ties go to the lower id). One of each per CPU type */
+typedef struct {
+    vector<MachineId_t> heap;
+    vector<int> pos;
+    bool maxHeap;
+} UtilHeap_t;
+
+UtilHeap_t minUtilHeap[4];
+UtilHeap_t maxUtilHeap[4];
+
+void heapInit(UtilHeap_t *h, unsigned total, bool maxHeap);
+bool heapBefore(const UtilHeap_t *h, MachineId_t a, MachineId_t b);
+void heapSift(UtilHeap_t *h, int slot);
+void heapSet(UtilHeap_t *h, MachineId_t id);
+void heapRemove(UtilHeap_t *h, MachineId_t id);
+void reheapMachine(MachineId_t mid);
+MachineId_t busiestFeasible(const UtilHeap_t *h, unsigned memory, unsigned mips);
+
+void indexTask(MachineId_t mid, TaskId_t tid, uint64_t remaining);
+uint64_t unindexTask(MachineId_t mid, TaskId_t tid);
+void advanceWork(Time_t now);
+
+void poolInsert(MachinePool_t* pool, MachineId_t id);
+void poolErase(MachinePool_t* pool, MachineId_t id);
 bool hasEnoughResource(MachineId_t mid, TaskId_t tid); 
 signed getCurrUtilization(MachineId_t mid);
-double getCurrentLoad(vector<MachineId_t> machines);
+double getCurrentLoad(const MachinePool_t &machines);
+void trackVM(VMId_t vid);
 
 /* We need to make sure we separate machines by VM type and hardware type
    to assign tasks to their requirements*/
 
 void Scheduler::Init() {
-    SimOutput("Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()), 3);
-    SimOutput("Scheduler::Init(): Initializing scheduler", 1);
+    SCHED_LOG(3, "Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()));
+    SCHED_LOG(1, "Scheduler::Init(): Initializing scheduler");
+    buildCatalog(); 
+    forecastInit(); 
+    warmVMs.resize(Machine_GetTotal() * NUM_VM_TYPES); 
+    remainingMips.resize(Machine_GetTotal()); 
+    remainingMemory.resize(Machine_GetTotal()); 
+    tierMips.resize(Machine_GetTotal()); 
+    sleepInit(); 
+    slaInit(); 
+    slackInit(); 
+    gpuInit(); 
+    machineEE.resize(Machine_GetTotal()); 
+    eeRank.resize(Machine_GetTotal()); 
+    eligible.assign(Machine_GetTotal(), 0); 
+    taskIndex.resize(Machine_GetTotal()); 
+    workDone.assign(Machine_GetTotal(), 0); 
+    for (int c = 0; c < 4; c++) {
+        heapInit(&minUtilHeap[c], Machine_GetTotal(), false); 
+        heapInit(&maxUtilHeap[c], Machine_GetTotal(), true); 
+    }
 
     //First organize all of the machines we have available
     for (unsigned i = 0; i < Machine_GetTotal(); i++) {
-        switch (Machine_GetCPUType(MachineId_t(i))) {
+        machineEE[i] = machinePerformance(MachineId_t(i), 0) / machinePStatePower(MachineId_t(i), 0); 
+        switch (catalogCpu[MachineId_t(i)]) {
             case X86:
-                insertSortedEE(&x86Machines, MachineId_t(i)); 
+                poolInsert(&x86Machines, MachineId_t(i)); 
                 break; 
             case ARM:
-                insertSortedEE(&armMachines, MachineId_t(i)); 
+                poolInsert(&armMachines, MachineId_t(i)); 
                 break; 
             case POWER:
-                insertSortedEE(&powerMachines, MachineId_t(i)); 
+                poolInsert(&powerMachines, MachineId_t(i)); 
                 break; 
             default:
-                insertSortedEE(&riscvMachines, MachineId_t(i)); 
+                poolInsert(&riscvMachines, MachineId_t(i)); 
                 break; 
         }
         //Compute effective performance of each machine and turn all machines on initially
-        remainingMips[MachineId_t(i)] = Machine_GetInfo(MachineId_t(i)).performance[0] * Machine_GetInfo(MachineId_t(i)).num_cpus; 
-        remainingMemory[MachineId_t(i)] = Machine_GetInfo(MachineId_t(i)).memory_size;
-        Machine_SetState(MachineId_t(i), S0); 
-        idleCounter.emplace(MachineId_t(i), 0);
+        remainingMips[MachineId_t(i)] = machinePerformance(MachineId_t(i), 0) * catalogNumCpus[MachineId_t(i)]; 
+        remainingMemory[MachineId_t(i)] = catalogMemory[MachineId_t(i)];
+        tierMips[MachineId_t(i)] = remainingMips[MachineId_t(i)]; 
+        setMachineState(MachineId_t(i), S0, REASON_INIT); 
+    }
+
+    /* Pools are in their final order, so every machine's rank is fixed from here on */
+    MachinePool_t *pools[] = {&x86Machines, &armMachines, &powerMachines, &riscvMachines}; 
+    for (MachinePool_t *pool: pools) {
+        int32_t rank = 0; 
+        for (auto & entry: *pool) {
+            eeRank[entry.second] = rank++; 
+        }
     }
 }
 
@@ -85,55 +505,71 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
     TaskInfo_t t_info = GetTaskInfo(task_id);
     CPUType_t cpu = t_info.required_cpu; 
     VMType_t os = t_info.required_vm; 
+    forecastArrival(cpu, t_info, now); 
+    gpuArrival(t_info); 
 
-    /* Figure out which list of machines to use */
-    vector<MachineId_t> machine_list;
+    /* Figure out which pool of machines to use */
+    MachinePool_t *machine_list;
     switch (cpu) {
         case X86:
-            machine_list = x86OnMachines;
+            machine_list = &x86OnMachines;
             break; 
         case ARM:
-            machine_list = armOnMachines; 
+            machine_list = &armOnMachines; 
             break;
         case POWER:
-            machine_list = powerOnMachines; 
+            machine_list = &powerOnMachines; 
             break;
         default:
-            machine_list = riscvOnMachines; 
+            machine_list = &riscvOnMachines; 
             break;
     }
 
     //Choose which machine we are going to use; try to assign to the most energy efficient machine (this should
-    //also generally congregate tasks onto the same machines)
-    MachineId_t chosen = -1; 
-    for (int i = 0; i < machine_list.size(); i++) {
-        
-        MachineInfo_t curr_info = Machine_GetInfo(machine_list.at(i));
-        if((curr_info.s_state == S0) && hasEnoughResource(machine_list.at(i), task_id)) {
-            chosen = machine_list.at(i);
-            break;
-        }
+    //also generally congregate tasks onto the same machines) that leaves the headroom the task's SLA class asks for;
+    //GPU-capable tasks look at GPU hosts first and, while they need them, everyone else looks there last
+    SLAType_t sla = t_info.required_sla; 
+    unsigned mips = taskMips(t_info); 
+    const int32_t *rank = placementRank(t_info); 
+    MachineId_t chosen = feasibleArgmin(tierMips.data(), remainingMemory.data(), rank, eligible.data(), 
+                                        ELIGIBLE(cpu), Machine_GetTotal(), slaNeed(sla, cpu, mips), t_info.required_memory, NULL); 
+    //No machine has that much room; any that can run the task will do
+    if (chosen == -1) {
+        chosen = feasibleArgmin(remainingMips.data(), remainingMemory.data(), rank, eligible.data(), 
+                                ELIGIBLE(cpu), Machine_GetTotal(), mips, t_info.required_memory, NULL); 
     }
 
     //Check that we actually found a machine that can service the task
+    uint8_t reason = REASON_PLACE;
     if (chosen == -1) {
+        reason = REASON_FALLBACK;
+        /* Before the first StateChangeComplete nothing is on yet, so draw from every machine of the type */
+        if ((*machine_list).empty()) {
+            MachinePool_t *pools[] = {&armMachines, &powerMachines, &riscvMachines, &x86Machines};
+            machine_list = pools[cpu];
+        }
         //If we didn't, just use a random one to disperse load
-        unsigned random = rand() % machine_list.size();
-        chosen = machine_list.at(random);
+        unsigned random = rand() % (*machine_list).size();
+        chosen = std::next((*machine_list).begin(), random)->second;
     }
 
     /* Put the task on the machine */
     if(vmMap.find(chosen) == vmMap.end()) {
         vmMap[chosen] = {}; 
     }
-    VMId_t v_id = VM_Create(os, cpu); 
-    isMigrating[v_id] = false;
+    VMId_t v_id = acquireVM(chosen, os, cpu); 
     vmMap[chosen].push_back(v_id); 
-    VM_Attach(v_id, chosen); 
     VM_AddTask(v_id, task_id, t_info.priority); 
-    remainingMips[chosen] -= 1000; 
+    traceDecision(TRACE_PLACE, reason, chosen, v_id, task_id, os); 
+    remainingMips[chosen] -= mips; 
     remainingMemory[chosen] -= t_info.required_memory;
+    slaHost(chosen, sla, 1); 
+    reheapMachine(chosen); 
+    idleEnd(chosen, now); 
     taskMap.emplace(task_id, chosen);
+    taskToVM[task_id] = v_id;
+    indexTask(chosen, task_id, t_info.total_instructions);
+    slackAdd(task_id, chosen, now);
 }
 
 void Scheduler::PeriodicCheck(Time_t now) {
@@ -141,46 +577,73 @@ void Scheduler::PeriodicCheck(Time_t now) {
     // SchedulerCheck is called periodically by the simulator to allow you to monitor, make decisions, adjustments, etc.
     // Unlike the other invocations of the scheduler, this one doesn't report any specific event
     // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
+    advanceWork(now);
+    reclaimIdleVMs(now);
+    slackCheck(now);
+    forecastAdvance(now);
+    if (slaAdapt(now)) {
+        for (unsigned i = 0; i < Machine_GetTotal(); i++) {
+            tierMips[i] = remainingMips[i] - signed(slaReserve(MachineId_t(i))); 
+        }
+    }
+
+    MachinePool_t *types[] = {&x86OnMachines, &x86OffMachines, &armOnMachines, &armOffMachines, &powerOnMachines, &powerOffMachines, &riscvOnMachines, &riscvOffMachines};
+    MachinePool_t *totalTypes[] = {&x86Machines, &armMachines, &powerMachines, &riscvMachines};
+    CPUType_t typeCpus[] = {X86, ARM, POWER, RISCV};
+    for (int a = 0; a < 8; a+=2) {
+        MachinePool_t *currOn = types[a];
+        MachinePool_t *currOff = types[a+1];
 
-    vector<vector<MachineId_t> *> types = {&x86OnMachines, &x86OffMachines, &armOnMachines, &armOffMachines, &powerOnMachines, &powerOffMachines, &riscvOnMachines, &riscvOffMachines};
-    vector<vector<MachineId_t> *> totalTypes = {&x86Machines, &armMachines, &powerMachines, &riscvMachines};
-    for (int a = 0; a < types.size(); a+=2) {
-        vector<MachineId_t> *currOn = types.at(a);
-        vector<MachineId_t> *currOff = types.at(a+1);
+        //Wake ahead of the forecast: machines that are on or already waking must cover it by the time they're up
+        unsigned forecast = forecastMachines(typeCpus[a/2]);
+        unsigned powered = totalTypes[a/2]->size() - (*currOff).size();
+        auto wake = (*currOff).begin();
+        while (powered < forecast && wake != (*currOff).end()) {
+            MachineId_t curr = wake->second;
+            wake = (*currOff).erase(wake);
+            setMachineState(curr, S0, REASON_FORECAST);
+            powered++;
+        }
 
-        //First compute the idle time for all onMachines
-        for (int i = 0; i < (*currOn).size(); i++) {
-            MachineId_t curr = (*currOn).at(i);
+        //First track how long each onMachine has been idle
+        for (auto & entry: *currOn) {
+            MachineId_t curr = entry.second;
             if (getCurrUtilization(curr) == 0) {
-                idleCounter.at(curr)++;
+                idleStart(curr, now);
             }
             else {
-                idleCounter.at(curr) = 0;
+                idleEnd(curr, now);
             }
         }
 
         if (getCurrentLoad((*currOn)) > 0.5 || SLA_warning == true) {
             unsigned numTurnOn = (*currOff).size() / 5;
-            for (int i = 0; i < (*currOff).size(); i++) {
-                if (numTurnOn == 0) {
-                    break;
-                }
-                MachineId_t curr = (*currOff).at(i);
-                (*currOff).erase((*currOff).begin() + i);
-                Machine_SetState(curr, S0);
+            auto it = (*currOff).begin();
+            while (numTurnOn > 0 && it != (*currOff).end()) {
+                MachineId_t curr = it->second;
+                it = (*currOff).erase(it);
+                setMachineState(curr, S0, REASON_DEMAND);
                 numTurnOn--;
-                i--;
             }
             SLA_warning = false;
         }
         else {
-            for (int i = 0; i < (*currOn).size(); i++) {
-                MachineId_t curr = (*currOn).at(i);
-                if (idleCounter.at(curr) == 500 && (*currOn).size() > totalTypes.at(a/2)->size() / 4) {
-                    currSleep = (currSleep != 6) ? currSleep + 1 : 3;
-                    (*currOn).erase((*currOn).begin() + i);
-                    Machine_SetState(curr, (MachineState_t) currSleep);
-                    i--;    
+            auto it = (*currOn).begin();
+            while (it != (*currOn).end()) {
+                MachineId_t curr = it->second;
+                MachineState_t sleep = S0;
+                if (idleSince[curr] != NOT_IDLE && now - idleSince[curr] >= idleHold 
+                    && (*currOn).size() > totalTypes[a/2]->size() / 4 && (*currOn).size() > forecast) {
+                    sleep = sleepState(curr, now);
+                }
+                if (sleep != S0) {
+                    it = (*currOn).erase(it);
+                    eligible[curr] = 0;
+                    reheapMachine(curr);
+                    setMachineState(curr, sleep, REASON_IDLE);
+                }
+                else {
+                    it++;
                 }
             }
         }
@@ -196,27 +659,45 @@ void Scheduler::Shutdown(Time_t time) {
     for(auto & vm: vms) {
         VM_Shutdown(vm);
     }
-    SimOutput("SimulationComplete(): Finished!", 4);
-    SimOutput("SimulationComplete(): Time is " + to_string(time), 4);
+    shutdownVMs();
+    SCHED_LOG(4, "SimulationComplete(): Finished!");
+    SCHED_LOG(4, "SimulationComplete(): Time is " + to_string(time));
 }
 
 void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
     // Do any bookkeeping necessary for the data structures
     // Decide if a machine is to be turned off, slowed down, or VMs to be migrated according to your policy
     // This is an opportunity to make any adjustments to optimize performance/energy
-    SimOutput("Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now), 4);
+    SCHED_LOG(4, "Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now));
 
-    remainingMips[taskMap[task_id]] += 1000;
-    remainingMemory[taskMap[task_id]] += GetTaskInfo(task_id).required_memory;
+    TaskInfo_t t_info = GetTaskInfo(task_id);
+    forecastCompletion(t_info.required_cpu, t_info, now);
+    remainingMips[taskMap[task_id]] += taskMips(t_info);
+    remainingMemory[taskMap[task_id]] += t_info.required_memory;
+    slaHost(taskMap[task_id], t_info.required_sla, -1);
+    slaCompleted[t_info.required_sla]++;
+    reheapMachine(taskMap[task_id]);
+    unindexTask(taskMap[task_id], task_id);
+    slackRemove(task_id, taskMap[task_id]);
+    //Hand the task's VM back to the warm pool of the machine it sits on
+    VMId_t done = taskToVM[task_id];
+    vector<VMId_t> &machine_vms = vmMap[vmHost[done]];
+    machine_vms.erase(std::remove(machine_vms.begin(), machine_vms.end(), done), machine_vms.end());
+    releaseVM(done, now);
+    taskToVM.erase(task_id);
 
-    //First find the machine with the least utilization that's still turned on and the max utilization as well
+    //First find the machine with the least utilization that's still turned on: the top of each min heap
+    //Note: machines at a currUtilization of 0 are kept out of the min heaps, there's nothing to migrate on them
     signed minUtilization = INT_MAX;
     MachineId_t min = -1;
-    for (unsigned i = 0; i < Machine_GetTotal(); i++) {
-        signed currUtilization = getCurrUtilization(MachineId_t(i));
-        //Note: If currUtilization = 0, that means there's nothing to migrate on this machine to begin with
-        if (currUtilization < minUtilization && currUtilization != 0 && Machine_GetInfo(MachineId_t(i)).s_state == S0) {
-            min = MachineId_t(i);
+    for (int c = 0; c < 4; c++) {
+        if (minUtilHeap[c].heap.empty()) {
+            continue;
+        }
+        MachineId_t top = minUtilHeap[c].heap[0];
+        signed currUtilization = getCurrUtilization(top);
+        if (currUtilization < minUtilization || (currUtilization == minUtilization && top < min)) {
+            min = top;
             minUtilization = currUtilization;
         }
     }
@@ -227,20 +708,12 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
         return;
     }
 
-    //Now find the workload on this machine with the most instructions remaining
-    vector<VMId_t> vms = vmMap[min];
-    unsigned maxLoad = 0;
+    //Now find the workload on this machine with the most instructions remaining: the top of its task index
     TaskId_t task_max = -1;
     VMId_t vm_max = -1;
-    for (VMId_t vm : vms) {
-        for (TaskId_t task : VM_GetInfo(vm).active_tasks){
-            TaskInfo_t t_info = GetTaskInfo(task);
-            if (t_info.remaining_instructions > maxLoad) {
-                task_max = task;
-                vm_max = vm;
-                maxLoad = t_info.remaining_instructions;
-            }
-        }
+    if (!taskIndex[min].empty()) {
+        task_max = taskIndex[min].rbegin()->second;
+        vm_max = taskToVM[task_max];
     }
 
     //If we cannot find any tasks to migrate then return OR if the task is close to completed
@@ -251,31 +724,9 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 
     //Now migrate that task from this machine to a machine with high utilization
     CPUType_t cpu = GetTaskInfo(task_max).required_cpu;
-    vector<MachineId_t> machine_list;
-    switch (cpu) {
-        case X86:
-            machine_list = x86OnMachines;
-            break; 
-        case ARM:
-            machine_list = armOnMachines; 
-            break;
-        case POWER:
-            machine_list = powerOnMachines; 
-            break;
-        default:
-            machine_list = riscvOnMachines; 
-            break;
-    }
-    signed maxUtilization = INT_MIN;
-    MachineId_t max = -1;
-    for (unsigned i = 0; i < machine_list.size(); i++) {
-        MachineId_t curr = machine_list.at(i);
-        signed currUtilization = getCurrUtilization(curr);
-        if (currUtilization > maxUtilization && hasEnoughResource(curr, task_max)) {
-            max = curr;
-            maxUtilization = currUtilization;
-        }
-    }
+    //Walk the max heap of this type from the top down to the busiest on machine with room for the task
+    MachineId_t max = busiestFeasible(&maxUtilHeap[cpu], GetTaskInfo(task_max).required_memory, taskMips(GetTaskInfo(task_max)));
+    signed maxUtilization = (max != -1) ? getCurrUtilization(max) : INT_MIN;
 
     //Double check the minimum load machine isn't the same as the max load
     if (minUtilization == maxUtilization) {
@@ -284,12 +735,7 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
     }
 
     if (max != -1 && !isMigrating[vm_max]) {
-        VM_Migrate(vm_max, max);
-        isMigrating[vm_max] = true;
-        remainingMips[max] -= 1000;
-        remainingMips[min] += 1000;
-        remainingMemory[max] -= GetTaskInfo(task_max).required_memory;
-        remainingMemory[min] += GetTaskInfo(task_max).required_memory;
+        migrateTask(task_max, min, max, REASON_CONSOLIDATE, now);
     }
 }
 
@@ -298,38 +744,51 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 static Scheduler Scheduler;
 
 void InitScheduler() {
-    SimOutput("InitScheduler(): Initializing scheduler", 4);
+    CallbackTimer timer(CB_INIT); 
+    openTrace(); 
+    SCHED_LOG(4, "InitScheduler(): Initializing scheduler");
     Scheduler.Init();
 }
 
 void HandleNewTask(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time), 4);
+    CallbackTimer timer(CB_NEW_TASK); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time));
     Scheduler.NewTask(time, task_id);
 }
 
 void HandleTaskCompletion(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time), 4);
+    CallbackTimer timer(CB_TASK_COMPLETE); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time));
     Scheduler.TaskComplete(time, task_id);
 }
 
 void MemoryWarning(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_MEMORY_WARNING); 
+    currentTime = time; 
     // The simulator is alerting you that machine identified by machine_id is overcommitted
-    SimOutput("MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time), 4);
+    SCHED_LOG(4, "MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time));
 }
 
 void MigrationDone(Time_t time, VMId_t vm_id) {
+    CallbackTimer timer(CB_MIGRATION_DONE); 
+    currentTime = time; 
     // The function is called on to alert you that migration is complete
-    SimOutput("MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time), 4);
+    SCHED_LOG(4, "MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time));
     Scheduler.MigrationComplete(time, vm_id);
 }
 
 void SchedulerCheck(Time_t time) {
+    CallbackTimer timer(CB_SCHEDULER_CHECK); 
+    currentTime = time; 
     // This function is called periodically by the simulator, no specific event
-    SimOutput("SchedulerCheck(): SchedulerCheck() called at " + to_string(time), 4);
+    SCHED_LOG(4, "SchedulerCheck(): SchedulerCheck() called at " + to_string(time));
     Scheduler.PeriodicCheck(time);
 }
 
 void SimulationComplete(Time_t time) {
+    currentTime = time; 
     // This function is called before the simulation terminates Add whatever you feel like.
     cout << "SLA violation report" << endl;
     cout << "SLA0: " << GetSLAReport(SLA0) << "%" << endl;
@@ -337,49 +796,68 @@ void SimulationComplete(Time_t time) {
     cout << "SLA2: " << GetSLAReport(SLA2) << "%" << endl;     // SLA3 do not have SLA violation issues
     cout << "Total Energy " << Machine_GetClusterEnergy() << "KW-Hour" << endl;
     cout << "Simulation run finished in " << double(time)/1000000 << " seconds" << endl;
-    SimOutput("SimulationComplete(): Simulation finished at time " + to_string(time), 4);
+    reportLatency();
+    SCHED_LOG(4, "SimulationComplete(): Simulation finished at time " + to_string(time));
     
     Scheduler.Shutdown(time);
+    closeTrace();
 }
 
 void SLAWarning(Time_t time, TaskId_t task_id) {
+    CallbackTimer timer(CB_SLA_WARNING); 
+    currentTime = time; 
     SLA_warning = true;
 }
 
 void StateChangeComplete(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_STATE_CHANGE); 
+    currentTime = time; 
     // Called in response to an earlier request to change the state of a machine
-    if (Machine_GetInfo(machine_id).s_state == S0) {
-        CPUType_t cpu = Machine_GetCPUType(machine_id);
+    catalogSState[machine_id] = Machine_GetInfo(machine_id).s_state; 
+    forecastWakeDone(machine_id, time); 
+    sleepDone(machine_id, time); 
+    eligible[machine_id] = (catalogSState[machine_id] == S0) ? ELIGIBLE(catalogCpu[machine_id]) : 0; 
+    reheapMachine(machine_id); 
+    if (catalogSState[machine_id] == S0) {
+        CPUType_t cpu = catalogCpu[machine_id];
         switch (cpu) {
             case X86:
-                insertSortedEE(&x86OnMachines, machine_id);
+                poolErase(&x86OffMachines, machine_id);
+                poolInsert(&x86OnMachines, machine_id);
                 break; 
             case ARM:
-                insertSortedEE(&armOnMachines, machine_id); 
+                poolErase(&armOffMachines, machine_id);
+                poolInsert(&armOnMachines, machine_id); 
                 break;
             case POWER:
-                insertSortedEE(&powerOnMachines, machine_id); 
+                poolErase(&powerOffMachines, machine_id);
+                poolInsert(&powerOnMachines, machine_id); 
                 break;
             default:
-                insertSortedEE(&riscvOnMachines, machine_id);
+                poolErase(&riscvOffMachines, machine_id);
+                poolInsert(&riscvOnMachines, machine_id);
                 break;
         }
     }
     else {
         //We just turned off a machine to some lower power state
-        CPUType_t cpu = Machine_GetCPUType(machine_id);
+        CPUType_t cpu = catalogCpu[machine_id];
         switch (cpu) {
             case X86:
-                insertSortedEE(&x86OffMachines, machine_id);
+                poolErase(&x86OnMachines, machine_id);
+                poolInsert(&x86OffMachines, machine_id);
                 break; 
             case ARM:
-                insertSortedEE(&armOffMachines, machine_id); 
+                poolErase(&armOnMachines, machine_id);
+                poolInsert(&armOffMachines, machine_id); 
                 break;
             case POWER:
-                insertSortedEE(&powerOffMachines, machine_id); 
+                poolErase(&powerOnMachines, machine_id);
+                poolInsert(&powerOffMachines, machine_id); 
                 break;
             default:
-                insertSortedEE(&riscvOffMachines, machine_id);
+                poolErase(&riscvOnMachines, machine_id);
+                poolInsert(&riscvOffMachines, machine_id);
                 break;
         }
     }
@@ -389,34 +867,19 @@ void StateChangeComplete(Time_t time, MachineId_t machine_id) {
 
 
 
-unsigned insertSortedEE(vector<MachineId_t>* mList, MachineId_t id) {
-
-    if((*mList).size() == 0) {
-        (*mList).push_back(id); 
-        return 0; 
-    }
-
-    MachineInfo_t newInfo = Machine_GetInfo (id); 
-    double new_ee = newInfo.performance.at(0) / newInfo.p_states.at(0); 
-
-    for (unsigned i = 0; i < (*mList).size(); i++) {
-        MachineInfo_t info = Machine_GetInfo((*mList).at(i));
-        double ee = info.performance.at(0) / info.p_states.at(0); 
-        if (new_ee > ee) {
-            (*mList).insert((*mList).begin() + i, id); 
-            return i; 
-        }
-    }
+/* Keyed on the negated efficiency so the set iterates from the most efficient machine down */
+void poolInsert(MachinePool_t* pool, MachineId_t id) {
+    (*pool).insert(std::make_pair(-machineEE[id], id)); 
+}
 
-    (*mList).push_back(id); 
-    return (*mList).size() - 1; 
+void poolErase(MachinePool_t* pool, MachineId_t id) {
+    (*pool).erase(std::make_pair(-machineEE[id], id)); 
 }
 
 bool hasEnoughResource(MachineId_t mid, TaskId_t tid) {
-    MachineInfo_t minfo = Machine_GetInfo(mid); 
     TaskInfo_t tinfo = GetTaskInfo(tid); 
 
-    unsigned mipsRequired = 1000; 
+    signed mipsRequired = taskMips(tinfo); 
     if(remainingMips[mid] < mipsRequired) {
         return false; 
     }
@@ -429,23 +892,22 @@ bool hasEnoughResource(MachineId_t mid, TaskId_t tid) {
 }
 
 signed getCurrUtilization(MachineId_t mid) {
-    MachineInfo_t minfo = Machine_GetInfo(mid); 
-    unsigned maxPerformance = minfo.performance[0] * minfo.num_cpus;
+    unsigned maxPerformance = machinePerformance(mid, 0) * catalogNumCpus[mid];
     signed currUtilization = maxPerformance - remainingMips[mid];
     return currUtilization;
 }
 
-double getCurrentLoad(vector<MachineId_t> machines) {
+double getCurrentLoad(const MachinePool_t &machines) {
     signed totalMips = 0;
     signed usedMips = 0;
     signed totalMemory = 0;
     signed usedMemory = 0;
-    for (unsigned i = 0; i < machines.size(); i++) {
-        MachineInfo_t info = Machine_GetInfo(machines.at(i));
-        totalMips += info.performance[0] * info.num_cpus;
-        usedMips += info.performance[0] * info.num_cpus - remainingMips[machines.at(i)];
-        totalMemory += info.memory_size;
-        usedMemory += info.memory_size - remainingMemory[machines.at(i)];
+    for (auto & entry: machines) {
+        MachineId_t mid = entry.second;
+        totalMips += machinePerformance(mid, 0) * catalogNumCpus[mid];
+        usedMips += machinePerformance(mid, 0) * catalogNumCpus[mid] - remainingMips[mid];
+        totalMemory += catalogMemory[mid];
+        usedMemory += catalogMemory[mid] - remainingMemory[mid];
     } 
     double mipsLoad = (usedMips * 1.0) / totalMips;
     double memoryLoad = (usedMemory * 1.0) / totalMemory;
@@ -453,3 +915,1058 @@ double getCurrentLoad(vector<MachineId_t> machines) {
     //Return largest overall load, whether it's mips or memory load
     return (mipsLoad > memoryLoad) ? mipsLoad : memoryLoad;
 }
+
+void heapInit(UtilHeap_t *h, unsigned total, bool maxHeap) {
+    (*h).heap.clear(); 
+    (*h).heap.reserve(total); 
+    (*h).pos.assign(total, -1); 
+    (*h).maxHeap = maxHeap; 
+}
+
+/* True when machine a belongs above machine b */
+bool heapBefore(const UtilHeap_t *h, MachineId_t a, MachineId_t b) {
+    signed ua = getCurrUtilization(a); 
+    signed ub = getCurrUtilization(b); 
+    if (ua != ub) {
+        return (*h).maxHeap ? ua > ub : ua < ub; 
+    }
+    return (*h).maxHeap ? eeRank[a] < eeRank[b] : a < b; 
+}
+
+/* Restore the heap order around one slot whose key may have moved either way */
+void heapSift(UtilHeap_t *h, int slot) {
+    vector<MachineId_t> &heap = (*h).heap; 
+    MachineId_t id = heap[slot]; 
+    while (slot > 0 && heapBefore(h, id, heap[(slot - 1) / 2])) {
+        heap[slot] = heap[(slot - 1) / 2]; 
+        (*h).pos[heap[slot]] = slot; 
+        slot = (slot - 1) / 2; 
+    }
+    int size = heap.size(); 
+    while (2 * slot + 1 < size) {
+        int child = 2 * slot + 1; 
+        if (child + 1 < size && heapBefore(h, heap[child + 1], heap[child])) {
+            child++; 
+        }
+        if (!heapBefore(h, heap[child], id)) {
+            break; 
+        }
+        heap[slot] = heap[child]; 
+        (*h).pos[heap[slot]] = slot; 
+        slot = child; 
+    }
+    heap[slot] = id; 
+    (*h).pos[id] = slot; 
+}
+
+/* Insert the machine, or move it to its new place after its utilization changed */
+void heapSet(UtilHeap_t *h, MachineId_t id) {
+    if ((*h).pos[id] == -1) {
+        (*h).heap.push_back(id); 
+        (*h).pos[id] = (*h).heap.size() - 1; 
+    }
+    heapSift(h, (*h).pos[id]); 
+}
+
+void heapRemove(UtilHeap_t *h, MachineId_t id) {
+    int slot = (*h).pos[id]; 
+    if (slot == -1) {
+        return; 
+    }
+    MachineId_t last = (*h).heap.back(); 
+    (*h).heap.pop_back(); 
+    (*h).pos[id] = -1; 
+    if (last != id) {
+        (*h).heap[slot] = last; 
+        (*h).pos[last] = slot; 
+        heapSift(h, slot); 
+    }
+}
+
+/* Called whenever remainingMips, s_state or eligible changes for a machine */
+void reheapMachine(MachineId_t mid) {
+    CPUType_t cpu = catalogCpu[mid]; 
+    //Every change to a machine's load comes through here, so its tier room is kept current too
+    tierMips[mid] = remainingMips[mid] - signed(slaReserve(mid)); 
+    if (catalogSState[mid] == S0 && getCurrUtilization(mid) != 0) {
+        heapSet(&minUtilHeap[cpu], mid); 
+    }
+    else {
+        heapRemove(&minUtilHeap[cpu], mid); 
+    }
+    if (eligible[mid] != 0) {
+        heapSet(&maxUtilHeap[cpu], mid); 
+    }
+    else {
+        heapRemove(&maxUtilHeap[cpu], mid); 
+    }
+}
+
+/* Best-first walk of the max heap: a child never ranks above its parent, so popping slots from a
+   frontier ordered like the heap visits machines busiest first and stops at the first one with
+   room, after O(k log k) steps for the k machines passed over */
+MachineId_t busiestFeasible(const UtilHeap_t *h, unsigned memory, unsigned mips) {
+    const vector<MachineId_t> &heap = (*h).heap; 
+    auto below = [&](int a, int b) { return heapBefore(h, heap[b], heap[a]); }; 
+    std::priority_queue<int, vector<int>, decltype(below)> frontier(below); 
+    if (!heap.empty()) {
+        frontier.push(0); 
+    }
+    while (!frontier.empty()) {
+        int slot = frontier.top(); 
+        frontier.pop(); 
+        MachineId_t mid = heap[slot]; 
+        if (remainingMips[mid] >= signed(mips) && remainingMemory[mid] >= memory) {
+            return mid; 
+        }
+        if (2 * slot + 1 < (int) heap.size()) {
+            frontier.push(2 * slot + 1); 
+        }
+        if (2 * slot + 2 < (int) heap.size()) {
+            frontier.push(2 * slot + 2); 
+        }
+    }
+    return -1; 
+}
+
+void indexTask(MachineId_t mid, TaskId_t tid, uint64_t remaining) {
+    uint64_t key = remaining + workDone[mid]; 
+    taskIndex[mid].insert(std::make_pair(key, tid)); 
+    taskWorkKey[tid] = key; 
+}
+
+/* Drops the task from the machine's index and returns its estimated instructions left */
+uint64_t unindexTask(MachineId_t mid, TaskId_t tid) {
+    auto it = taskWorkKey.find(tid); 
+    if (it == taskWorkKey.end()) {
+        return 0; 
+    }
+    uint64_t key = it->second; 
+    taskIndex[mid].erase(std::make_pair(key, tid)); 
+    taskWorkKey.erase(it); 
+    return (key > workDone[mid]) ? key - workDone[mid] : 0; 
+}
+
+/* Each task gets a core at P0 until there are more tasks than cores, then they share evenly */
+void advanceWork(Time_t now) {
+    Time_t elapsed = now - lastWorkUpdate; 
+    lastWorkUpdate = now; 
+    for (unsigned i = 0; i < taskIndex.size(); i++) {
+        uint64_t tasks = taskIndex[i].size(); 
+        if (tasks == 0 || catalogSState[i] != S0) {
+            continue; 
+        }
+        uint64_t perTask = uint64_t(machinePerformance(MachineId_t(i), 0)) * elapsed; 
+        if (tasks > catalogNumCpus[i]) {
+            perTask = perTask * catalogNumCpus[i] / tasks; 
+        }
+        workDone[i] += perTask; 
+    }
+}
+
+/* Hand out the most recently idled VM of this type on the machine, or create and attach one */
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu) {
+    vector<VMId_t> &pool = warmVMs[mid * NUM_VM_TYPES + type]; 
+    for(int i = int(pool.size()) - 1; i >= 0; i--) {
+        VMId_t vid = pool[i]; 
+        if(isMigrating[vid]) {
+            continue; 
+        }
+        pool.erase(pool.begin() + i); 
+        vmIdle[vid] = false; 
+        return vid; 
+    }
+    VMId_t vid = VM_Create(type, cpu); 
+    trackVM(vid); 
+    vmHost[vid] = mid; 
+    vmType[vid] = type; 
+    vmLive[vid] = true; 
+    VM_Attach(vid, mid); 
+    traceDecision(TRACE_VM_ATTACH, REASON_PLACE, mid, vid, TRACE_NONE, type); 
+    return vid; 
+}
+
+void releaseVM(VMId_t vid, Time_t now) {
+    vmIdle[vid] = true; 
+    vmIdleSince[vid] = now; 
+    warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]].push_back(vid); 
+    idleVMs.push_back(std::make_pair(now, vid)); 
+}
+
+/* Entries for VMs that were handed out again since they were queued are skipped */
+void reclaimIdleVMs(Time_t now) {
+    while(!idleVMs.empty() && idleVMs.front().first + vmIdleLimit <= now) {
+        Time_t since = idleVMs.front().first; 
+        VMId_t vid = idleVMs.front().second; 
+        idleVMs.pop_front(); 
+        if(!vmIdle[vid] || vmIdleSince[vid] != since) {
+            continue; 
+        }
+        if(isMigrating[vid]) {
+            /* Look again once the migration has landed */
+            vmIdleSince[vid] = now; 
+            idleVMs.push_back(std::make_pair(now, vid)); 
+            continue; 
+        }
+        vector<VMId_t> &pool = warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]]; 
+        pool.erase(std::remove(pool.begin(), pool.end(), vid), pool.end()); 
+        vmIdle[vid] = false; 
+        vmLive[vid] = false; 
+        VM_Shutdown(vid); 
+        traceDecision(TRACE_VM_SHUTDOWN, REASON_RECLAIM, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+    }
+}
+
+void shutdownVMs() {
+    for(unsigned vid = 0; vid < vmLive.size(); vid++) {
+        if(vmLive[vid]) {
+            VM_Shutdown(vid); 
+            vmLive[vid] = false; 
+            traceDecision(TRACE_VM_SHUTDOWN, REASON_SHUTDOWN, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+        }
+    }
+}
+
+//Move a task's VM between machines and carry the task's share of the accounting with it
+void migrateTask(TaskId_t tid, MachineId_t from, MachineId_t to, uint8_t reason, Time_t now) {
+    VMId_t vid = taskToVM[tid];
+    TaskInfo_t info = GetTaskInfo(tid);
+    VM_Migrate(vid, to);
+    traceDecision(TRACE_MIGRATE, reason, to, vid, tid, from);
+    isMigrating[vid] = true;
+    remainingMips[to] -= taskMips(info);
+    remainingMips[from] += taskMips(info);
+    remainingMemory[to] -= info.required_memory;
+    remainingMemory[from] += info.required_memory;
+    slaHost(to, info.required_sla, 1);
+    slaHost(from, info.required_sla, -1);
+    reheapMachine(to);
+    reheapMachine(from);
+    idleEnd(to, now);
+    indexTask(to, tid, unindexTask(from, tid));
+    taskMap[tid] = to;
+    vmMap[from].erase(std::remove(vmMap[from].begin(), vmMap[from].end(), vid), vmMap[from].end());
+    vmMap[to].push_back(vid);
+    vmHost[vid] = to;
+    slackMove(tid, from, to, now);
+}
+
+//A task short of slack moves to the most efficient on machine where it would run quicker; hosts
+//already run at P0 here, but one that doesn't is brought up first
+void slackRescue(TaskId_t tid, MachineId_t mid, Time_t now) {
+    if (catalogPState[mid] != P0) {
+        setMachinePerformance(mid, P0, REASON_SLACK);
+        return;
+    }
+    if (isMigrating[taskToVM[tid]]) {
+        return;
+    }
+    uint8_t saved = eligible[mid];
+    eligible[mid] = 0;
+    MachineId_t target = feasibleArgmin(remainingMips.data(), remainingMemory.data(), placementRank(GetTaskInfo(tid)), eligible.data(), 
+                                        ELIGIBLE(catalogCpu[mid]), Machine_GetTotal(), taskMips(GetTaskInfo(tid)), GetTaskMemory(tid), NULL);
+    eligible[mid] = saved;
+    if (target != -1 && slackRate(target, slackOn[target].size() + 1) > slackRate(mid, slackOn[mid].size())) {
+        migrateTask(tid, mid, target, REASON_SLACK, now);
+    }
+}
+
+/* Make room for a freshly created VM in the per-VM flags */
+void trackVM(VMId_t vid) {
+    if(vid >= isMigrating.size()) {
+        isMigrating.resize(vid + 1, false); 
+        vmHost.resize(vid + 1); 
+        vmType.resize(vid + 1); 
+        vmIdleSince.resize(vid + 1, 0); 
+        vmIdle.resize(vid + 1, false); 
+        vmLive.resize(vid + 1, false); 
+    }
+    isMigrating[vid] = false; 
+}
+
+/* SHARED BEGIN latency-impl */
+void histRecord(LatencyHist_t *hist, uint64_t ns) {
+    unsigned bucket = ns; 
+    if(ns >= (1u << HIST_SUB_BITS)) {
+        unsigned shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS; 
+        bucket = ((shift + 1) << HIST_SUB_BITS) + ((ns >> shift) & ((1u << HIST_SUB_BITS) - 1)); 
+    }
+    hist->buckets[bucket]++; 
+    hist->count++; 
+    hist->total += ns; 
+    if(ns > hist->max) {
+        hist->max = ns; 
+    }
+}
+
+/* Lower edge of the bucket holding the q-th fraction of the samples */
+uint64_t histPercentile(const LatencyHist_t *hist, double q) {
+    uint64_t rank = uint64_t(q * hist->count); 
+    uint64_t seen = 0; 
+    for(unsigned bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += hist->buckets[bucket]; 
+        if(seen > rank) {
+            if(bucket < (1u << HIST_SUB_BITS)) {
+                return bucket; 
+            }
+            unsigned shift = (bucket >> HIST_SUB_BITS) - 1; 
+            return uint64_t((1u << HIST_SUB_BITS) + (bucket & ((1u << HIST_SUB_BITS) - 1))) << shift; 
+        }
+    }
+    return hist->max; 
+}
+
+void reportLatency() {
+    cout << "Scheduler overhead (ns)" << endl;
+    for(unsigned i = 0; i < CB_COUNT; i++) {
+        const LatencyHist_t *hist = &callbackLatency[i]; 
+        if(hist->count == 0) {
+            continue; 
+        }
+        cout << hist->name << ": calls " << hist->count << " total " << hist->total 
+             << " p50 " << histPercentile(hist, 0.5) << " p99 " << histPercentile(hist, 0.99) 
+             << " max " << hist->max << endl;
+    }
+}
+/* SHARED END latency-impl */
+
+/* SHARED BEGIN trace-impl */
+void openTrace() {
+    const char *path = getenv("SCHED_TRACE"); 
+    if(path == NULL || traceFile != NULL) {
+        return; 
+    }
+    traceFile = fopen(path, "wb"); 
+    if(traceFile == NULL) {
+        SCHED_LOG(0, string("Cannot open trace file ") + path); 
+        return; 
+    }
+    TraceHeader_t header; 
+    memset(&header, 0, sizeof(header)); 
+    memcpy(header.magic, "SCHTRACE", 8); 
+    header.version = TRACE_VERSION; 
+    header.recordSize = sizeof(TraceRecord_t); 
+    strncpy(header.algorithm, SCHED_NAME, sizeof(header.algorithm) - 1); 
+    fwrite(&header, sizeof(header), 1, traceFile); 
+}
+
+void closeTrace() {
+    if(traceFile == NULL) {
+        return; 
+    }
+    fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+    traceCount = 0; 
+    fclose(traceFile); 
+    traceFile = NULL; 
+}
+
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg) {
+    if(traceFile == NULL) {
+        return; 
+    }
+    TraceRecord_t &record = traceBuffer[traceCount++]; 
+    record.time = currentTime; 
+    record.machine = mid; 
+    record.vm = vid; 
+    record.task = tid; 
+    record.kind = kind; 
+    record.reason = reason; 
+    record.arg = arg; 
+    memset(record.reserved, 0, sizeof(record.reserved)); 
+    if(traceCount == TRACE_BUFFER) {
+        fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+        traceCount = 0; 
+    }
+}
+/* SHARED END trace-impl */
+
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason) {
+    if(state == S0) {
+        forecastWakeStart(mid); 
+    }
+    sleepRequest(mid, state); 
+    Machine_SetState(mid, state); 
+    traceDecision(TRACE_SET_STATE, reason, mid, TRACE_NONE, TRACE_NONE, state); 
+}
+
+/* Every core of the machine to the same P-state */
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason) {
+    for(unsigned j = 0; j < catalogNumCpus[mid]; j++) {
+        Machine_SetCorePerformance(mid, j, p_state); 
+    }
+    traceDecision(TRACE_SET_PERF, reason, mid, TRACE_NONE, TRACE_NONE, p_state); 
+    /* Slowing down brings the host's tasks closer to their targets than they were filed for */
+    bool slower = p_state > catalogPState[mid]; 
+    catalogPState[mid] = p_state; 
+    if(slower) {
+        slackTouch(mid, currentTime); 
+    }
+}
+
+/* SHARED BEGIN forecast-impl */
+void forecastInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        forecasts[c] = Forecast_t(); 
+        wakeLatency[c] = forecastLead; 
+        forecastCores[c] = 0; 
+        forecastMemory[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        forecastCores[catalogCpu[i]] += catalogNumCpus[i]; 
+        forecastMemory[catalogCpu[i]] += catalogMemory[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            forecastCores[c] /= machines[c]; 
+            forecastMemory[c] /= machines[c]; 
+        }
+    }
+    wakeRequested.assign(Machine_GetTotal(), NO_WAKE); 
+}
+
+/* Close every interval that has ended, empty ones included */
+void forecastAdvance(Time_t now) {
+    unsigned seasons = std::min(forecastSeasons, unsigned(FORECAST_MAX_SEASONS)); 
+    for(int c = 0; c < 4; c++) {
+        Forecast_t *f = &forecasts[c]; 
+        unsigned closed = 0; 
+        while(now >= f->intervalStart + forecastInterval) {
+            double x = f->arrivals; 
+            f->arrivals = 0; 
+            f->intervalStart += forecastInterval; 
+            if(!f->primed) {
+                f->level = x; 
+                f->primed = true; 
+            } else if(seasons == 0) {
+                f->level = forecastAlpha * x + (1 - forecastAlpha) * f->level; 
+            } else {
+                double season = f->season[f->slot]; 
+                double level = forecastAlpha * (x - season) + (1 - forecastAlpha) * (f->level + f->trend); 
+                f->trend = forecastBeta * (level - f->level) + (1 - forecastBeta) * f->trend; 
+                f->season[f->slot] = forecastGamma * (x - level) + (1 - forecastGamma) * season; 
+                f->level = level; 
+                f->slot = (f->slot + 1) % seasons; 
+            }
+            /* After a long gap the model has decayed to the empty intervals; skip the rest */
+            if(++closed == 4 * (seasons + 1) + 16) {
+                f->intervalStart = now - (now % forecastInterval); 
+            }
+        }
+    }
+}
+
+void forecastArrival(CPUType_t cpu, const TaskInfo_t &info, Time_t now) {
+    forecastAdvance(now); 
+    Forecast_t *f = &forecasts[cpu]; 
+    f->arrivals++; 
+    if(f->lifetime == 0) {
+        f->lifetime = info.target_completion - info.arrival;    // the SLA window until a task finishes
+        f->memory = info.required_memory; 
+    }
+    f->memory = forecastAlpha * info.required_memory + (1 - forecastAlpha) * f->memory; 
+}
+
+void forecastCompletion(CPUType_t cpu, const TaskInfo_t &info, Time_t now) {
+    Forecast_t *f = &forecasts[cpu]; 
+    f->lifetime = forecastAlpha * (now - info.arrival) + (1 - forecastAlpha) * f->lifetime; 
+}
+
+/* Arrivals expected in the interval `ahead` intervals after the open one */
+double forecastRate(const Forecast_t *f, unsigned ahead) {
+    unsigned seasons = std::min(forecastSeasons, unsigned(FORECAST_MAX_SEASONS)); 
+    if(seasons == 0) {
+        return f->level; 
+    }
+    return std::max(0.0, f->level + ahead * f->trend + f->season[(f->slot + ahead) % seasons]); 
+}
+
+/* Tasks expected in flight once a machine woken now is up */
+double forecastTasks(CPUType_t cpu) {
+    const Forecast_t *f = &forecasts[cpu]; 
+    if(!f->primed) {
+        return 0; 
+    }
+    unsigned ahead = unsigned(std::ceil(wakeLatency[cpu] / forecastInterval)) + 1; 
+    double rate = std::max(forecastRate(f, 0), forecastRate(f, ahead)) / forecastInterval; 
+    return rate * f->lifetime; 
+}
+
+/* Machines of the type that should be powered to absorb the forecast, by cores and by memory */
+unsigned forecastMachines(CPUType_t cpu) {
+    if(forecastCores[cpu] == 0) {
+        return 0; 
+    }
+    double tasks = forecastTasks(cpu); 
+    double machines = std::max(tasks / forecastCores[cpu], tasks * forecasts[cpu].memory / forecastMemory[cpu]); 
+    return unsigned(std::ceil(machines * forecastHeadroom)); 
+}
+
+void forecastWakeStart(MachineId_t mid) {
+    if(catalogSState[mid] != S0 && wakeRequested[mid] == NO_WAKE) {
+        wakeRequested[mid] = currentTime; 
+    }
+}
+
+void forecastWakeDone(MachineId_t mid, Time_t now) {
+    if(wakeRequested[mid] == NO_WAKE) {
+        return; 
+    }
+    if(catalogSState[mid] == S0) {
+        CPUType_t cpu = catalogCpu[mid]; 
+        wakeLatency[cpu] = forecastAlpha * (now - wakeRequested[mid]) + (1 - forecastAlpha) * wakeLatency[cpu]; 
+    }
+    wakeRequested[mid] = NO_WAKE; 
+}
+/* SHARED END forecast-impl */
+
+void sleepInit() {
+    unsigned total = Machine_GetTotal(); 
+    sleepDown.assign(total * NUM_S_STATES, -1); 
+    sleepUp.assign(total * NUM_S_STATES, -1); 
+    for (int c = 0; c < 4; c++) {
+        for (int s = 0; s < NUM_S_STATES; s++) {
+            typeSleepDown[c][s] = -1; 
+            typeSleepUp[c][s] = -1; 
+        }
+    }
+    sleepRequested.assign(total, NOT_IDLE); 
+    sleepFrom.assign(total, S0); 
+    sleepTo.assign(total, S0); 
+    idleSince.assign(total, NOT_IDLE); 
+    idlePeriod.assign(total, 0); 
+}
+
+/* A request that replaces one still under way restarts the clock */
+void sleepRequest(MachineId_t mid, MachineState_t state) {
+    sleepRequested[mid] = currentTime; 
+    sleepFrom[mid] = catalogSState[mid]; 
+    sleepTo[mid] = state; 
+}
+
+/* Only plain trips between S0 and one sleep state are timed */
+void sleepSample(double *sample, double *typeSample, double latency) {
+    *sample = (*sample < 0) ? latency : sleepAlpha * latency + (1 - sleepAlpha) * *sample; 
+    *typeSample = (*typeSample < 0) ? latency : sleepAlpha * latency + (1 - sleepAlpha) * *typeSample; 
+}
+
+void sleepDone(MachineId_t mid, Time_t now) {
+    if (sleepRequested[mid] == NOT_IDLE || catalogSState[mid] != sleepTo[mid]) {
+        return; 
+    }
+    double latency = now - sleepRequested[mid]; 
+    CPUType_t cpu = catalogCpu[mid]; 
+    MachineState_t from = sleepFrom[mid]; 
+    MachineState_t to = sleepTo[mid]; 
+    if (from == S0 && to != S0) {
+        sleepSample(&sleepDown[mid * NUM_S_STATES + to], &typeSleepDown[cpu][to], latency); 
+    } else if (from != S0 && to == S0) {
+        sleepSample(&sleepUp[mid * NUM_S_STATES + from], &typeSleepUp[cpu][from], latency); 
+    }
+    sleepRequested[mid] = NOT_IDLE; 
+}
+
+/* Stand-in for a leg no machine of the type has timed: its slowest timed leg, at least forecastLead */
+double sleepPrior(const double *typeSample) {
+    double prior = forecastLead; 
+    for (unsigned s = S0 + 1; s < NUM_S_STATES; s++) {
+        prior = std::max(prior, typeSample[s]); 
+    }
+    return prior; 
+}
+
+/* Down and back up, from the machine's own trips, else its type's, else the prior */
+double sleepRoundTrip(MachineId_t mid, unsigned s_state) {
+    CPUType_t cpu = catalogCpu[mid]; 
+    double down = sleepDown[mid * NUM_S_STATES + s_state]; 
+    double up = sleepUp[mid * NUM_S_STATES + s_state]; 
+    if (down < 0) {
+        down = (typeSleepDown[cpu][s_state] < 0) ? sleepPrior(typeSleepDown[cpu]) : typeSleepDown[cpu][s_state]; 
+    }
+    if (up < 0) {
+        up = (typeSleepUp[cpu][s_state] < 0) ? sleepPrior(typeSleepUp[cpu]) : typeSleepUp[cpu][s_state]; 
+    }
+    return down + up; 
+}
+
+/* How long the machine must stay in the state to save energy over idling in S0, or -1 if it never does */
+double breakEven(MachineId_t mid, unsigned s_state) {
+    double idle = machineSStatePower(mid, S0); 
+    double asleep = machineSStatePower(mid, s_state); 
+    if (asleep >= idle) {
+        return -1; 
+    }
+    double transition = sleepTransitionPower * idle; 
+    return sleepRoundTrip(mid, s_state) * std::max(0.0, transition - asleep) / (idle - asleep); 
+}
+
+/* The deepest state worth entering for the idle time ahead, S0 when none is */
+MachineState_t sleepState(MachineId_t mid, Time_t now) {
+    if (machineSStatePower(mid, S0) == 0) {
+        //No power table to weigh the states against each other
+        return S3; 
+    }
+    double idle = now - idleSince[mid]; 
+    double predicted = std::max(idlePeriod[mid] - idle, idle); 
+    for (int s = S5; s > S0; s--) {
+        double t = breakEven(mid, s); 
+        if (t >= 0 && t <= predicted) {
+            return MachineState_t(s); 
+        }
+    }
+    return S0; 
+}
+
+void idleStart(MachineId_t mid, Time_t now) {
+    if (idleSince[mid] == NOT_IDLE) {
+        idleSince[mid] = now; 
+    }
+}
+
+void idleEnd(MachineId_t mid, Time_t now) {
+    if (idleSince[mid] == NOT_IDLE) {
+        return; 
+    }
+    double period = now - idleSince[mid]; 
+    idlePeriod[mid] = (idlePeriod[mid] == 0) ? period : sleepAlpha * period + (1 - sleepAlpha) * idlePeriod[mid]; 
+    idleSince[mid] = NOT_IDLE; 
+}
+
+/* SHARED BEGIN demand-impl */
+unsigned taskMips(const TaskInfo_t &info) {
+    if(info.target_completion <= info.arrival) {
+        return 1000; 
+    }
+    double mips = demandMargin * double(info.total_instructions) / double(info.target_completion - info.arrival); 
+    return std::max(1u, unsigned(std::ceil(mips))); 
+}
+/* SHARED END demand-impl */
+
+/* SHARED BEGIN gpu-impl */
+void gpuArrival(const TaskInfo_t &info) {
+    gpuShare[info.required_cpu] = gpuAlpha * (info.gpu_capable ? 1.0 : 0.0) + (1 - gpuAlpha) * gpuShare[info.required_cpu]; 
+}
+
+bool gpuReserved(CPUType_t cpu) {
+    return gpuShare[cpu] >= gpuReserveShare; 
+}
+
+/* Whether the machine is the kind of host the task should try first */
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid) {
+    if(info.gpu_capable) {
+        return catalogGpus[mid]; 
+    }
+    return !(catalogGpus[mid] && gpuReserved(info.required_cpu)); 
+}
+/* SHARED END gpu-impl */
+
+/* SHARED BEGIN gpu-rank-impl */
+/* Ranks only order machines of one type against each other, so one order over all of them will do */
+void gpuInit() {
+    unsigned total = Machine_GetTotal(); 
+    vector<MachineId_t> order(total); 
+    vector<double> efficiency(total); 
+    for(unsigned i = 0; i < total; i++) {
+        order[i] = MachineId_t(i); 
+        efficiency[i] = double(machinePerformance(MachineId_t(i), 0)) / std::max(1u, machinePStatePower(MachineId_t(i), 0)); 
+    }
+    std::sort(order.begin(), order.end(), [&](MachineId_t a, MachineId_t b) {
+        double ea = efficiency[a] * (catalogGpus[a] ? gpuSpeedup : 1.0); 
+        double eb = efficiency[b] * (catalogGpus[b] ? gpuSpeedup : 1.0); 
+        return (ea != eb) ? ea > eb : a < b; 
+    });
+    gpuRank.resize(total); 
+    for(unsigned i = 0; i < total; i++) {
+        gpuRank[order[i]] = i; 
+    }
+    std::sort(order.begin(), order.end(), [&](MachineId_t a, MachineId_t b) {
+        if(catalogGpus[a] != catalogGpus[b]) {
+            return !catalogGpus[a]; 
+        }
+        return (efficiency[a] != efficiency[b]) ? efficiency[a] > efficiency[b] : a < b; 
+    });
+    plainRank.resize(total); 
+    for(unsigned i = 0; i < total; i++) {
+        plainRank[order[i]] = i; 
+    }
+}
+
+const int32_t *placementRank(const TaskInfo_t &info) {
+    if(info.gpu_capable) {
+        return gpuRank.data(); 
+    }
+    return gpuReserved(info.required_cpu) ? plainRank.data() : eeRank.data(); 
+}
+/* SHARED END gpu-rank-impl */
+
+/* SHARED BEGIN sla-impl */
+void slaInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        slaCompleted[c] = 0; 
+        slaSeenCompleted[c] = 0; 
+        slaSeenMissed[c] = 0; 
+        slaCapacity[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        slaCapacity[catalogCpu[i]] += machinePerformance(MachineId_t(i), 0) * catalogNumCpus[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            slaCapacity[c] /= machines[c]; 
+        }
+    }
+    slaHosted.assign(Machine_GetTotal() * 4, 0); 
+}
+
+/* Count a task of the class onto (count 1) or off (count -1) a machine */
+void slaHost(MachineId_t mid, SLAType_t sla, int count) {
+    slaHosted[mid * 4 + sla] += count; 
+}
+
+/* Machines with SLA0 or SLA1 work stay at P0 */
+bool slaPinned(MachineId_t mid) {
+    return slaHosted[mid * 4 + SLA0] > 0 || slaHosted[mid * 4 + SLA1] > 0; 
+}
+
+/* MIPS held back on a machine for the tightest class it hosts */
+unsigned slaReserve(MachineId_t mid) {
+    double target = 1.0; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        if(slaHosted[mid * 4 + c] > 0) {
+            target = std::min(target, slaTarget[c]); 
+        }
+    }
+    return unsigned((1 - target) * machinePerformance(mid, 0) * catalogNumCpus[mid]); 
+}
+
+/* MIPS a new task of the class needs free on a machine of the type: its own demand and its headroom */
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips) {
+    return mips + unsigned((1 - slaTarget[sla]) * slaCapacity[cpu]); 
+}
+
+/* Move the targets of the classes whose recent miss rate is off their goal; true if any moved */
+bool slaAdapt(Time_t now) {
+    if(now - slaLastAdapt < slaAdaptInterval) {
+        return false; 
+    }
+    slaLastAdapt = now; 
+    bool changed = false; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        unsigned window = slaCompleted[c] - slaSeenCompleted[c]; 
+        if(window < slaMinSamples) {
+            continue; 
+        }
+        double missed = GetSLAReport(SLAType_t(c)) * slaCompleted[c] / 100; 
+        double rate = 100 * (missed - slaSeenMissed[c]) / window; 
+        slaSeenCompleted[c] = slaCompleted[c]; 
+        slaSeenMissed[c] = missed; 
+        double target = slaTarget[c]; 
+        if(rate > slaGoal[c]) {
+            target = std::max(slaTargetFloor, target - slaStep); 
+        } else if(rate < slaGoal[c] / 2) {
+            target = std::min(1.0, target + slaStep); 
+        }
+        if(target != slaTarget[c]) {
+            SCHED_LOG(2, "SLA" + to_string(c) + " missed " + to_string(rate) + "%, utilization target now " + to_string(target)); 
+            slaTarget[c] = target; 
+            changed = true; 
+        }
+    }
+    return changed; 
+}
+/* SHARED END sla-impl */
+
+/* SHARED BEGIN slack-impl */
+void slackInit() {
+    slackOn.assign(Machine_GetTotal(), std::set<TaskId_t>()); 
+}
+
+/* File a task that just landed on the machine; its co-tenants only need re-filing once the machine
+   runs more tasks than it has cores and their share of it shrinks */
+void slackAdd(TaskId_t tid, MachineId_t mid, Time_t now) {
+    slackOn[mid].insert(tid); 
+    if(slackOn[mid].size() > catalogNumCpus[mid]) {
+        slackTouch(mid, now); 
+        return; 
+    }
+    TaskInfo_t info = GetTaskInfo(tid); 
+    if(info.required_sla != SLA3) {
+        slackFile(tid, now + Time_t(std::max(0.0, slackSpare(info, mid, now)))); 
+    }
+}
+
+/* A finished task leaves its heap entries behind to be skipped */
+void slackRemove(TaskId_t tid, MachineId_t mid) {
+    slackOn[mid].erase(tid); 
+    slackLive.erase(tid); 
+}
+
+void slackMove(TaskId_t tid, MachineId_t from, MachineId_t to, Time_t now) {
+    slackOn[from].erase(tid); 
+    slackAdd(tid, to, now); 
+}
+
+/* MIPS each of `tasks` tasks gets on the machine at its current P-state */
+double slackRate(MachineId_t mid, unsigned tasks) {
+    double rate = machinePerformance(mid, catalogPState[mid]); 
+    if(tasks > catalogNumCpus[mid]) {
+        rate = rate * catalogNumCpus[mid] / tasks; 
+    }
+    return std::max(rate, 1.0); 
+}
+
+/* Slack above the margin in us, negative once the task is at risk */
+double slackSpare(const TaskInfo_t &info, MachineId_t mid, Time_t now) {
+    double rate = slackRate(mid, slackOn[mid].size()); 
+    if(info.gpu_capable && catalogGpus[mid]) {
+        rate *= gpuSpeedup; 
+    }
+    double left = info.remaining_instructions / rate; 
+    double window = double(info.target_completion) - double(info.arrival); 
+    return double(info.target_completion) - double(now) - left - slackMargin * window; 
+}
+
+/* Once stale entries outnumber live ones the heap is rebuilt from slackLive */
+void slackFile(TaskId_t tid, Time_t due) {
+    SlackEntry_t entry = std::make_pair(due, std::make_pair(++slackSequence, tid)); 
+    slackLive[tid] = entry; 
+    slackHeap.push(entry); 
+    if(slackHeap.size() > 2 * slackLive.size() + 1024) {
+        vector<SlackEntry_t> live; 
+        live.reserve(slackLive.size()); 
+        for(auto & entry: slackLive) {
+            live.push_back(entry.second); 
+        }
+        slackHeap = std::priority_queue<SlackEntry_t, vector<SlackEntry_t>, std::greater<SlackEntry_t>>(
+            std::greater<SlackEntry_t>(), std::move(live)); 
+    }
+}
+
+/* Re-file the tasks of a machine that just got slower for them */
+void slackTouch(MachineId_t mid, Time_t now) {
+    for(TaskId_t tid: slackOn[mid]) {
+        TaskInfo_t info = GetTaskInfo(tid); 
+        if(info.required_sla != SLA3) {
+            slackFile(tid, now + Time_t(std::max(0.0, slackSpare(info, mid, now)))); 
+        }
+    }
+}
+
+/* Pop the tasks whose slack is due to run out, rescue the ones that really are short and file
+   every one again for its next look */
+void slackCheck(Time_t now) {
+    while(!slackHeap.empty() && slackHeap.top().first <= now) {
+        SlackEntry_t entry = slackHeap.top(); 
+        slackHeap.pop(); 
+        TaskId_t tid = entry.second.second; 
+        auto live = slackLive.find(tid); 
+        if(live == slackLive.end() || live->second != entry) {
+            continue; 
+        }
+        MachineId_t mid = taskMap[tid]; 
+        double spare = slackSpare(GetTaskInfo(tid), mid, now); 
+        if(spare >= 1) {
+            slackFile(tid, now + Time_t(spare)); 
+            continue; 
+        }
+        SCHED_LOG(2, "Task " + to_string(tid) + " on machine " + to_string(mid) + " is " 
+                     + to_string(Time_t(-spare)) + "us past its slack margin"); 
+        slackRescue(tid, mid, now); 
+        slackFile(tid, now + slackRetry); 
+    }
+}
+/* SHARED END slack-impl */
+
+/* SHARED BEGIN logging-impl */
+/* Runtime log level from SCHED_VERBOSE, SCHED_LOG_MAX when it is unset */
+int initLogLevel() {
+    const char *level = getenv("SCHED_VERBOSE"); 
+    return (level != NULL) ? atoi(level) : SCHED_LOG_MAX; 
+}
+/* SHARED END logging-impl */
+
+/* SHARED BEGIN catalog-impl */
+void buildCatalog() {
+    unsigned total = Machine_GetTotal(); 
+    catalogCpu.resize(total); 
+    catalogNumCpus.resize(total); 
+    catalogMemory.resize(total); 
+    catalogGpus.resize(total); 
+    catalogPerformance.assign(total * NUM_P_STATES, 0); 
+    catalogPStatePower.assign(total * NUM_P_STATES, 0); 
+    catalogSStatePower.assign(total * NUM_S_STATES, 0); 
+    catalogSState.resize(total); 
+    catalogPState.resize(total); 
+
+    for(unsigned i = 0; i < total; i++) {
+        MachineInfo_t info = Machine_GetInfo(MachineId_t(i)); 
+        catalogCpu[i] = info.cpu; 
+        catalogNumCpus[i] = info.num_cpus; 
+        catalogMemory[i] = info.memory_size; 
+        catalogGpus[i] = info.gpus; 
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.performance.size(); p++) {
+            catalogPerformance[i * NUM_P_STATES + p] = info.performance[p]; 
+        }
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.p_states.size(); p++) {
+            catalogPStatePower[i * NUM_P_STATES + p] = info.p_states[p]; 
+        }
+        /* s_states is not always populated, missing entries stay at 0 */
+        for(unsigned s = 0; s < NUM_S_STATES && s < info.s_states.size(); s++) {
+            catalogSStatePower[i * NUM_S_STATES + s] = info.s_states[s]; 
+        }
+        catalogSState[i] = info.s_state; 
+        catalogPState[i] = info.p_state; 
+    }
+}
+
+unsigned machinePerformance(MachineId_t mid, unsigned p_state) {
+    return catalogPerformance[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state) {
+    return catalogPStatePower[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state) {
+    return catalogSStatePower[mid * NUM_S_STATES + s_state]; 
+}
+/* SHARED END catalog-impl */
+
+/* SHARED BEGIN kernel-impl */
+/* Scalar check of candidates i..n-1, folded into the best found so far */
+int feasibleTail(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                 uint8_t want, unsigned i, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask,
+                 int best, int32_t bestScore) {
+    for(; i < n; i++) {
+        if(eligible[i] == want && mips[i] >= mipsNeeded && memory[i] >= memoryNeeded) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(1) << (i % 64); 
+            }
+            if(score[i] < bestScore || best == -1) {
+                bestScore = score[i]; 
+                best = i; 
+            }
+        }
+    }
+    return best; 
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+int feasibleAvx2(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                 uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    int32_t bestScore = INT32_MAX; 
+    int best = -1; 
+    unsigned i = 0; 
+    const __m256i needMips = _mm256_set1_epi32(mipsNeeded - 1); 
+    const __m256i needMemory = _mm256_set1_epi32(memoryNeeded); 
+    const __m256i wanted = _mm256_set1_epi32(want); 
+    const __m256i step = _mm256_set1_epi32(8); 
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); 
+    __m256i laneBest = _mm256_set1_epi32(INT32_MAX); 
+    __m256i laneIndex = _mm256_set1_epi32(-1); 
+    for(; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)(mips + i)); 
+        __m256i mem = _mm256_loadu_si256((const __m256i *)(memory + i)); 
+        __m256i el = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(eligible + i))); 
+        __m256i ok = _mm256_cmpgt_epi32(m, needMips); 
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_max_epu32(mem, needMemory), mem)); 
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(el, wanted)); 
+        unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(ok)); 
+        if(bits != 0) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(bits) << (i % 64); 
+            }
+            __m256i s = _mm256_loadu_si256((const __m256i *)(score + i)); 
+            __m256i better = _mm256_and_si256(ok, _mm256_cmpgt_epi32(laneBest, s)); 
+            laneBest = _mm256_blendv_epi8(laneBest, s, better); 
+            laneIndex = _mm256_blendv_epi8(laneIndex, lane, better); 
+        }
+        lane = _mm256_add_epi32(lane, step); 
+    }
+    int32_t scores[8]; 
+    int32_t indices[8]; 
+    _mm256_storeu_si256((__m256i *)scores, laneBest); 
+    _mm256_storeu_si256((__m256i *)indices, laneIndex); 
+    for(int l = 0; l < 8; l++) {
+        if(indices[l] != -1 && (best == -1 || scores[l] < bestScore || (scores[l] == bestScore && indices[l] < best))) {
+            bestScore = scores[l]; 
+            best = indices[l]; 
+        }
+    }
+    return feasibleTail(mips, memory, score, eligible, want, i, n, mipsNeeded, memoryNeeded, mask, best, bestScore); 
+}
+
+__attribute__((target("sse4.1")))
+int feasibleSse41(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                  uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    int32_t bestScore = INT32_MAX; 
+    int best = -1; 
+    unsigned i = 0; 
+    const __m128i needMips = _mm_set1_epi32(mipsNeeded - 1); 
+    const __m128i needMemory = _mm_set1_epi32(memoryNeeded); 
+    const __m128i wanted = _mm_set1_epi32(want); 
+    const __m128i step = _mm_set1_epi32(4); 
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3); 
+    __m128i laneBest = _mm_set1_epi32(INT32_MAX); 
+    __m128i laneIndex = _mm_set1_epi32(-1); 
+    for(; i + 4 <= n; i += 4) {
+        int32_t packed; 
+        memcpy(&packed, eligible + i, sizeof(packed)); 
+        __m128i m = _mm_loadu_si128((const __m128i *)(mips + i)); 
+        __m128i mem = _mm_loadu_si128((const __m128i *)(memory + i)); 
+        __m128i el = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)); 
+        __m128i ok = _mm_cmpgt_epi32(m, needMips); 
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_max_epu32(mem, needMemory), mem)); 
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(el, wanted)); 
+        unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(ok)); 
+        if(bits != 0) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(bits) << (i % 64); 
+            }
+            __m128i s = _mm_loadu_si128((const __m128i *)(score + i)); 
+            __m128i better = _mm_and_si128(ok, _mm_cmpgt_epi32(laneBest, s)); 
+            laneBest = _mm_blendv_epi8(laneBest, s, better); 
+            laneIndex = _mm_blendv_epi8(laneIndex, lane, better); 
+        }
+        lane = _mm_add_epi32(lane, step); 
+    }
+    int32_t scores[4]; 
+    int32_t indices[4]; 
+    _mm_storeu_si128((__m128i *)scores, laneBest); 
+    _mm_storeu_si128((__m128i *)indices, laneIndex); 
+    for(int l = 0; l < 4; l++) {
+        if(indices[l] != -1 && (best == -1 || scores[l] < bestScore || (scores[l] == bestScore && indices[l] < best))) {
+            bestScore = scores[l]; 
+            best = indices[l]; 
+        }
+    }
+    return feasibleTail(mips, memory, score, eligible, want, i, n, mipsNeeded, memoryNeeded, mask, best, bestScore); 
+}
+#endif
+
+/* Checks n candidates in one pass: a candidate is feasible when eligible[i] == want and it has
+   at least mipsNeeded MIPS and memoryNeeded memory left. Sets bit i of mask (if given) for every
+   feasible candidate and returns the feasible one with the lowest score (scores stay below
+   INT32_MAX), lowest index on ties, or -1. On x86 the widest version the CPU runs is picked once:
+   AVX2 handles 8 candidates per step, SSE4.1 handles 4, and the tail runs scalar */
+int feasibleArgmin(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                   uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    if(mask != NULL) {
+        (*mask).assign((n + 63) / 64, 0); 
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    static const int level = __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("sse4.1") ? 1 : 0); 
+    if(level == 2) {
+        return feasibleAvx2(mips, memory, score, eligible, want, n, mipsNeeded, memoryNeeded, mask); 
+    }
+    if(level == 1) {
+        return feasibleSse41(mips, memory, score, eligible, want, n, mipsNeeded, memoryNeeded, mask); 
+    }
+#endif
+    return feasibleTail(mips, memory, score, eligible, want, 0, n, mipsNeeded, memoryNeeded, mask, -1, INT32_MAX); 
+}
+/* SHARED END kernel-impl */
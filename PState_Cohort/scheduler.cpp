@@ -7,6 +7,10 @@
 
 #include "Scheduler.hpp"
 #include <unordered_map>
+#include <cstdio>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
 #include <cmath>
 #include <limits.h>
 #include <algorithm>
@@ -14,6 +18,33 @@
 #include <vector>
 #include <iterator>
 #include <random>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Name of this scheduler in its decision trace */
+#define SCHED_NAME "PStateCohort"
+
+/* SHARED BEGIN logging */
+/* Scheduler logging. SCHED_LOG(level, message) only evaluates message, and so only builds the
+   string, when level is within both SCHED_LOG_MAX (compile time, -DSCHED_LOG_MAX=0 compiles every
+   message above 0 out) and schedLogLevel (runtime, taken from the SCHED_VERBOSE environment
+   variable). Both default to 4, which passes everything on to SimOutput as before */
+#ifndef SCHED_LOG_MAX
+#define SCHED_LOG_MAX 4
+#endif
+#define SCHED_LOG(level, message) \
+    do { \
+        if((level) <= SCHED_LOG_MAX && (level) <= schedLogLevel) { \
+            SimOutput((message), (level)); \
+        } \
+    } while(0)
+
+int initLogLevel(); 
+int schedLogLevel = initLogLevel(); 
+/* SHARED END logging */
 
 vector<MachineId_t> x86Machines;
 vector<MachineId_t> armMachines;
@@ -23,30 +54,314 @@ vector<MachineId_t> allMachines;
 
 unsigned currAssign = 0;
 unsigned currSleep = 3;
-bool SLA_warning = false;
-CPUPerformance_t currentPerf = P3;
+
+/* Per-machine DVFS governor. Each machine runs at the slowest P-state whose capacity keeps its
+   MIPS demand under governorUp. Speeding up happens at once; slowing down waits until the demand
+   fits under governorDown at the slower state, the machine has held its state for governorDwell
+   and its CPU type's load is not rising. Machines hosting SLA0 or SLA1 work stay at P0. Only
+   machines in governorDirty (demand changed, SLA boost, or still waiting out a dwell) are looked
+   at on each SchedulerCheck */
+vector<CPUPerformance_t> machinePerf; 
+vector<Time_t> perfSince; 
+vector<Time_t> boostUntil;          // run at P0 until then after an SLA warning
+vector<MachineId_t> governorDirty; 
+vector<bool> inGovernorDirty; 
+double governorUp = 0.8; 
+double governorDown = 0.6; 
+Time_t governorDwell = 500000; 
 
 std::unordered_map<MachineId_t, vector<VMId_t>> vmMap;
 std::unordered_map<TaskId_t, MachineId_t> taskMap;
-std::unordered_map<MachineId_t, signed> mipsCost; 
-std::unordered_map<MachineId_t, unsigned> memoryCost; 
-std::unordered_map<VMId_t, bool> isMigrating; 
+std::unordered_map<TaskId_t, VMId_t> taskToVM;
+
+/* Warm VM pool. A VM whose work is done stays attached to its machine in
+   warmVMs[machine * NUM_VM_TYPES + type] and goes to the next task of that type placed there,
+   so arrivals skip VM_Create/VM_Attach. VMs left idle for vmIdleLimit are shut down from
+   SchedulerCheck, oldest first */
+#define NUM_VM_TYPES 4
+vector<vector<VMId_t>> warmVMs; 
+std::deque<std::pair<Time_t, VMId_t>> idleVMs;     // in release order
+vector<MachineId_t> vmHost;     // per-VM entries below are indexed by VMId_t
+vector<VMType_t> vmType; 
+vector<Time_t> vmIdleSince; 
+vector<bool> vmIdle; 
+vector<bool> vmLive; 
+Time_t vmIdleLimit = 5000000; 
+
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu);
+void releaseVM(VMId_t vid, Time_t now);
+void reclaimIdleVMs(Time_t now);
+void shutdownVMs();
+
+/* Accounting table indexed directly by MachineId_t, sized once in Init */
+vector<signed> mipsCost; 
+vector<unsigned> memoryCost; 
+vector<bool> isMigrating;   // indexed by VMId_t, grown as VMs are created
+vector<int32_t> headroomMips;       // MIPS left at the current performance level
+vector<uint32_t> headroomMemory; 
+vector<int32_t> tierMips;           // headroomMips less the SLA reserve of the machine's tasks
+vector<int32_t> eeRank;             // position of each machine in its energy-efficiency ordered list
+
+/* SHARED BEGIN latency */
+/* Scheduler overhead: wall time spent in each entry point, recorded by a CallbackTimer at the top
+   of the callback into a log-linear histogram (every power of two of nanoseconds split into 8
+   linear buckets, so a percentile is within 12.5%) and reported from SimulationComplete */
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS (64 << HIST_SUB_BITS)
+typedef struct {
+    const char *name; 
+    uint64_t count = 0; 
+    uint64_t total = 0; 
+    uint64_t max = 0; 
+    uint64_t buckets[HIST_BUCKETS] = {}; 
+} LatencyHist_t;
+
+enum { CB_INIT, CB_NEW_TASK, CB_TASK_COMPLETE, CB_MEMORY_WARNING, CB_SLA_WARNING, CB_MIGRATION_DONE, 
+       CB_SCHEDULER_CHECK, CB_STATE_CHANGE, CB_COUNT };
+LatencyHist_t callbackLatency[CB_COUNT] = {
+    {"InitScheduler"}, {"HandleNewTask"}, {"HandleTaskCompletion"}, {"MemoryWarning"}, {"SLAWarning"}, 
+    {"MigrationDone"}, {"SchedulerCheck"}, {"StateChangeComplete"}
+};
+
+void histRecord(LatencyHist_t *hist, uint64_t ns);
+uint64_t histPercentile(const LatencyHist_t *hist, double q);
+void reportLatency();
+
+struct CallbackTimer {
+    unsigned which; 
+    std::chrono::steady_clock::time_point start; 
+    CallbackTimer(unsigned which) : which(which), start(std::chrono::steady_clock::now()) {}
+    ~CallbackTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start; 
+        histRecord(&callbackLatency[which], std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()); 
+    }
+};
+/* SHARED END latency */
+
+/* SHARED BEGIN trace */
+/* Decision trace. With SCHED_TRACE=<file> set, every placement, migration, VM attach/shutdown,
+   power-state and P-state request is appended to <file> as a fixed 32-byte record behind a
+   32-byte header, through a buffer flushed every TRACE_BUFFER records and at the end of the run.
+   Tools/trace_reader.cpp prints and diffs these files. Without SCHED_TRACE, traceDecision
+   returns at once */
+#define TRACE_VERSION 1
+#define TRACE_BUFFER 4096
+#define TRACE_NONE UINT32_MAX
+typedef struct {
+    char magic[8];          // "SCHTRACE"
+    uint32_t version; 
+    uint32_t recordSize; 
+    char algorithm[16]; 
+} TraceHeader_t;
+
+typedef struct {
+    uint64_t time; 
+    uint32_t machine; 
+    uint32_t vm; 
+    uint32_t task; 
+    uint32_t arg;           // S-state or P-state requested, VM type, or migration source machine
+    uint8_t kind; 
+    uint8_t reason; 
+    uint8_t reserved[6]; 
+} TraceRecord_t;
+static_assert(sizeof(TraceRecord_t) == 32, "trace records are 32 bytes"); 
+
+enum { TRACE_PLACE, TRACE_MIGRATE, TRACE_SET_STATE, TRACE_SET_PERF, TRACE_VM_ATTACH, TRACE_VM_SHUTDOWN };
+enum { REASON_INIT, REASON_PLACE, REASON_FALLBACK, REASON_MEMORY_WARNING, REASON_SLA_WARNING, REASON_CONSOLIDATE, 
+       REASON_IDLE, REASON_DEMAND, REASON_GOVERNOR, REASON_RECLAIM, REASON_SHUTDOWN, REASON_FORECAST, REASON_SLACK };
+
+FILE *traceFile = NULL; 
+TraceRecord_t traceBuffer[TRACE_BUFFER]; 
+unsigned traceCount = 0; 
+Time_t currentTime = 0;     // time of the callback being handled
+
+void openTrace();
+void closeTrace();
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg);
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason);
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason);
+/* SHARED END trace */
+
+/* SHARED BEGIN catalog */
+/* Machine catalog: static attributes cached once in Init so the hot paths never copy
+   MachineInfo_t. Only s_state and p_state change at runtime; s_state is refreshed from
+   StateChangeComplete and p_state is recorded by setMachinePerformance */
+#define NUM_P_STATES 4
+#define NUM_S_STATES 7
+vector<CPUType_t> catalogCpu;
+vector<unsigned> catalogNumCpus;
+vector<unsigned> catalogMemory;
+vector<bool> catalogGpus;
+vector<unsigned> catalogPerformance;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogPStatePower;    // NUM_P_STATES entries per machine
+vector<unsigned> catalogSStatePower;    // NUM_S_STATES entries per machine, 0 when not reported
+vector<MachineState_t> catalogSState;
+vector<CPUPerformance_t> catalogPState;
+
+void buildCatalog();
+unsigned machinePerformance(MachineId_t mid, unsigned p_state);
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state);
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state);
+/* SHARED END catalog */
+
+/* SHARED BEGIN demand */
+/* MIPS demand model. A task has to retire total_instructions between its arrival and its target
+   completion, so it needs total / (target - arrival) MIPS on average; demandMargin pads that for
+   time lost to sharing a core or to a migration. Every MIPS charge and load figure counts tasks by
+   this demand. A task without a window is charged the flat 1000 MIPS the accounting used before */
+double demandMargin = 1.25; 
+
+unsigned taskMips(const TaskInfo_t &info);
+/* SHARED END demand */
+
+/* SHARED BEGIN gpu */
+/* GPU routing. A GPU-capable task runs gpuSpeedup times faster on a GPU host, so it tries the GPU
+   hosts of its type first. It is still charged its full demand there: it holds a core share for as
+   long as it runs, it just runs for less time. While GPU-capable work is at least gpuReserveShare
+   of a type's arrivals (an EWMA with weight gpuAlpha), tasks that cannot use a GPU take that
+   type's GPU hosts last, keeping them for the work that finishes faster there */
+double gpuSpeedup = 2.0; 
+double gpuAlpha = 0.05; 
+double gpuReserveShare = 0.1; 
+double gpuShare[4];             // GPU-capable share of each CPU type's arrivals
+
+void gpuArrival(const TaskInfo_t &info);
+bool gpuReserved(CPUType_t cpu);
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid);
+/* SHARED END gpu */
+
+/* SHARED BEGIN gpu-rank */
+/* Placement ranks for candidate scans. A GPU-capable task ranks hosts by efficiency times its
+   speedup, which puts a GPU host first unless a plain one is more efficient by more than the
+   speedup; other tasks rank by efficiency, with the GPU hosts after the plain ones while they are
+   reserved */
+vector<int32_t> gpuRank;        // placement score of each machine for GPU-capable tasks
+vector<int32_t> plainRank;      // and for other tasks while GPU hosts are held back
+
+void gpuInit();
+const int32_t *placementRank(const TaskInfo_t &info);
+/* SHARED END gpu-rank */
+
+/* SHARED BEGIN sla */
+/* SLA tiers. A task of class c only goes where its host stays under slaTarget[c] of its P0
+   capacity once the task is on it, and the headroom that leaves is held back from later tasks
+   for as long as the class has work there. SLA0 and SLA1 start with room in reserve and keep
+   their hosts at P0; SLA2 and SLA3 pack the most efficient hosts full, which can then stay slow.
+   The targets follow GetSLAReport: every slaAdaptInterval the share of each class's tasks that
+   missed since the last look is held against slaGoal, and the target steps toward more headroom
+   when over it and toward denser packing when well under it */
+double slaTarget[4] = {0.6, 0.75, 1.0, 1.0};   // highest host utilization a task of the class accepts
+double slaGoal[4] = {5, 10, 20, 100};           // % of the class's tasks allowed to miss
+double slaStep = 0.05; 
+double slaTargetFloor = 0.3; 
+unsigned slaMinSamples = 20;    // completions needed before a class's target moves
+Time_t slaAdaptInterval = 10000000; 
+Time_t slaLastAdapt = 0; 
+unsigned slaCompleted[4];       // completions seen by TaskComplete
+unsigned slaSeenCompleted[4];   // and the completions and misses at the last adaptation
+double slaSeenMissed[4]; 
+double slaCapacity[4];          // average P0 MIPS of a machine of each type
+vector<unsigned> slaHosted;     // tasks of each class on each machine, 4 entries per machine
+
+void slaInit();
+void slaHost(MachineId_t mid, SLAType_t sla, int count);
+bool slaPinned(MachineId_t mid);
+unsigned slaReserve(MachineId_t mid);
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips);
+bool slaAdapt(Time_t now);
+/* SHARED END sla */
+
+/* SHARED BEGIN rescue */
+/* Graduated SLA rescue. A task an SLAWarning reports as late is first raised to HIGH_PRIORITY
+   and the co-located tasks of less strict classes are lowered to LOW_PRIORITY, which moves the
+   host's cycles toward it at no cost in power. Every rescueWait the task's progress since the last
+   look is projected to its finish, and while that still misses the target the rescue goes one
+   step further: the host is brought up to P0, then the task's VM alone is migrated. A demoted task
+   gets its own priority back once every rescue that lowered it is over */
+enum { RESCUE_PRIORITY, RESCUE_BOOST, RESCUE_MIGRATE };
+typedef struct {
+    unsigned stage; 
+    Time_t since;               // time of the last look
+    uint64_t remaining;         // instructions left at the last look
+    vector<TaskId_t> demoted; 
+} Rescue_t;
+std::unordered_map<TaskId_t, Rescue_t> rescues; 
+std::unordered_map<TaskId_t, std::pair<unsigned, Priority_t>> demotions;   // rescues holding the task down, its own priority
+Time_t rescueWait = 500000; 
+
+void rescueStart(TaskId_t tid, Time_t now);
+void rescueCheck(Time_t now);
+void rescueFinish(TaskId_t tid);
+/* SHARED END rescue */
+bool rescueBoost(TaskId_t tid, MachineId_t mid, Time_t now);
+bool rescueMigrate(TaskId_t tid, MachineId_t mid, Time_t now);
+
+/* SHARED BEGIN kernel */
+/* Feasibility kernel over candidate machines laid out as parallel arrays indexed by MachineId_t.
+   eligible[i] holds the machine's CPU type + 1 while it can take work and 0 otherwise */
+#define ELIGIBLE(cpu) uint8_t((cpu) + 1)
+vector<uint8_t> eligible;
+
+int feasibleArgmin(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                   uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask);
+/* SHARED END kernel */
+
+/* Running load totals per CPU type (slots 0-3, indexed by CPUType_t) and for the whole cluster
+   (slot LOAD_CLUSTER). loadAccount keeps them current as work is added, removed or moved, so
+   every load query is O(1). MIPS capacity is counted at P0. The EWMA variants are advanced once
+   per SchedulerCheck by sampleLoad. The governor holds back slowing a machine down while its
+   type's MIPS load is above that average, that is while work is still arriving */
+#define LOAD_CLUSTER 4
+uint64_t loadTotalMemory[LOAD_CLUSTER + 1]; 
+uint64_t loadUsedMemory[LOAD_CLUSTER + 1]; 
+uint64_t loadTotalMips[LOAD_CLUSTER + 1]; 
+uint64_t loadUsedMips[LOAD_CLUSTER + 1]; 
+double loadMemoryEwma[LOAD_CLUSTER + 1]; 
+double loadMipsEwma[LOAD_CLUSTER + 1]; 
+double loadAlpha = 0.3;     // weight of the newest sample
+
+void loadAccount(MachineId_t mid, signed mips, signed memory);
+double memoryLoad(unsigned slot);
+double mipsLoad(unsigned slot);
+double smoothedMemoryLoad(unsigned slot);
+double smoothedMipsLoad(unsigned slot);
+bool loadRising(CPUType_t type);
+void sampleLoad();
 
 unsigned insertSortedEE(vector<MachineId_t>* mList, MachineId_t id);
-bool hasEnoughResource(MachineId_t mid, TaskId_t tid); 
-double getCurrentLoad(vector<MachineId_t> machines);
+void trackVM(VMId_t vid);
+void refreshHeadroom(MachineId_t mid);
+void markGovernorDirty(MachineId_t mid);
+CPUPerformance_t governorTarget(MachineId_t mid, Time_t now);
+bool governMachine(MachineId_t mid, Time_t now);
+void migrateTask(TaskId_t tid, MachineId_t from, MachineId_t to, Time_t now);
 
 /* We need to make sure we separate machines by VM type and hardware type
    to assign tasks to their requirements*/
 
 void Scheduler::Init() {
-    SimOutput("Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()), 3);
-    SimOutput("Scheduler::Init(): Initializing scheduler", 1);
+    SCHED_LOG(3, "Scheduler::Init(): Total number of machines is " + to_string(Machine_GetTotal()));
+    SCHED_LOG(1, "Scheduler::Init(): Initializing scheduler");
+    buildCatalog(); 
+    slaInit(); 
+    gpuInit(); 
+    warmVMs.resize(Machine_GetTotal() * NUM_VM_TYPES); 
+    mipsCost.assign(Machine_GetTotal(), 0); 
+    memoryCost.assign(Machine_GetTotal(), 0); 
+    headroomMips.resize(Machine_GetTotal()); 
+    headroomMemory.resize(Machine_GetTotal()); 
+    tierMips.resize(Machine_GetTotal()); 
+    eeRank.resize(Machine_GetTotal()); 
+    eligible.assign(Machine_GetTotal(), 0); 
+    machinePerf.assign(Machine_GetTotal(), P3); 
+    perfSince.assign(Machine_GetTotal(), 0); 
+    boostUntil.assign(Machine_GetTotal(), 0); 
+    inGovernorDirty.assign(Machine_GetTotal(), false); 
 
     //First organize all of the machines we have available
     for (unsigned i = 0; i < Machine_GetTotal(); i++) {
         allMachines.push_back(MachineId_t(i));
-        switch (Machine_GetCPUType(MachineId_t(i))) {
+        switch (catalogCpu[MachineId_t(i)]) {
             case X86:
                 insertSortedEE(&x86Machines, MachineId_t(i)); 
                 break; 
@@ -60,18 +375,30 @@ void Scheduler::Init() {
                 insertSortedEE(&riscvMachines, MachineId_t(i)); 
                 break; 
         }
-        //Compute effective performance of each machine and turn all machines on initially
-        mipsCost[MachineId_t(i)] = 0; 
-        memoryCost[MachineId_t(i)] = 0;
-        Machine_SetState(MachineId_t(i), S0); 
-        for(int j = 0; j < Machine_GetInfo(MachineId_t(i)).num_cpus; j++) {
-            Machine_SetCorePerformance(MachineId_t(i), j, currentPerf); 
+        //Turn all machines on initially
+        setMachineState(MachineId_t(i), S0, REASON_INIT); 
+        setMachinePerformance(MachineId_t(i), machinePerf[i], REASON_INIT); 
+        refreshHeadroom(MachineId_t(i)); 
+        eligible[i] = (catalogSState[i] == S0) ? ELIGIBLE(catalogCpu[i]) : 0; 
+        unsigned slots[] = {unsigned(catalogCpu[i]), LOAD_CLUSTER}; 
+        for(unsigned slot: slots) {
+            loadTotalMemory[slot] += catalogMemory[i]; 
+            loadTotalMips[slot] += machinePerformance(MachineId_t(i), 0) * catalogNumCpus[i]; 
+        }
+    }
+
+    /* Lists are in their final order, so every machine's rank is fixed from here on */
+    vector<MachineId_t> *lists[] = {&x86Machines, &armMachines, &powerMachines, &riscvMachines}; 
+    for(vector<MachineId_t> *list: lists) {
+        for(unsigned i = 0; i < (*list).size(); i++) {
+            eeRank[(*list).at(i)] = i; 
         }
     }
 }
 
 void Scheduler::MigrationComplete(Time_t time, VMId_t vm_id) {
     // Update your data structure. The VM now can receive new tasks
+    isMigrating[vm_id] = false;
 }
 
 void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
@@ -79,52 +406,61 @@ void Scheduler::NewTask(Time_t now, TaskId_t task_id) {
     CPUType_t cpu = t_info.required_cpu; 
     VMType_t os = t_info.required_vm; 
 
-    /* Figure out which list of machines to use */
-    vector<MachineId_t> machine_list;
-    switch (cpu) {
-        case X86:
-            machine_list = x86Machines;
-            break; 
-        case ARM:
-            machine_list = armMachines; 
-            break;
-        case POWER:
-            machine_list = powerMachines; 
-            break;
-        default:
-            machine_list = riscvMachines; 
-            break;
-    }
-
-    //Choose which machine we are going to use; try to assign to the most energy efficient machine
-    MachineId_t chosen = -1; 
-    for (int i = 0; i < machine_list.size(); i++) {
-        
-        MachineInfo_t curr_info = Machine_GetInfo(machine_list.at(i));
-        if((curr_info.s_state == S0) && hasEnoughResource(machine_list.at(i), task_id)) {
-            chosen = machine_list.at(i);
-            break;
-        }
+    //Choose which machine we are going to use; try to assign to the most energy efficient machine that leaves
+    //the headroom the task's SLA class asks for, or failing that any machine with room. GPU-capable tasks look at
+    //GPU hosts first and, while they need them, everyone else looks there last
+    SLAType_t sla = t_info.required_sla; 
+    unsigned mips = taskMips(t_info); 
+    gpuArrival(t_info); 
+    const int32_t *rank = placementRank(t_info); 
+    MachineId_t chosen = feasibleArgmin(tierMips.data(), headroomMemory.data(), rank, eligible.data(), 
+                                        ELIGIBLE(cpu), allMachines.size(), slaNeed(sla, cpu, mips), t_info.required_memory, NULL); 
+    if (chosen == -1) {
+        chosen = feasibleArgmin(headroomMips.data(), headroomMemory.data(), rank, eligible.data(), 
+                                ELIGIBLE(cpu), allMachines.size(), mips, t_info.required_memory, NULL); 
     }
 
     //Check that we actually found a machine that can service the task
+    uint8_t reason = REASON_PLACE;
     if (chosen == -1) {
+        reason = REASON_FALLBACK;
+        /* Figure out which list of machines to use */
+        vector<MachineId_t> *machine_list;
+        switch (cpu) {
+            case X86:
+                machine_list = &x86Machines;
+                break; 
+            case ARM:
+                machine_list = &armMachines; 
+                break;
+            case POWER:
+                machine_list = &powerMachines; 
+                break;
+            default:
+                machine_list = &riscvMachines; 
+                break;
+        }
+
         //If we didn't, just use a random one to disperse load
-        unsigned random = rand() % machine_list.size();
-        chosen = machine_list.at(random);
+        unsigned random = rand() % (*machine_list).size();
+        chosen = (*machine_list).at(random);
     }
 
     /* Put the task on the machine */
     if(vmMap.find(chosen) == vmMap.end()) {
         vmMap[chosen] = {}; 
     }
-    VMId_t v_id = VM_Create(os, cpu); 
-    isMigrating[v_id] = false;
+    VMId_t v_id = acquireVM(chosen, os, cpu); 
     vmMap[chosen].push_back(v_id); 
-    VM_Attach(v_id, chosen); 
+    taskToVM[task_id] = v_id; 
     VM_AddTask(v_id, task_id, t_info.priority); 
-    mipsCost[chosen] += 1000; 
+    traceDecision(TRACE_PLACE, reason, chosen, v_id, task_id, os); 
+    mipsCost[chosen] += mips; 
     memoryCost[chosen] += t_info.required_memory;
+    loadAccount(chosen, mips, t_info.required_memory); 
+    slaHost(chosen, sla, 1); 
+    refreshHeadroom(chosen); 
+    markGovernorDirty(chosen); 
     taskMap.emplace(task_id, chosen);
 }
 
@@ -134,50 +470,22 @@ void Scheduler::PeriodicCheck(Time_t now) {
     // Unlike the other invocations of the scheduler, this one doesn't report any specific event
     // Recommendation: Take advantage of this function to do some monitoring and adjustments as necessary
 
-    //Dynamically adjust current operating performance level based on overall average load of the machines
-    // std::cout << getCurrentLoad(allMachines) << std::endl;
-    if ((getCurrentLoad(allMachines) > 0.8 || SLA_warning)) {
-        if (currentPerf == P0) {
-            return;
-        }
-        currentPerf = P0;
+    reclaimIdleVMs(now);
+    sampleLoad();
+    rescueCheck(now);
+    if (slaAdapt(now)) {
         for (MachineId_t machine : allMachines) {
-            for(int j = 0; j < Machine_GetInfo(machine).num_cpus; j++) {
-                Machine_SetCorePerformance(machine, j, currentPerf); 
-            }
-        }
-    }
-    else if (getCurrentLoad(allMachines) > 0.6) {
-        if (currentPerf == P1) {
-            return;
-        }
-        currentPerf = P1;
-        for (MachineId_t machine : allMachines) {
-            for(int j = 0; j < Machine_GetInfo(machine).num_cpus; j++) {
-                Machine_SetCorePerformance(machine, j, currentPerf); 
-            }
-        }
-    }
-    else if (getCurrentLoad(allMachines) > 0.4) {
-        if (currentPerf == P2) {
-            return;
-        }
-        currentPerf = P2;
-        for (MachineId_t machine : allMachines) {
-            for(int j = 0; j < Machine_GetInfo(machine).num_cpus; j++) {
-                Machine_SetCorePerformance(machine, j, currentPerf); 
-            }
+            refreshHeadroom(machine); 
         }
     }
-    else {
-        if (currentPerf == P3) {
-            return;
-        }
-        currentPerf = P3;
-        for (MachineId_t machine : allMachines) {
-            for(int j = 0; j < Machine_GetInfo(machine).num_cpus; j++) {
-                Machine_SetCorePerformance(machine, j, currentPerf); 
-            }
+
+    //Let the governor re-evaluate the machines whose demand changed since the last check
+    vector<MachineId_t> pending; 
+    pending.swap(governorDirty); 
+    for (MachineId_t machine : pending) {
+        inGovernorDirty[machine] = false; 
+        if (!governMachine(machine, now)) {
+            markGovernorDirty(machine); 
         }
     }
 }
@@ -190,17 +498,33 @@ void Scheduler::Shutdown(Time_t time) {
     for(auto & vm: vms) {
         VM_Shutdown(vm);
     }
-    SimOutput("SimulationComplete(): Finished!", 4);
-    SimOutput("SimulationComplete(): Time is " + to_string(time), 4);
+    shutdownVMs();
+    SCHED_LOG(4, "SimulationComplete(): Finished!");
+    SCHED_LOG(4, "SimulationComplete(): Time is " + to_string(time));
 }
 
 void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
     // Do any bookkeeping necessary for the data structures
     // Decide if a machine is to be turned off, slowed down, or VMs to be migrated according to your policy
     // This is an opportunity to make any adjustments to optimize performance/energy
-    SimOutput("Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now), 4);
-    mipsCost[taskMap[task_id]] -= 1000;
-    memoryCost[taskMap[task_id]] -= GetTaskInfo(task_id).required_memory;
+    SCHED_LOG(4, "Scheduler::TaskComplete(): Task " + to_string(task_id) + " is complete at " + to_string(now));
+    TaskInfo_t t_info = GetTaskInfo(task_id);
+    unsigned memory = t_info.required_memory;
+    mipsCost[taskMap[task_id]] -= taskMips(t_info);
+    memoryCost[taskMap[task_id]] -= memory;
+    loadAccount(taskMap[task_id], -signed(taskMips(t_info)), -signed(memory)); 
+    slaHost(taskMap[task_id], t_info.required_sla, -1); 
+    slaCompleted[t_info.required_sla]++; 
+    refreshHeadroom(taskMap[task_id]); 
+    markGovernorDirty(taskMap[task_id]); 
+    rescueFinish(task_id); 
+
+    //Hand the task's VM back to the warm pool of its machine
+    VMId_t done = taskToVM[task_id];
+    vector<VMId_t> &machine_vms = vmMap[vmHost[done]];
+    machine_vms.erase(std::remove(machine_vms.begin(), machine_vms.end(), done), machine_vms.end());
+    releaseVM(done, now);
+    taskToVM.erase(task_id);
 }
 
 // Public interface below
@@ -208,38 +532,51 @@ void Scheduler::TaskComplete(Time_t now, TaskId_t task_id) {
 static Scheduler Scheduler;
 
 void InitScheduler() {
-    SimOutput("InitScheduler(): Initializing scheduler", 4);
+    CallbackTimer timer(CB_INIT); 
+    openTrace(); 
+    SCHED_LOG(4, "InitScheduler(): Initializing scheduler");
     Scheduler.Init();
 }
 
 void HandleNewTask(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time), 4);
+    CallbackTimer timer(CB_NEW_TASK); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleNewTask(): Received new task " + to_string(task_id) + " at time " + to_string(time));
     Scheduler.NewTask(time, task_id);
 }
 
 void HandleTaskCompletion(Time_t time, TaskId_t task_id) {
-    SimOutput("HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time), 4);
+    CallbackTimer timer(CB_TASK_COMPLETE); 
+    currentTime = time; 
+    SCHED_LOG(4, "HandleTaskCompletion(): Task " + to_string(task_id) + " completed at time " + to_string(time));
     Scheduler.TaskComplete(time, task_id);
 }
 
 void MemoryWarning(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_MEMORY_WARNING); 
+    currentTime = time; 
     // The simulator is alerting you that machine identified by machine_id is overcommitted
-    SimOutput("MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time), 4);
+    SCHED_LOG(4, "MemoryWarning(): Overflow at " + to_string(machine_id) + " was detected at time " + to_string(time));
 }
 
 void MigrationDone(Time_t time, VMId_t vm_id) {
+    CallbackTimer timer(CB_MIGRATION_DONE); 
+    currentTime = time; 
     // The function is called on to alert you that migration is complete
-    SimOutput("MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time), 4);
+    SCHED_LOG(4, "MigrationDone(): Migration of VM " + to_string(vm_id) + " was completed at time " + to_string(time));
     Scheduler.MigrationComplete(time, vm_id);
 }
 
 void SchedulerCheck(Time_t time) {
+    CallbackTimer timer(CB_SCHEDULER_CHECK); 
+    currentTime = time; 
     // This function is called periodically by the simulator, no specific event
-    SimOutput("SchedulerCheck(): SchedulerCheck() called at " + to_string(time), 4);
+    SCHED_LOG(4, "SchedulerCheck(): SchedulerCheck() called at " + to_string(time));
     Scheduler.PeriodicCheck(time);
 }
 
 void SimulationComplete(Time_t time) {
+    currentTime = time; 
     // This function is called before the simulation terminates Add whatever you feel like.
     cout << "SLA violation report" << endl;
     cout << "SLA0: " << GetSLAReport(SLA0) << "%" << endl;
@@ -247,17 +584,26 @@ void SimulationComplete(Time_t time) {
     cout << "SLA2: " << GetSLAReport(SLA2) << "%" << endl;     // SLA3 do not have SLA violation issues
     cout << "Total Energy " << Machine_GetClusterEnergy() << "KW-Hour" << endl;
     cout << "Simulation run finished in " << double(time)/1000000 << " seconds" << endl;
-    SimOutput("SimulationComplete(): Simulation finished at time " + to_string(time), 4);
+    reportLatency();
+    SCHED_LOG(4, "SimulationComplete(): Simulation finished at time " + to_string(time));
     
     Scheduler.Shutdown(time);
+    closeTrace();
 }
 
 void SLAWarning(Time_t time, TaskId_t task_id) {
-    SLA_warning = true;
+    CallbackTimer timer(CB_SLA_WARNING); 
+    currentTime = time; 
+    //Rescue the late task step by step rather than boosting its whole host at once
+    rescueStart(task_id, time);
 }
 
 void StateChangeComplete(Time_t time, MachineId_t machine_id) {
+    CallbackTimer timer(CB_STATE_CHANGE); 
+    currentTime = time; 
     // Called in response to an earlier request to change the state of a machine
+    catalogSState[machine_id] = Machine_GetInfo(machine_id).s_state; 
+    eligible[machine_id] = (catalogSState[machine_id] == S0) ? ELIGIBLE(catalogCpu[machine_id]) : 0; 
 }
 
 
@@ -271,12 +617,10 @@ unsigned insertSortedEE(vector<MachineId_t>* mList, MachineId_t id) {
         return 0; 
     }
 
-    MachineInfo_t newInfo = Machine_GetInfo (id); 
-    double new_ee = newInfo.performance.at(0) / newInfo.p_states.at(0); 
+    double new_ee = machinePerformance(id, 0) / machinePStatePower(id, 0); 
 
     for (unsigned i = 0; i < (*mList).size(); i++) {
-        MachineInfo_t info = Machine_GetInfo((*mList).at(i));
-        double ee = info.performance.at(0) / info.p_states.at(0); 
+        double ee = machinePerformance((*mList).at(i), 0) / machinePStatePower((*mList).at(i), 0); 
         if (new_ee > ee) {
             (*mList).insert((*mList).begin() + i, id); 
             return i; 
@@ -287,32 +631,767 @@ unsigned insertSortedEE(vector<MachineId_t>* mList, MachineId_t id) {
     return (*mList).size() - 1; 
 }
 
-bool hasEnoughResource(MachineId_t mid, TaskId_t tid) {
-    MachineInfo_t minfo = Machine_GetInfo(mid); 
-    TaskInfo_t tinfo = GetTaskInfo(tid); 
+/* Add (or with negative amounts remove) work on a machine to its CPU type's totals and the cluster's */
+void loadAccount(MachineId_t mid, signed mips, signed memory) {
+    unsigned slots[] = {unsigned(catalogCpu[mid]), LOAD_CLUSTER}; 
+    for(unsigned slot: slots) {
+        loadUsedMips[slot] += mips; 
+        loadUsedMemory[slot] += memory; 
+    }
+}
+
+double memoryLoad(unsigned slot) {
+    return (loadTotalMemory[slot] == 0) ? 0.0 : double(loadUsedMemory[slot]) / loadTotalMemory[slot]; 
+}
+
+double mipsLoad(unsigned slot) {
+    return (loadTotalMips[slot] == 0) ? 0.0 : double(loadUsedMips[slot]) / loadTotalMips[slot]; 
+}
+
+double smoothedMemoryLoad(unsigned slot) {
+    return loadMemoryEwma[slot]; 
+}
 
-    unsigned mipsRequired = 1000; 
-    if(minfo.performance[currentPerf] * minfo.num_cpus - mipsCost.at(mid) < mipsRequired) {
+double smoothedMipsLoad(unsigned slot) {
+    return loadMipsEwma[slot]; 
+}
+
+bool loadRising(CPUType_t type) {
+    return mipsLoad(type) > smoothedMipsLoad(type); 
+}
+
+void sampleLoad() {
+    for(unsigned slot = 0; slot <= LOAD_CLUSTER; slot++) {
+        loadMemoryEwma[slot] = loadAlpha * memoryLoad(slot) + (1 - loadAlpha) * loadMemoryEwma[slot]; 
+        loadMipsEwma[slot] = loadAlpha * mipsLoad(slot) + (1 - loadAlpha) * loadMipsEwma[slot]; 
+    }
+}
+
+/* Hand out the most recently idled VM of this type on the machine, or create and attach one */
+VMId_t acquireVM(MachineId_t mid, VMType_t type, CPUType_t cpu) {
+    vector<VMId_t> &pool = warmVMs[mid * NUM_VM_TYPES + type]; 
+    for(int i = int(pool.size()) - 1; i >= 0; i--) {
+        VMId_t vid = pool[i]; 
+        if(isMigrating[vid]) {
+            continue; 
+        }
+        pool.erase(pool.begin() + i); 
+        vmIdle[vid] = false; 
+        return vid; 
+    }
+    VMId_t vid = VM_Create(type, cpu); 
+    trackVM(vid); 
+    vmHost[vid] = mid; 
+    vmType[vid] = type; 
+    vmLive[vid] = true; 
+    VM_Attach(vid, mid); 
+    traceDecision(TRACE_VM_ATTACH, REASON_PLACE, mid, vid, TRACE_NONE, type); 
+    return vid; 
+}
+
+void releaseVM(VMId_t vid, Time_t now) {
+    vmIdle[vid] = true; 
+    vmIdleSince[vid] = now; 
+    warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]].push_back(vid); 
+    idleVMs.push_back(std::make_pair(now, vid)); 
+}
+
+/* Entries for VMs that were handed out again since they were queued are skipped */
+void reclaimIdleVMs(Time_t now) {
+    while(!idleVMs.empty() && idleVMs.front().first + vmIdleLimit <= now) {
+        Time_t since = idleVMs.front().first; 
+        VMId_t vid = idleVMs.front().second; 
+        idleVMs.pop_front(); 
+        if(!vmIdle[vid] || vmIdleSince[vid] != since) {
+            continue; 
+        }
+        if(isMigrating[vid]) {
+            /* Look again once the migration has landed */
+            vmIdleSince[vid] = now; 
+            idleVMs.push_back(std::make_pair(now, vid)); 
+            continue; 
+        }
+        vector<VMId_t> &pool = warmVMs[vmHost[vid] * NUM_VM_TYPES + vmType[vid]]; 
+        pool.erase(std::remove(pool.begin(), pool.end(), vid), pool.end()); 
+        vmIdle[vid] = false; 
+        vmLive[vid] = false; 
+        VM_Shutdown(vid); 
+        traceDecision(TRACE_VM_SHUTDOWN, REASON_RECLAIM, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+    }
+}
+
+void shutdownVMs() {
+    for(unsigned vid = 0; vid < vmLive.size(); vid++) {
+        if(vmLive[vid]) {
+            VM_Shutdown(vid); 
+            vmLive[vid] = false; 
+            traceDecision(TRACE_VM_SHUTDOWN, REASON_SHUTDOWN, vmHost[vid], vid, TRACE_NONE, vmType[vid]); 
+        }
+    }
+}
+
+/* Make room for a freshly created VM in the per-VM flags */
+void trackVM(VMId_t vid) {
+    if(vid >= isMigrating.size()) {
+        isMigrating.resize(vid + 1, false); 
+        vmHost.resize(vid + 1); 
+        vmType.resize(vid + 1); 
+        vmIdleSince.resize(vid + 1, 0); 
+        vmIdle.resize(vid + 1, false); 
+        vmLive.resize(vid + 1, false); 
+    }
+    isMigrating[vid] = false; 
+}
+
+/* Recompute what a machine can still take. MIPS are counted at P0: the governor speeds the
+   machine up once the work is there */
+void refreshHeadroom(MachineId_t mid) {
+    headroomMips[mid] = machinePerformance(mid, P0) * catalogNumCpus[mid] - mipsCost[mid]; 
+    headroomMemory[mid] = (catalogMemory[mid] > memoryCost[mid]) ? catalogMemory[mid] - memoryCost[mid] : 0; 
+    tierMips[mid] = headroomMips[mid] - signed(slaReserve(mid)); 
+}
+
+void markGovernorDirty(MachineId_t mid) {
+    if (!inGovernorDirty[mid]) {
+        inGovernorDirty[mid] = true; 
+        governorDirty.push_back(mid); 
+    }
+}
+
+/* The P-state the machine should move to now, which is its current one while a slow down is held back */
+CPUPerformance_t governorTarget(MachineId_t mid, Time_t now) {
+    double demand = mipsCost[mid]; 
+    if (now < boostUntil[mid] || slaPinned(mid)) {
+        return P0; 
+    }
+    int target = P0; 
+    for (int p = P3; p >= P0; p--) {
+        if (demand <= governorUp * machinePerformance(mid, p) * catalogNumCpus[mid]) {
+            target = p; 
+            break; 
+        }
+    }
+    int current = machinePerf[mid]; 
+    if (target <= current) {
+        return CPUPerformance_t(target); 
+    }
+    if (now - perfSince[mid] < governorDwell || loadRising(catalogCpu[mid])) {
+        return CPUPerformance_t(current); 
+    }
+    for (int p = target; p > current; p--) {
+        if (demand <= governorDown * machinePerformance(mid, p) * catalogNumCpus[mid]) {
+            return CPUPerformance_t(p); 
+        }
+    }
+    return CPUPerformance_t(current); 
+}
+
+/* Apply the governor to one machine, touching its cores only when the P-state changes. Returns
+   false while a slower state is due but held back by the dwell time or a boost, so the machine
+   stays on the dirty list */
+bool governMachine(MachineId_t mid, Time_t now) {
+    CPUPerformance_t target = governorTarget(mid, now); 
+    if (target != machinePerf[mid]) {
+        setMachinePerformance(mid, target, (now < boostUntil[mid]) ? REASON_SLA_WARNING : REASON_GOVERNOR); 
+        machinePerf[mid] = target; 
+        perfSince[mid] = now; 
+    }
+    if (now < boostUntil[mid]) {
         return false; 
     }
+    //A pinned machine is re-evaluated when its SLA0/SLA1 work leaves, which marks it dirty
+    if (slaPinned(mid)) {
+        return true; 
+    }
+    for (int p = P3; p > target; p--) {
+        if (mipsCost[mid] <= governorDown * machinePerformance(mid, p) * catalogNumCpus[mid]) {
+            return false; 
+        }
+    }
+    return true; 
+}
 
-    if(minfo.memory_size - memoryCost.at(mid) - tinfo.required_memory < 0) {
+//Hold the late task's host at P0 for a dwell; false when the governor already runs it there
+bool rescueBoost(TaskId_t tid, MachineId_t mid, Time_t now) {
+    if (machinePerf[mid] == P0) {
         return false; 
     }
+    boostUntil[mid] = now + governorDwell; 
+    markGovernorDirty(mid); 
+    return true; 
+}
 
+//Move the late task's VM to the most efficient other machine that leaves its class the headroom it wants
+bool rescueMigrate(TaskId_t tid, MachineId_t mid, Time_t now) {
+    if (isMigrating[taskToVM[tid]]) {
+        return false; 
+    }
+    TaskInfo_t t_info = GetTaskInfo(tid); 
+    CPUType_t cpu = t_info.required_cpu; 
+    uint8_t saved = eligible[mid]; 
+    eligible[mid] = 0; 
+    MachineId_t target = feasibleArgmin(tierMips.data(), headroomMemory.data(), placementRank(t_info), eligible.data(), 
+                                        ELIGIBLE(cpu), allMachines.size(), slaNeed(t_info.required_sla, cpu, taskMips(t_info)), t_info.required_memory, NULL); 
+    eligible[mid] = saved; 
+    if (target == -1) {
+        return false; 
+    }
+    migrateTask(tid, mid, target, now); 
     return true; 
 }
 
-double getCurrentLoad(vector<MachineId_t> machines) {
-    signed totalMemory = 0;
-    signed usedMemory = 0;
-    for (unsigned i = 0; i < machines.size(); i++) {
-        MachineInfo_t info = Machine_GetInfo(machines.at(i));
-        totalMemory += info.memory_size;
-        usedMemory += memoryCost[machines.at(i)];
-    } 
-    double memoryLoad = (usedMemory * 1.0) / totalMemory;
+//Migrate a task's VM and carry its costs over; the target starts boosted since the task is behind
+void migrateTask(TaskId_t tid, MachineId_t from, MachineId_t to, Time_t now) {
+    VMId_t vid = taskToVM[tid]; 
+    TaskInfo_t t_info = GetTaskInfo(tid); 
+    VM_Migrate(vid, to); 
+    traceDecision(TRACE_MIGRATE, REASON_SLA_WARNING, to, vid, tid, from); 
+    isMigrating[vid] = true; 
+    signed mips = taskMips(t_info); 
+    mipsCost[from] -= mips; 
+    mipsCost[to] += mips; 
+    memoryCost[from] -= t_info.required_memory; 
+    memoryCost[to] += t_info.required_memory; 
+    loadAccount(from, -mips, -signed(t_info.required_memory)); 
+    loadAccount(to, mips, t_info.required_memory); 
+    slaHost(from, t_info.required_sla, -1); 
+    slaHost(to, t_info.required_sla, 1); 
+    refreshHeadroom(from); 
+    refreshHeadroom(to); 
+    boostUntil[to] = now + governorDwell; 
+    markGovernorDirty(from); 
+    markGovernorDirty(to); 
+    taskMap[tid] = to; 
+    vmMap[from].erase(std::remove(vmMap[from].begin(), vmMap[from].end(), vid), vmMap[from].end()); 
+    vmMap[to].push_back(vid); 
+    vmHost[vid] = to; 
+}
 
-    //Return overall load
-    return memoryLoad;
+/* SHARED BEGIN latency-impl */
+void histRecord(LatencyHist_t *hist, uint64_t ns) {
+    unsigned bucket = ns; 
+    if(ns >= (1u << HIST_SUB_BITS)) {
+        unsigned shift = 63 - __builtin_clzll(ns) - HIST_SUB_BITS; 
+        bucket = ((shift + 1) << HIST_SUB_BITS) + ((ns >> shift) & ((1u << HIST_SUB_BITS) - 1)); 
+    }
+    hist->buckets[bucket]++; 
+    hist->count++; 
+    hist->total += ns; 
+    if(ns > hist->max) {
+        hist->max = ns; 
+    }
+}
+
+/* Lower edge of the bucket holding the q-th fraction of the samples */
+uint64_t histPercentile(const LatencyHist_t *hist, double q) {
+    uint64_t rank = uint64_t(q * hist->count); 
+    uint64_t seen = 0; 
+    for(unsigned bucket = 0; bucket < HIST_BUCKETS; bucket++) {
+        seen += hist->buckets[bucket]; 
+        if(seen > rank) {
+            if(bucket < (1u << HIST_SUB_BITS)) {
+                return bucket; 
+            }
+            unsigned shift = (bucket >> HIST_SUB_BITS) - 1; 
+            return uint64_t((1u << HIST_SUB_BITS) + (bucket & ((1u << HIST_SUB_BITS) - 1))) << shift; 
+        }
+    }
+    return hist->max; 
+}
+
+void reportLatency() {
+    cout << "Scheduler overhead (ns)" << endl;
+    for(unsigned i = 0; i < CB_COUNT; i++) {
+        const LatencyHist_t *hist = &callbackLatency[i]; 
+        if(hist->count == 0) {
+            continue; 
+        }
+        cout << hist->name << ": calls " << hist->count << " total " << hist->total 
+             << " p50 " << histPercentile(hist, 0.5) << " p99 " << histPercentile(hist, 0.99) 
+             << " max " << hist->max << endl;
+    }
+}
+/* SHARED END latency-impl */
+
+/* SHARED BEGIN trace-impl */
+void openTrace() {
+    const char *path = getenv("SCHED_TRACE"); 
+    if(path == NULL || traceFile != NULL) {
+        return; 
+    }
+    traceFile = fopen(path, "wb"); 
+    if(traceFile == NULL) {
+        SCHED_LOG(0, string("Cannot open trace file ") + path); 
+        return; 
+    }
+    TraceHeader_t header; 
+    memset(&header, 0, sizeof(header)); 
+    memcpy(header.magic, "SCHTRACE", 8); 
+    header.version = TRACE_VERSION; 
+    header.recordSize = sizeof(TraceRecord_t); 
+    strncpy(header.algorithm, SCHED_NAME, sizeof(header.algorithm) - 1); 
+    fwrite(&header, sizeof(header), 1, traceFile); 
+}
+
+void closeTrace() {
+    if(traceFile == NULL) {
+        return; 
+    }
+    fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+    traceCount = 0; 
+    fclose(traceFile); 
+    traceFile = NULL; 
+}
+
+void traceDecision(uint8_t kind, uint8_t reason, MachineId_t mid, VMId_t vid, TaskId_t tid, unsigned arg) {
+    if(traceFile == NULL) {
+        return; 
+    }
+    TraceRecord_t &record = traceBuffer[traceCount++]; 
+    record.time = currentTime; 
+    record.machine = mid; 
+    record.vm = vid; 
+    record.task = tid; 
+    record.kind = kind; 
+    record.reason = reason; 
+    record.arg = arg; 
+    memset(record.reserved, 0, sizeof(record.reserved)); 
+    if(traceCount == TRACE_BUFFER) {
+        fwrite(traceBuffer, sizeof(TraceRecord_t), traceCount, traceFile); 
+        traceCount = 0; 
+    }
+}
+/* SHARED END trace-impl */
+
+void setMachineState(MachineId_t mid, MachineState_t state, uint8_t reason) {
+    Machine_SetState(mid, state); 
+    traceDecision(TRACE_SET_STATE, reason, mid, TRACE_NONE, TRACE_NONE, state); 
+}
+
+/* Every core of the machine to the same P-state */
+void setMachinePerformance(MachineId_t mid, CPUPerformance_t p_state, uint8_t reason) {
+    for(unsigned j = 0; j < catalogNumCpus[mid]; j++) {
+        Machine_SetCorePerformance(mid, j, p_state); 
+    }
+    traceDecision(TRACE_SET_PERF, reason, mid, TRACE_NONE, TRACE_NONE, p_state); 
+    catalogPState[mid] = p_state; 
+}
+
+/* SHARED BEGIN demand-impl */
+unsigned taskMips(const TaskInfo_t &info) {
+    if(info.target_completion <= info.arrival) {
+        return 1000; 
+    }
+    double mips = demandMargin * double(info.total_instructions) / double(info.target_completion - info.arrival); 
+    return std::max(1u, unsigned(std::ceil(mips))); 
+}
+/* SHARED END demand-impl */
+
+/* SHARED BEGIN gpu-impl */
+void gpuArrival(const TaskInfo_t &info) {
+    gpuShare[info.required_cpu] = gpuAlpha * (info.gpu_capable ? 1.0 : 0.0) + (1 - gpuAlpha) * gpuShare[info.required_cpu]; 
+}
+
+bool gpuReserved(CPUType_t cpu) {
+    return gpuShare[cpu] >= gpuReserveShare; 
+}
+
+/* Whether the machine is the kind of host the task should try first */
+bool gpuPreferred(const TaskInfo_t &info, MachineId_t mid) {
+    if(info.gpu_capable) {
+        return catalogGpus[mid]; 
+    }
+    return !(catalogGpus[mid] && gpuReserved(info.required_cpu)); 
+}
+/* SHARED END gpu-impl */
+
+/* SHARED BEGIN gpu-rank-impl */
+/* Ranks only order machines of one type against each other, so one order over all of them will do */
+void gpuInit() {
+    unsigned total = Machine_GetTotal(); 
+    vector<MachineId_t> order(total); 
+    vector<double> efficiency(total); 
+    for(unsigned i = 0; i < total; i++) {
+        order[i] = MachineId_t(i); 
+        efficiency[i] = double(machinePerformance(MachineId_t(i), 0)) / std::max(1u, machinePStatePower(MachineId_t(i), 0)); 
+    }
+    std::sort(order.begin(), order.end(), [&](MachineId_t a, MachineId_t b) {
+        double ea = efficiency[a] * (catalogGpus[a] ? gpuSpeedup : 1.0); 
+        double eb = efficiency[b] * (catalogGpus[b] ? gpuSpeedup : 1.0); 
+        return (ea != eb) ? ea > eb : a < b; 
+    });
+    gpuRank.resize(total); 
+    for(unsigned i = 0; i < total; i++) {
+        gpuRank[order[i]] = i; 
+    }
+    std::sort(order.begin(), order.end(), [&](MachineId_t a, MachineId_t b) {
+        if(catalogGpus[a] != catalogGpus[b]) {
+            return !catalogGpus[a]; 
+        }
+        return (efficiency[a] != efficiency[b]) ? efficiency[a] > efficiency[b] : a < b; 
+    });
+    plainRank.resize(total); 
+    for(unsigned i = 0; i < total; i++) {
+        plainRank[order[i]] = i; 
+    }
+}
+
+const int32_t *placementRank(const TaskInfo_t &info) {
+    if(info.gpu_capable) {
+        return gpuRank.data(); 
+    }
+    return gpuReserved(info.required_cpu) ? plainRank.data() : eeRank.data(); 
+}
+/* SHARED END gpu-rank-impl */
+
+/* SHARED BEGIN sla-impl */
+void slaInit() {
+    unsigned machines[4] = {0, 0, 0, 0}; 
+    for(int c = 0; c < 4; c++) {
+        slaCompleted[c] = 0; 
+        slaSeenCompleted[c] = 0; 
+        slaSeenMissed[c] = 0; 
+        slaCapacity[c] = 0; 
+    }
+    for(unsigned i = 0; i < Machine_GetTotal(); i++) {
+        machines[catalogCpu[i]]++; 
+        slaCapacity[catalogCpu[i]] += machinePerformance(MachineId_t(i), 0) * catalogNumCpus[i]; 
+    }
+    for(int c = 0; c < 4; c++) {
+        if(machines[c] > 0) {
+            slaCapacity[c] /= machines[c]; 
+        }
+    }
+    slaHosted.assign(Machine_GetTotal() * 4, 0); 
+}
+
+/* Count a task of the class onto (count 1) or off (count -1) a machine */
+void slaHost(MachineId_t mid, SLAType_t sla, int count) {
+    slaHosted[mid * 4 + sla] += count; 
+}
+
+/* Machines with SLA0 or SLA1 work stay at P0 */
+bool slaPinned(MachineId_t mid) {
+    return slaHosted[mid * 4 + SLA0] > 0 || slaHosted[mid * 4 + SLA1] > 0; 
+}
+
+/* MIPS held back on a machine for the tightest class it hosts */
+unsigned slaReserve(MachineId_t mid) {
+    double target = 1.0; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        if(slaHosted[mid * 4 + c] > 0) {
+            target = std::min(target, slaTarget[c]); 
+        }
+    }
+    return unsigned((1 - target) * machinePerformance(mid, 0) * catalogNumCpus[mid]); 
+}
+
+/* MIPS a new task of the class needs free on a machine of the type: its own demand and its headroom */
+unsigned slaNeed(SLAType_t sla, CPUType_t cpu, unsigned mips) {
+    return mips + unsigned((1 - slaTarget[sla]) * slaCapacity[cpu]); 
+}
+
+/* Move the targets of the classes whose recent miss rate is off their goal; true if any moved */
+bool slaAdapt(Time_t now) {
+    if(now - slaLastAdapt < slaAdaptInterval) {
+        return false; 
+    }
+    slaLastAdapt = now; 
+    bool changed = false; 
+    for(int c = SLA0; c <= SLA3; c++) {
+        unsigned window = slaCompleted[c] - slaSeenCompleted[c]; 
+        if(window < slaMinSamples) {
+            continue; 
+        }
+        double missed = GetSLAReport(SLAType_t(c)) * slaCompleted[c] / 100; 
+        double rate = 100 * (missed - slaSeenMissed[c]) / window; 
+        slaSeenCompleted[c] = slaCompleted[c]; 
+        slaSeenMissed[c] = missed; 
+        double target = slaTarget[c]; 
+        if(rate > slaGoal[c]) {
+            target = std::max(slaTargetFloor, target - slaStep); 
+        } else if(rate < slaGoal[c] / 2) {
+            target = std::min(1.0, target + slaStep); 
+        }
+        if(target != slaTarget[c]) {
+            SCHED_LOG(2, "SLA" + to_string(c) + " missed " + to_string(rate) + "%, utilization target now " + to_string(target)); 
+            slaTarget[c] = target; 
+            changed = true; 
+        }
+    }
+    return changed; 
+}
+/* SHARED END sla-impl */
+
+/* SHARED BEGIN rescue-impl */
+/* First step of a rescue; a task already being rescued is left to rescueCheck */
+void rescueStart(TaskId_t tid, Time_t now) {
+    auto host = taskMap.find(tid); 
+    if(host == taskMap.end() || rescues.count(tid) != 0) {
+        return; 
+    }
+    TaskInfo_t info = GetTaskInfo(tid); 
+    Rescue_t &rescue = rescues[tid]; 
+    rescue.stage = RESCUE_PRIORITY; 
+    rescue.since = now; 
+    rescue.remaining = info.remaining_instructions; 
+    SetTaskPriority(tid, HIGH_PRIORITY); 
+    for(VMId_t vid: vmMap[host->second]) {
+        for(TaskId_t other: VM_GetInfo(vid).active_tasks) {
+            if(other == tid || RequiredSLA(other) <= info.required_sla || rescues.count(other) != 0) {
+                continue; 
+            }
+            auto held = demotions.find(other); 
+            if(held == demotions.end()) {
+                demotions[other] = std::make_pair(1u, Priority_t(GetTaskPriority(other))); 
+                SetTaskPriority(other, LOW_PRIORITY); 
+            } else {
+                held->second.first++; 
+            }
+            rescue.demoted.push_back(other); 
+        }
+    }
+    SCHED_LOG(2, "Rescuing task " + to_string(tid) + " on machine " + to_string(host->second) + ", " 
+                 + to_string(rescue.demoted.size()) + " co-located tasks lowered"); 
+}
+
+/* Take the next step for every rescue whose last one has not caught the task up */
+void rescueCheck(Time_t now) {
+    for(auto & entry: rescues) {
+        Rescue_t &rescue = entry.second; 
+        if(rescue.stage == RESCUE_MIGRATE || now < rescue.since + rescueWait) {
+            continue; 
+        }
+        TaskInfo_t info = GetTaskInfo(entry.first); 
+        double rate = double(rescue.remaining - info.remaining_instructions) / double(now - rescue.since); 
+        bool late = rate <= 0 || now + info.remaining_instructions / rate > info.target_completion; 
+        rescue.since = now; 
+        rescue.remaining = info.remaining_instructions; 
+        if(!late) {
+            continue; 
+        }
+        MachineId_t mid = taskMap[entry.first]; 
+        if(rescue.stage == RESCUE_PRIORITY) {
+            rescue.stage = RESCUE_BOOST; 
+            if(rescueBoost(entry.first, mid, now)) {
+                continue; 
+            }
+        }
+        /* Already at P0, or the boost was not enough: move the task, or try again next look */
+        if(rescueMigrate(entry.first, mid, now)) {
+            rescue.stage = RESCUE_MIGRATE; 
+        }
+    }
+}
+
+/* Called as a task completes: ends its rescue, and its demotion if it was lowered for another's */
+void rescueFinish(TaskId_t tid) {
+    demotions.erase(tid); 
+    auto it = rescues.find(tid); 
+    if(it == rescues.end()) {
+        return; 
+    }
+    for(TaskId_t other: it->second.demoted) {
+        auto held = demotions.find(other); 
+        if(held == demotions.end() || --held->second.first > 0) {
+            continue; 
+        }
+        if(rescues.count(other) == 0) {
+            SetTaskPriority(other, held->second.second); 
+        }
+        demotions.erase(held); 
+    }
+    rescues.erase(it); 
+}
+/* SHARED END rescue-impl */
+
+/* SHARED BEGIN logging-impl */
+/* Runtime log level from SCHED_VERBOSE, SCHED_LOG_MAX when it is unset */
+int initLogLevel() {
+    const char *level = getenv("SCHED_VERBOSE"); 
+    return (level != NULL) ? atoi(level) : SCHED_LOG_MAX; 
+}
+/* SHARED END logging-impl */
+
+/* SHARED BEGIN catalog-impl */
+void buildCatalog() {
+    unsigned total = Machine_GetTotal(); 
+    catalogCpu.resize(total); 
+    catalogNumCpus.resize(total); 
+    catalogMemory.resize(total); 
+    catalogGpus.resize(total); 
+    catalogPerformance.assign(total * NUM_P_STATES, 0); 
+    catalogPStatePower.assign(total * NUM_P_STATES, 0); 
+    catalogSStatePower.assign(total * NUM_S_STATES, 0); 
+    catalogSState.resize(total); 
+    catalogPState.resize(total); 
+
+    for(unsigned i = 0; i < total; i++) {
+        MachineInfo_t info = Machine_GetInfo(MachineId_t(i)); 
+        catalogCpu[i] = info.cpu; 
+        catalogNumCpus[i] = info.num_cpus; 
+        catalogMemory[i] = info.memory_size; 
+        catalogGpus[i] = info.gpus; 
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.performance.size(); p++) {
+            catalogPerformance[i * NUM_P_STATES + p] = info.performance[p]; 
+        }
+        for(unsigned p = 0; p < NUM_P_STATES && p < info.p_states.size(); p++) {
+            catalogPStatePower[i * NUM_P_STATES + p] = info.p_states[p]; 
+        }
+        /* s_states is not always populated, missing entries stay at 0 */
+        for(unsigned s = 0; s < NUM_S_STATES && s < info.s_states.size(); s++) {
+            catalogSStatePower[i * NUM_S_STATES + s] = info.s_states[s]; 
+        }
+        catalogSState[i] = info.s_state; 
+        catalogPState[i] = info.p_state; 
+    }
+}
+
+unsigned machinePerformance(MachineId_t mid, unsigned p_state) {
+    return catalogPerformance[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machinePStatePower(MachineId_t mid, unsigned p_state) {
+    return catalogPStatePower[mid * NUM_P_STATES + p_state]; 
+}
+
+unsigned machineSStatePower(MachineId_t mid, unsigned s_state) {
+    return catalogSStatePower[mid * NUM_S_STATES + s_state]; 
+}
+/* SHARED END catalog-impl */
+
+/* SHARED BEGIN kernel-impl */
+/* Scalar check of candidates i..n-1, folded into the best found so far */
+int feasibleTail(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                 uint8_t want, unsigned i, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask,
+                 int best, int32_t bestScore) {
+    for(; i < n; i++) {
+        if(eligible[i] == want && mips[i] >= mipsNeeded && memory[i] >= memoryNeeded) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(1) << (i % 64); 
+            }
+            if(score[i] < bestScore || best == -1) {
+                bestScore = score[i]; 
+                best = i; 
+            }
+        }
+    }
+    return best; 
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+int feasibleAvx2(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                 uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    int32_t bestScore = INT32_MAX; 
+    int best = -1; 
+    unsigned i = 0; 
+    const __m256i needMips = _mm256_set1_epi32(mipsNeeded - 1); 
+    const __m256i needMemory = _mm256_set1_epi32(memoryNeeded); 
+    const __m256i wanted = _mm256_set1_epi32(want); 
+    const __m256i step = _mm256_set1_epi32(8); 
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); 
+    __m256i laneBest = _mm256_set1_epi32(INT32_MAX); 
+    __m256i laneIndex = _mm256_set1_epi32(-1); 
+    for(; i + 8 <= n; i += 8) {
+        __m256i m = _mm256_loadu_si256((const __m256i *)(mips + i)); 
+        __m256i mem = _mm256_loadu_si256((const __m256i *)(memory + i)); 
+        __m256i el = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(eligible + i))); 
+        __m256i ok = _mm256_cmpgt_epi32(m, needMips); 
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_max_epu32(mem, needMemory), mem)); 
+        ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(el, wanted)); 
+        unsigned bits = _mm256_movemask_ps(_mm256_castsi256_ps(ok)); 
+        if(bits != 0) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(bits) << (i % 64); 
+            }
+            __m256i s = _mm256_loadu_si256((const __m256i *)(score + i)); 
+            __m256i better = _mm256_and_si256(ok, _mm256_cmpgt_epi32(laneBest, s)); 
+            laneBest = _mm256_blendv_epi8(laneBest, s, better); 
+            laneIndex = _mm256_blendv_epi8(laneIndex, lane, better); 
+        }
+        lane = _mm256_add_epi32(lane, step); 
+    }
+    int32_t scores[8]; 
+    int32_t indices[8]; 
+    _mm256_storeu_si256((__m256i *)scores, laneBest); 
+    _mm256_storeu_si256((__m256i *)indices, laneIndex); 
+    for(int l = 0; l < 8; l++) {
+        if(indices[l] != -1 && (best == -1 || scores[l] < bestScore || (scores[l] == bestScore && indices[l] < best))) {
+            bestScore = scores[l]; 
+            best = indices[l]; 
+        }
+    }
+    return feasibleTail(mips, memory, score, eligible, want, i, n, mipsNeeded, memoryNeeded, mask, best, bestScore); 
+}
+
+__attribute__((target("sse4.1")))
+int feasibleSse41(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                  uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    int32_t bestScore = INT32_MAX; 
+    int best = -1; 
+    unsigned i = 0; 
+    const __m128i needMips = _mm_set1_epi32(mipsNeeded - 1); 
+    const __m128i needMemory = _mm_set1_epi32(memoryNeeded); 
+    const __m128i wanted = _mm_set1_epi32(want); 
+    const __m128i step = _mm_set1_epi32(4); 
+    __m128i lane = _mm_setr_epi32(0, 1, 2, 3); 
+    __m128i laneBest = _mm_set1_epi32(INT32_MAX); 
+    __m128i laneIndex = _mm_set1_epi32(-1); 
+    for(; i + 4 <= n; i += 4) {
+        int32_t packed; 
+        memcpy(&packed, eligible + i, sizeof(packed)); 
+        __m128i m = _mm_loadu_si128((const __m128i *)(mips + i)); 
+        __m128i mem = _mm_loadu_si128((const __m128i *)(memory + i)); 
+        __m128i el = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)); 
+        __m128i ok = _mm_cmpgt_epi32(m, needMips); 
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_max_epu32(mem, needMemory), mem)); 
+        ok = _mm_and_si128(ok, _mm_cmpeq_epi32(el, wanted)); 
+        unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(ok)); 
+        if(bits != 0) {
+            if(mask != NULL) {
+                (*mask)[i / 64] |= uint64_t(bits) << (i % 64); 
+            }
+            __m128i s = _mm_loadu_si128((const __m128i *)(score + i)); 
+            __m128i better = _mm_and_si128(ok, _mm_cmpgt_epi32(laneBest, s)); 
+            laneBest = _mm_blendv_epi8(laneBest, s, better); 
+            laneIndex = _mm_blendv_epi8(laneIndex, lane, better); 
+        }
+        lane = _mm_add_epi32(lane, step); 
+    }
+    int32_t scores[4]; 
+    int32_t indices[4]; 
+    _mm_storeu_si128((__m128i *)scores, laneBest); 
+    _mm_storeu_si128((__m128i *)indices, laneIndex); 
+    for(int l = 0; l < 4; l++) {
+        if(indices[l] != -1 && (best == -1 || scores[l] < bestScore || (scores[l] == bestScore && indices[l] < best))) {
+            bestScore = scores[l]; 
+            best = indices[l]; 
+        }
+    }
+    return feasibleTail(mips, memory, score, eligible, want, i, n, mipsNeeded, memoryNeeded, mask, best, bestScore); 
+}
+#endif
+
+/* Checks n candidates in one pass: a candidate is feasible when eligible[i] == want and it has
+   at least mipsNeeded MIPS and memoryNeeded memory left. Sets bit i of mask (if given) for every
+   feasible candidate and returns the feasible one with the lowest score (scores stay below
+   INT32_MAX), lowest index on ties, or -1. On x86 the widest version the CPU runs is picked once:
+   AVX2 handles 8 candidates per step, SSE4.1 handles 4, and the tail runs scalar */
+int feasibleArgmin(const int32_t *mips, const uint32_t *memory, const int32_t *score, const uint8_t *eligible,
+                   uint8_t want, unsigned n, int32_t mipsNeeded, uint32_t memoryNeeded, vector<uint64_t> *mask) {
+    if(mask != NULL) {
+        (*mask).assign((n + 63) / 64, 0); 
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    static const int level = __builtin_cpu_supports("avx2") ? 2 : (__builtin_cpu_supports("sse4.1") ? 1 : 0); 
+    if(level == 2) {
+        return feasibleAvx2(mips, memory, score, eligible, want, n, mipsNeeded, memoryNeeded, mask); 
+    }
+    if(level == 1) {
+        return feasibleSse41(mips, memory, score, eligible, want, n, mipsNeeded, memoryNeeded, mask); 
+    }
+#endif
+    return feasibleTail(mips, memory, score, eligible, want, 0, n, mipsNeeded, memoryNeeded, mask, -1, INT32_MAX); 
 }
+/* SHARED END kernel-impl */
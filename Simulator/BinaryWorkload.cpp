@@ -0,0 +1,269 @@
+//
+//  BinaryWorkload.cpp
+//  CloudSim
+//
+//  Columnar binary workloads for long replays. The file is a 64-byte header, the machine classes
+//  as fixed 96-byte records, then one column per task field, each holding every task in arrival
+//  order:
+//
+//      arrival u64 | instructions u64 | target completion u64 | memory u32 | cpu u8 | vm u8 | sla u8 | gpu u8
+//
+//  Every column starts on an 8-byte boundary because the header and class records are multiples
+//  of 8 and the wide columns come first. The reader maps the file and hands out arrivals straight
+//  from the columns, so opening a replay costs one mmap and memory stays flat however many tasks
+//  it holds: columns are paged in ahead of the read position and released behind it.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Simulator.hpp"
+
+#define WORKLOAD_MAGIC "SCHWORK"
+#define WORKLOAD_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t machineClasses;
+    uint64_t taskCount;
+    uint8_t reserved[40];
+} WorkloadHeader_t;
+static_assert(sizeof(WorkloadHeader_t) == 64, "workload header is 64 bytes");
+
+typedef struct {
+    uint32_t count;
+    uint32_t cpu;
+    uint32_t num_cpus;
+    uint32_t memory;
+    uint32_t gpus;
+    uint32_t s_states[7];
+    uint32_t p_states[4];
+    uint32_t c_states[4];
+    uint32_t performance[4];
+} MachineRecord_t;
+static_assert(sizeof(MachineRecord_t) == 96, "machine class records are 96 bytes");
+
+/* Bytes per task across all columns */
+#define TASK_BYTES (8 + 8 + 8 + 4 + 1 + 1 + 1 + 1)
+/* Tasks read between releases of the pages already consumed */
+#define RELEASE_WINDOW 65536
+
+class MappedWorkloadSource : public WorkloadSource {
+public:
+    const uint8_t *base = NULL;
+    size_t length = 0;
+    uint64_t count = 0;
+    uint64_t next = 0;
+    const uint64_t *arrival;
+    const uint64_t *instructions;
+    const uint64_t *target;
+    const uint32_t *memory;
+    const uint8_t *cpu;
+    const uint8_t *vm;
+    const uint8_t *sla;
+    const uint8_t *gpu;
+
+    ~MappedWorkloadSource() {
+        if(base != NULL) {
+            munmap((void *) base, length);
+        }
+    }
+
+    bool Next(TaskSpec_t *spec) {
+        if(next == count) {
+            return false;
+        }
+        spec->arrival = arrival[next];
+        spec->instructions = instructions[next];
+        spec->target_completion = target[next];
+        spec->memory = memory[next];
+        spec->cpu = CPUType_t(cpu[next]);
+        spec->vm = VMType_t(vm[next]);
+        spec->sla = SLAType_t(sla[next]);
+        spec->gpu = gpu[next] != 0;
+        next++;
+        if(next % RELEASE_WINDOW == 0) {
+            releaseConsumed();
+        }
+        return true;
+    }
+
+    /* Drops the whole pages of every column that lie before the read position */
+    void releaseConsumed() {
+        size_t page = sysconf(_SC_PAGESIZE);
+        const void *columns[] = {arrival, instructions, target, memory, cpu, vm, sla, gpu};
+        size_t widths[] = {8, 8, 8, 4, 1, 1, 1, 1};
+        for(unsigned i = 0; i < 8; i++) {
+            uintptr_t start = ((uintptr_t) columns[i] + page - 1) & ~(page - 1);
+            uintptr_t end = ((uintptr_t) columns[i] + next * widths[i]) & ~(page - 1);
+            if(end > start) {
+                madvise((void *) start, end - start, MADV_DONTNEED);
+            }
+        }
+    }
+};
+
+bool IsBinaryWorkload(const string &path) {
+    char magic[8] = {0};
+    FILE *file = fopen(path.c_str(), "rb");
+    if(file == NULL) {
+        return false;
+    }
+    size_t read = fread(magic, 1, sizeof(magic), file);
+    fclose(file);
+    return read == sizeof(magic) && memcmp(magic, WORKLOAD_MAGIC, sizeof(magic)) == 0;
+}
+
+bool LoadBinaryWorkload(const string &path, Workload_t *workload) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        cerr << "Cannot open workload " << path << endl;
+        return false;
+    }
+    struct stat status;
+    if(fstat(fd, &status) != 0 || size_t(status.st_size) < sizeof(WorkloadHeader_t)) {
+        cerr << path << " is too short for a binary workload" << endl;
+        close(fd);
+        return false;
+    }
+    size_t length = status.st_size;
+    void *mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        cerr << "Cannot map workload " << path << endl;
+        return false;
+    }
+    madvise(mapped, length, MADV_SEQUENTIAL);
+
+    MappedWorkloadSource *source = new MappedWorkloadSource();
+    source->base = (const uint8_t *) mapped;
+    source->length = length;
+    const WorkloadHeader_t *header = (const WorkloadHeader_t *) mapped;
+    size_t columns = sizeof(WorkloadHeader_t) + size_t(header->machineClasses) * sizeof(MachineRecord_t);
+    if(memcmp(header->magic, WORKLOAD_MAGIC, sizeof(header->magic)) != 0 || header->version != WORKLOAD_VERSION
+       || columns > length || (length - columns) / TASK_BYTES < header->taskCount) {
+        cerr << path << " is not a version " << WORKLOAD_VERSION << " binary workload" << endl;
+        delete source;
+        return false;
+    }
+
+    const MachineRecord_t *records = (const MachineRecord_t *) (source->base + sizeof(WorkloadHeader_t));
+    for(unsigned i = 0; i < header->machineClasses; i++) {
+        const MachineRecord_t &record = records[i];
+        if(record.cpu > X86) {
+            cerr << path << ": machine class " << i << " has an unknown CPU type " << record.cpu << endl;
+            delete source;
+            return false;
+        }
+        MachineClass_t machines;
+        machines.count = record.count;
+        machines.cpu = CPUType_t(record.cpu);
+        machines.num_cpus = record.num_cpus;
+        machines.memory = record.memory;
+        machines.gpus = record.gpus != 0;
+        machines.s_states.assign(record.s_states, record.s_states + 7);
+        machines.p_states.assign(record.p_states, record.p_states + 4);
+        machines.c_states.assign(record.c_states, record.c_states + 4);
+        machines.performance.assign(record.performance, record.performance + 4);
+        workload->machines.push_back(machines);
+    }
+
+    uint64_t count = header->taskCount;
+    const uint8_t *column = source->base + columns;
+    source->count = count;
+    source->arrival = (const uint64_t *) column;
+    source->instructions = source->arrival + count;
+    source->target = source->instructions + count;
+    source->memory = (const uint32_t *) (source->target + count);
+    source->cpu = (const uint8_t *) (source->memory + count);
+    source->vm = source->cpu + count;
+    source->sla = source->vm + count;
+    source->gpu = source->sla + count;
+
+    /* The enum columns index per-type tables in the schedulers, so a corrupt byte is caught here */
+    for(uint64_t i = 0; i < count; i++) {
+        if(source->cpu[i] > X86 || source->vm[i] > AIX || source->sla[i] > SLA3) {
+            cerr << path << ": task " << i << " has an unknown CPU, VM or SLA type" << endl;
+            workload->machines.clear();
+            delete source;
+            return false;
+        }
+    }
+    workload->tasks = source;
+    return true;
+}
+
+/* Writes one column by pulling a single field out of every task */
+template <typename T, typename F>
+static bool writeColumn(FILE *file, const vector<TaskSpec_t> &specs, F field) {
+    vector<T> values;
+    values.reserve(specs.size());
+    for(const TaskSpec_t &spec: specs) {
+        values.push_back(T(field(spec)));
+    }
+    return fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+bool WriteBinaryWorkload(const string &path, const Workload_t &workload) {
+    vector<TaskSpec_t> specs;
+    TaskSpec_t spec;
+    while(workload.tasks->Next(&spec)) {
+        specs.push_back(spec);
+    }
+
+    for(const MachineClass_t &machines: workload.machines) {
+        if(machines.s_states.size() != 7 || machines.p_states.size() != 4 || machines.c_states.size() != 4
+           || machines.performance.size() != 4) {
+            cerr << "Machine classes need 7 S-states and 4 P-states, C-states and MIPS to be written to " << path << endl;
+            return false;
+        }
+    }
+
+    FILE *file = fopen(path.c_str(), "wb");
+    if(file == NULL) {
+        cerr << "Cannot create " << path << endl;
+        return false;
+    }
+    WorkloadHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORKLOAD_MAGIC, sizeof(header.magic));
+    header.version = WORKLOAD_VERSION;
+    header.machineClasses = workload.machines.size();
+    header.taskCount = specs.size();
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for(const MachineClass_t &machines: workload.machines) {
+        MachineRecord_t record;
+        memset(&record, 0, sizeof(record));
+        record.count = machines.count;
+        record.cpu = machines.cpu;
+        record.num_cpus = machines.num_cpus;
+        record.memory = machines.memory;
+        record.gpus = machines.gpus;
+        copy(machines.s_states.begin(), machines.s_states.end(), record.s_states);
+        copy(machines.p_states.begin(), machines.p_states.end(), record.p_states);
+        copy(machines.c_states.begin(), machines.c_states.end(), record.c_states);
+        copy(machines.performance.begin(), machines.performance.end(), record.performance);
+        ok = ok && fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+
+    ok = ok && writeColumn<uint64_t>(file, specs, [](const TaskSpec_t &s) { return s.arrival; });
+    ok = ok && writeColumn<uint64_t>(file, specs, [](const TaskSpec_t &s) { return s.instructions; });
+    ok = ok && writeColumn<uint64_t>(file, specs, [](const TaskSpec_t &s) { return s.target_completion; });
+    ok = ok && writeColumn<uint32_t>(file, specs, [](const TaskSpec_t &s) { return s.memory; });
+    ok = ok && writeColumn<uint8_t>(file, specs, [](const TaskSpec_t &s) { return s.cpu; });
+    ok = ok && writeColumn<uint8_t>(file, specs, [](const TaskSpec_t &s) { return s.vm; });
+    ok = ok && writeColumn<uint8_t>(file, specs, [](const TaskSpec_t &s) { return s.sla; });
+    ok = ok && writeColumn<uint8_t>(file, specs, [](const TaskSpec_t &s) { return s.gpu; });
+    ok = (fclose(file) == 0) && ok;
+    if(!ok) {
+        cerr << "Failed writing " << path << endl;
+    }
+    return ok;
+}
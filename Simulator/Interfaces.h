@@ -0,0 +1,110 @@
+//
+//  Interfaces.h
+//  CloudSim
+//
+//  The simulator API the schedulers are written against: machines, VMs, tasks and reporting.
+//  Times are in microseconds, MIPS are instructions per microsecond, memory is in MB, power in
+//  watts and energy in joules unless noted otherwise.
+//
+
+#ifndef Interfaces_h
+#define Interfaces_h
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef unsigned MachineId_t;
+typedef unsigned TaskId_t;
+typedef unsigned VMId_t;
+typedef uint64_t Time_t;
+
+typedef enum { S0, S0i1, S1, S2, S3, S4, S5 } MachineState_t;
+typedef enum { P0, P1, P2, P3 } CPUPerformance_t;
+typedef enum { C0, C1, C2, C4 } CoreState_t;
+typedef enum { ARM, POWER, RISCV, X86 } CPUType_t;
+typedef enum { LINUX, LINUX_RT, WIN, AIX } VMType_t;
+typedef enum { SLA0, SLA1, SLA2, SLA3 } SLAType_t;
+typedef enum { HIGH_PRIORITY, MID_PRIORITY, LOW_PRIORITY } Priority_t;
+
+typedef struct {
+    unsigned num_cpus;
+    CPUType_t cpu;
+    unsigned memory_size;
+    unsigned memory_used;
+    bool gpus;
+    vector<unsigned> s_states;      // power draw in each S-state
+    vector<unsigned> c_states;      // power draw of a core in each C-state
+    vector<unsigned> p_states;      // power draw of a busy core in each P-state
+    vector<unsigned> performance;   // MIPS of a core in each P-state
+    unsigned active_tasks;
+    unsigned active_vms;
+    CPUPerformance_t p_state;
+    MachineState_t s_state;
+    uint64_t energy_consumed;       // joules
+    MachineId_t machine_id;
+} MachineInfo_t;
+
+typedef struct {
+    vector<TaskId_t> active_tasks;
+    CPUType_t cpu;
+    MachineId_t machine_id;
+    VMId_t vm_id;
+    VMType_t vm_type;
+} VMInfo_t;
+
+typedef struct {
+    bool completed;
+    uint64_t total_instructions;
+    uint64_t remaining_instructions;
+    Time_t arrival;
+    Time_t completion;
+    Time_t target_completion;
+    bool gpu_capable;
+    Priority_t priority;
+    CPUType_t required_cpu;
+    unsigned required_memory;
+    SLAType_t required_sla;
+    VMType_t required_vm;
+    TaskId_t task_id;
+} TaskInfo_t;
+
+// Machines
+void Machine_SetCorePerformance(MachineId_t machine_id, unsigned core_id, CPUPerformance_t p_state);
+CPUType_t Machine_GetCPUType(MachineId_t machine_id);
+double Machine_GetClusterEnergy();                 // KW-Hour
+uint64_t Machine_GetEnergy(MachineId_t machine_id);     // joules
+MachineInfo_t Machine_GetInfo(MachineId_t machine_id);
+void Machine_SetState(MachineId_t machine_id, MachineState_t s_state);
+unsigned Machine_GetTotal();
+
+// Tasks
+unsigned GetNumTasks();
+TaskInfo_t GetTaskInfo(TaskId_t task_id);
+unsigned GetTaskMemory(TaskId_t task_id);
+unsigned GetTaskPriority(TaskId_t task_id);
+SLAType_t RequiredSLA(TaskId_t task_id);
+CPUType_t RequiredCPUType(TaskId_t task_id);
+VMType_t RequiredVMType(TaskId_t task_id);
+void SetTaskPriority(TaskId_t task_id, Priority_t priority);
+bool IsGPUCapable(TaskId_t task_id);
+bool IsTaskCompleted(TaskId_t task_id);
+double GetSLAReport(SLAType_t sla);                 // percentage of completed tasks that missed their target
+
+// VMs
+void VM_AddTask(VMId_t vm_id, TaskId_t task_id, Priority_t priority);
+void VM_Attach(VMId_t vm_id, MachineId_t machine_id);
+VMId_t VM_Create(VMType_t vm_type, CPUType_t cpu);
+VMInfo_t VM_GetInfo(VMId_t vm_id);
+void VM_Migrate(VMId_t vm_id, MachineId_t machine_id);
+void VM_RemoveTask(VMId_t vm_id, TaskId_t task_id);
+void VM_Shutdown(VMId_t vm_id);
+
+// Output and time
+void SimOutput(string msg, unsigned int verbose_level);
+Time_t Now();
+
+#endif /* Interfaces_h */
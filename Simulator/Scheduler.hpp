@@ -0,0 +1,40 @@
+//
+//  Scheduler.hpp
+//  CloudSim
+//
+//  Implemented by each algorithm's Scheduler.cpp. The free functions below are the callbacks
+//  the simulator makes into the scheduler.
+//
+
+#ifndef Scheduler_hpp
+#define Scheduler_hpp
+
+#include <vector>
+
+#include "Interfaces.h"
+
+class Scheduler {
+public:
+    Scheduler()                 {}
+    void Init();
+    void MigrationComplete(Time_t time, VMId_t vm_id);
+    void NewTask(Time_t now, TaskId_t task_id);
+    void PeriodicCheck(Time_t now);
+    void Shutdown(Time_t now);
+    void TaskComplete(Time_t now, TaskId_t task_id);
+private:
+    vector<VMId_t> vms;
+    vector<MachineId_t> machines;
+};
+
+void InitScheduler();
+void HandleNewTask(Time_t time, TaskId_t task_id);
+void HandleTaskCompletion(Time_t time, TaskId_t task_id);
+void MemoryWarning(Time_t time, MachineId_t machine_id);
+void MigrationDone(Time_t time, VMId_t vm_id);
+void SchedulerCheck(Time_t time);
+void SimulationComplete(Time_t time);
+void SLAWarning(Time_t time, TaskId_t task_id);
+void StateChangeComplete(Time_t time, MachineId_t machine_id);
+
+#endif /* Scheduler_hpp */
@@ -0,0 +1,745 @@
+//
+//  Simulator.cpp
+//  CloudSim
+//
+//  A stand-in for the course simulator: implements Interfaces.h over a discrete event loop and
+//  drives the scheduler callbacks. It is only meant to be close enough to compare policies and
+//  profile the schedulers locally; the graded numbers still come from the course simulator.
+//
+//  Machines are advanced lazily. Each one remembers when its energy and task progress were last
+//  integrated, catches up whenever it is looked at or changed, and then re-derives its task rates
+//  and the time of its next completion. Stale events are recognised by a per-machine version.
+//
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <queue>
+
+#include "Scheduler.hpp"
+#include "Simulator.hpp"
+
+#define NO_MACHINE UINT_MAX
+#define VM_MEMORY_OVERHEAD 8            // MB taken by a VM before any task runs in it
+#define MIGRATION_BASE 1000             // us to start a migration
+#define MIGRATION_PER_MB 10             // us per MB of VM memory moved
+#define OVERCOMMIT_SLOWDOWN 0.5         // rate multiplier while a machine is out of memory
+#define GPU_SPEEDUP 2.0                 // rate multiplier for GPU capable tasks on GPU machines
+
+/* Time to enter or leave an S-state, keyed by the deeper of the two states */
+static const Time_t stateLatency[] = {0, 10, 100, 1000, 10000, 100000, 1000000};
+static const double priorityWeight[] = {3.0, 2.0, 1.0};
+
+typedef struct {
+    CPUType_t cpu;
+    unsigned num_cpus;
+    unsigned memory_size;
+    unsigned memory_used;
+    bool gpus;
+    const MachineClass_t *cls;
+    vector<CPUPerformance_t> corePerf;
+    MachineState_t s_state;
+    MachineState_t targetState;
+    bool transitioning;
+    vector<VMId_t> vms;
+    unsigned active_tasks;
+    double energy;                      // joules
+    Time_t lastAdvance;
+    uint64_t version;                   // bumped whenever the pending completion event is replaced
+    uint64_t stateVersion;              // bumped whenever the pending state change is replaced
+    bool overcommitted;
+} SimMachine_t;
+
+typedef struct {
+    VMType_t type;
+    CPUType_t cpu;
+    MachineId_t machine;
+    MachineId_t target;
+    bool migrating;
+    bool live;
+    vector<TaskId_t> tasks;
+} SimVM_t;
+
+typedef struct {
+    TaskSpec_t spec;
+    Priority_t priority;
+    VMId_t vm;
+    bool placed;
+    bool completed;
+    Time_t completion;
+    double remaining;
+    double rate;                        // instructions per us at the moment
+    bool slaWarned;
+} SimTask_t;
+
+typedef enum { EV_ARRIVAL, EV_COMPLETION, EV_STATE_CHANGE, EV_MIGRATION, EV_MEMORY_WARNING, EV_CHECK } EventType_t;
+
+typedef struct {
+    Time_t time;
+    uint64_t seq;
+    EventType_t type;
+    unsigned id;
+    uint64_t version;
+} Event_t;
+
+struct EventLater {
+    bool operator()(const Event_t &a, const Event_t &b) const {
+        return (a.time != b.time) ? a.time > b.time : a.seq > b.seq;
+    }
+};
+
+static vector<SimMachine_t> machines;
+static vector<SimVM_t> vms;
+static vector<SimTask_t> tasks;
+static priority_queue<Event_t, vector<Event_t>, EventLater> events;
+static uint64_t eventSeq = 0;
+static Time_t now = 0;
+static unsigned verbosity = 0;
+static unsigned completedTasks = 0;
+static unsigned slaCompleted[4] = {0, 0, 0, 0};    // per SLA class, so GetSLAReport doesn't walk every task
+static unsigned slaMissed[4] = {0, 0, 0, 0};
+
+static void fail(const string &message) {
+    cerr << "Simulator error at " << now << ": " << message << endl;
+    exit(1);
+}
+
+static void schedule(Time_t time, EventType_t type, unsigned id, uint64_t version) {
+    events.push({time, eventSeq++, type, id, version});
+}
+
+static SimMachine_t &machineAt(MachineId_t machine_id) {
+    if(machine_id >= machines.size()) {
+        fail("unknown machine " + to_string(machine_id));
+    }
+    return machines[machine_id];
+}
+
+static SimVM_t &vmAt(VMId_t vm_id) {
+    if(vm_id >= vms.size() || !vms[vm_id].live) {
+        fail("unknown or shut down VM " + to_string(vm_id));
+    }
+    return vms[vm_id];
+}
+
+static SimTask_t &taskAt(TaskId_t task_id) {
+    if(task_id >= tasks.size()) {
+        fail("unknown task " + to_string(task_id));
+    }
+    return tasks[task_id];
+}
+
+static double machinePower(const SimMachine_t &machine) {
+    if(machine.transitioning) {
+        return machine.cls->s_states[S0];
+    }
+    if(machine.s_state != S0) {
+        return machine.cls->s_states[machine.s_state];
+    }
+    double power = machine.cls->s_states[S0];
+    unsigned busy = min(machine.active_tasks, machine.num_cpus);
+    for(unsigned core = 0; core < busy; core++) {
+        power += machine.cls->p_states[machine.corePerf[core]];
+    }
+    return power;
+}
+
+/* Integrates energy and task progress up to the current time */
+static void advanceMachine(SimMachine_t &machine) {
+    if(machine.lastAdvance >= now) {
+        return;
+    }
+    double elapsed = double(now - machine.lastAdvance);
+    machine.energy += machinePower(machine) * elapsed / 1000000.0;
+    for(VMId_t vm_id: machine.vms) {
+        for(TaskId_t task_id: vms[vm_id].tasks) {
+            SimTask_t &task = tasks[task_id];
+            task.remaining = max(0.0, task.remaining - task.rate * elapsed);
+        }
+    }
+    machine.lastAdvance = now;
+}
+
+/* Re-derives task rates after any change to the machine and schedules its next completion */
+static void refreshMachine(MachineId_t machine_id) {
+    SimMachine_t &machine = machines[machine_id];
+    bool running = machine.s_state == S0 && !machine.transitioning;
+    vector<TaskId_t> active;
+    for(VMId_t vm_id: machine.vms) {
+        for(TaskId_t task_id: vms[vm_id].tasks) {
+            if(running && !vms[vm_id].migrating) {
+                active.push_back(task_id);
+            } else {
+                tasks[task_id].rate = 0;
+            }
+        }
+    }
+
+    double coreMips = 0;
+    for(CPUPerformance_t perf: machine.corePerf) {
+        coreMips += machine.cls->performance[perf];
+    }
+    coreMips /= machine.num_cpus;
+    double totalWeight = 0;
+    for(TaskId_t task_id: active) {
+        totalWeight += priorityWeight[tasks[task_id].priority];
+    }
+
+    Time_t next = 0;
+    for(TaskId_t task_id: active) {
+        SimTask_t &task = tasks[task_id];
+        task.rate = coreMips;
+        if(active.size() > machine.num_cpus) {
+            task.rate = coreMips * machine.num_cpus * priorityWeight[task.priority] / totalWeight;
+        }
+        if(machine.overcommitted) {
+            task.rate *= OVERCOMMIT_SLOWDOWN;
+        }
+        if(task.spec.gpu && machine.gpus) {
+            task.rate *= GPU_SPEEDUP;
+        }
+        Time_t finish = now + max<Time_t>(1, Time_t(ceil(task.remaining / task.rate)));
+        if(next == 0 || finish < next) {
+            next = finish;
+        }
+    }
+    machine.version++;
+    if(next != 0) {
+        schedule(next, EV_COMPLETION, machine_id, machine.version);
+    }
+}
+
+static void updateMemory(MachineId_t machine_id, int delta) {
+    SimMachine_t &machine = machines[machine_id];
+    machine.memory_used += delta;
+    bool overcommitted = machine.memory_used > machine.memory_size;
+    if(overcommitted && !machine.overcommitted) {
+        schedule(now, EV_MEMORY_WARNING, machine_id, 0);
+    }
+    machine.overcommitted = overcommitted;
+}
+
+static void syncTask(SimTask_t &task) {
+    if(task.placed) {
+        advanceMachine(machines[vms[task.vm].machine]);
+    }
+}
+
+// Machines
+
+void Machine_SetCorePerformance(MachineId_t machine_id, unsigned core_id, CPUPerformance_t p_state) {
+    SimMachine_t &machine = machineAt(machine_id);
+    if(core_id >= machine.num_cpus || p_state > P3) {
+        fail("bad core " + to_string(core_id) + " or P-state on machine " + to_string(machine_id));
+    }
+    advanceMachine(machine);
+    machine.corePerf[core_id] = p_state;
+    refreshMachine(machine_id);
+}
+
+CPUType_t Machine_GetCPUType(MachineId_t machine_id) {
+    return machineAt(machine_id).cpu;
+}
+
+double Machine_GetClusterEnergy() {
+    double joules = 0;
+    for(SimMachine_t &machine: machines) {
+        advanceMachine(machine);
+        joules += machine.energy;
+    }
+    return joules / 3600000.0;
+}
+
+uint64_t Machine_GetEnergy(MachineId_t machine_id) {
+    SimMachine_t &machine = machineAt(machine_id);
+    advanceMachine(machine);
+    return uint64_t(machine.energy);
+}
+
+MachineInfo_t Machine_GetInfo(MachineId_t machine_id) {
+    SimMachine_t &machine = machineAt(machine_id);
+    advanceMachine(machine);
+    MachineInfo_t info;
+    info.num_cpus = machine.num_cpus;
+    info.cpu = machine.cpu;
+    info.memory_size = machine.memory_size;
+    info.memory_used = machine.memory_used;
+    info.gpus = machine.gpus;
+    info.s_states = machine.cls->s_states;
+    info.c_states = machine.cls->c_states;
+    info.p_states = machine.cls->p_states;
+    info.performance = machine.cls->performance;
+    info.active_tasks = machine.active_tasks;
+    info.active_vms = machine.vms.size();
+    info.p_state = machine.corePerf[0];
+    info.s_state = machine.s_state;
+    info.energy_consumed = uint64_t(machine.energy);
+    info.machine_id = machine_id;
+    return info;
+}
+
+void Machine_SetState(MachineId_t machine_id, MachineState_t s_state) {
+    SimMachine_t &machine = machineAt(machine_id);
+    if(s_state > S5) {
+        fail("bad S-state for machine " + to_string(machine_id));
+    }
+    /* Asking again for the state already under way doesn't restart the transition */
+    if(machine.transitioning && machine.targetState == s_state) {
+        return;
+    }
+    advanceMachine(machine);
+    machine.targetState = s_state;
+    machine.transitioning = true;
+    machine.stateVersion++;
+    schedule(now + stateLatency[max(machine.s_state, s_state)], EV_STATE_CHANGE, machine_id, machine.stateVersion);
+    refreshMachine(machine_id);
+}
+
+unsigned Machine_GetTotal() {
+    return machines.size();
+}
+
+// Tasks
+
+unsigned GetNumTasks() {
+    return tasks.size();
+}
+
+TaskInfo_t GetTaskInfo(TaskId_t task_id) {
+    SimTask_t &task = taskAt(task_id);
+    syncTask(task);
+    TaskInfo_t info;
+    info.completed = task.completed;
+    info.total_instructions = task.spec.instructions;
+    info.remaining_instructions = uint64_t(ceil(task.remaining));
+    info.arrival = task.spec.arrival;
+    info.completion = task.completion;
+    info.target_completion = task.spec.target_completion;
+    info.gpu_capable = task.spec.gpu;
+    info.priority = task.priority;
+    info.required_cpu = task.spec.cpu;
+    info.required_memory = task.spec.memory;
+    info.required_sla = task.spec.sla;
+    info.required_vm = task.spec.vm;
+    info.task_id = task_id;
+    return info;
+}
+
+unsigned GetTaskMemory(TaskId_t task_id) {
+    return taskAt(task_id).spec.memory;
+}
+
+unsigned GetTaskPriority(TaskId_t task_id) {
+    return taskAt(task_id).priority;
+}
+
+SLAType_t RequiredSLA(TaskId_t task_id) {
+    return taskAt(task_id).spec.sla;
+}
+
+CPUType_t RequiredCPUType(TaskId_t task_id) {
+    return taskAt(task_id).spec.cpu;
+}
+
+VMType_t RequiredVMType(TaskId_t task_id) {
+    return taskAt(task_id).spec.vm;
+}
+
+void SetTaskPriority(TaskId_t task_id, Priority_t priority) {
+    SimTask_t &task = taskAt(task_id);
+    syncTask(task);
+    task.priority = priority;
+    if(task.placed) {
+        refreshMachine(vms[task.vm].machine);
+    }
+}
+
+bool IsGPUCapable(TaskId_t task_id) {
+    return taskAt(task_id).spec.gpu;
+}
+
+bool IsTaskCompleted(TaskId_t task_id) {
+    return taskAt(task_id).completed;
+}
+
+double GetSLAReport(SLAType_t sla) {
+    if(sla > SLA3) {
+        fail("bad SLA class");
+    }
+    return (slaCompleted[sla] == 0) ? 0.0 : 100.0 * slaMissed[sla] / slaCompleted[sla];
+}
+
+// VMs
+
+void VM_AddTask(VMId_t vm_id, TaskId_t task_id, Priority_t priority) {
+    SimVM_t &vm = vmAt(vm_id);
+    SimTask_t &task = taskAt(task_id);
+    if(vm.machine == NO_MACHINE) {
+        fail("task " + to_string(task_id) + " added to unattached VM " + to_string(vm_id));
+    }
+    if(task.placed || task.completed) {
+        fail("task " + to_string(task_id) + " is already placed");
+    }
+    if(task.spec.cpu != vm.cpu || task.spec.vm != vm.type) {
+        fail("task " + to_string(task_id) + " does not match VM " + to_string(vm_id));
+    }
+    advanceMachine(machines[vm.machine]);
+    vm.tasks.push_back(task_id);
+    task.vm = vm_id;
+    task.placed = true;
+    task.priority = priority;
+    machines[vm.machine].active_tasks++;
+    updateMemory(vm.machine, task.spec.memory);
+    refreshMachine(vm.machine);
+}
+
+void VM_Attach(VMId_t vm_id, MachineId_t machine_id) {
+    SimVM_t &vm = vmAt(vm_id);
+    SimMachine_t &machine = machineAt(machine_id);
+    if(vm.machine != NO_MACHINE) {
+        fail("VM " + to_string(vm_id) + " is already attached");
+    }
+    if(vm.cpu != machine.cpu) {
+        fail("VM " + to_string(vm_id) + " does not match the CPU of machine " + to_string(machine_id));
+    }
+    advanceMachine(machine);
+    vm.machine = machine_id;
+    machine.vms.push_back(vm_id);
+    updateMemory(machine_id, VM_MEMORY_OVERHEAD);
+}
+
+VMId_t VM_Create(VMType_t vm_type, CPUType_t cpu) {
+    vms.push_back({vm_type, cpu, NO_MACHINE, NO_MACHINE, false, true, {}});
+    return vms.size() - 1;
+}
+
+VMInfo_t VM_GetInfo(VMId_t vm_id) {
+    SimVM_t &vm = vmAt(vm_id);
+    VMInfo_t info;
+    info.active_tasks = vm.tasks;
+    info.cpu = vm.cpu;
+    info.machine_id = vm.machine;
+    info.vm_id = vm_id;
+    info.vm_type = vm.type;
+    return info;
+}
+
+void VM_Migrate(VMId_t vm_id, MachineId_t machine_id) {
+    SimVM_t &vm = vmAt(vm_id);
+    SimMachine_t &target = machineAt(machine_id);
+    if(vm.machine == NO_MACHINE || vm.migrating) {
+        fail("VM " + to_string(vm_id) + " cannot migrate now");
+    }
+    if(vm.cpu != target.cpu) {
+        fail("VM " + to_string(vm_id) + " cannot migrate to machine " + to_string(machine_id));
+    }
+    unsigned memory = VM_MEMORY_OVERHEAD;
+    for(TaskId_t task_id: vm.tasks) {
+        memory += tasks[task_id].spec.memory;
+    }
+    advanceMachine(machines[vm.machine]);
+    vm.migrating = true;
+    vm.target = machine_id;
+    schedule(now + MIGRATION_BASE + Time_t(memory) * MIGRATION_PER_MB, EV_MIGRATION, vm_id, 0);
+    refreshMachine(vm.machine);
+}
+
+void VM_RemoveTask(VMId_t vm_id, TaskId_t task_id) {
+    SimVM_t &vm = vmAt(vm_id);
+    SimTask_t &task = taskAt(task_id);
+    auto it = find(vm.tasks.begin(), vm.tasks.end(), task_id);
+    if(it == vm.tasks.end()) {
+        fail("task " + to_string(task_id) + " is not in VM " + to_string(vm_id));
+    }
+    advanceMachine(machines[vm.machine]);
+    vm.tasks.erase(it);
+    task.placed = false;
+    task.rate = 0;
+    machines[vm.machine].active_tasks--;
+    updateMemory(vm.machine, -int(task.spec.memory));
+    refreshMachine(vm.machine);
+}
+
+void VM_Shutdown(VMId_t vm_id) {
+    SimVM_t &vm = vmAt(vm_id);
+    if(vm.migrating) {
+        fail("VM " + to_string(vm_id) + " shut down while migrating");
+    }
+    if(vm.machine != NO_MACHINE) {
+        while(!vm.tasks.empty()) {
+            SimOutput("VM_Shutdown(): task " + to_string(vm.tasks.back()) + " dropped with VM " + to_string(vm_id), 1);
+            VM_RemoveTask(vm_id, vm.tasks.back());
+        }
+        SimMachine_t &machine = machines[vm.machine];
+        advanceMachine(machine);
+        machine.vms.erase(find(machine.vms.begin(), machine.vms.end(), vm_id));
+        updateMemory(vm.machine, -VM_MEMORY_OVERHEAD);
+    }
+    vm.live = false;
+}
+
+// Output and time
+
+void SimOutput(string msg, unsigned int verbose_level) {
+    if(verbose_level <= verbosity) {
+        cout << msg << endl;
+    }
+}
+
+Time_t Now() {
+    return now;
+}
+
+// Event handling
+
+static void completeTasks(MachineId_t machine_id) {
+    SimMachine_t &machine = machines[machine_id];
+    advanceMachine(machine);
+    vector<TaskId_t> finished;
+    for(VMId_t vm_id: machine.vms) {
+        SimVM_t &vm = vms[vm_id];
+        for(unsigned i = 0; i < vm.tasks.size(); ) {
+            SimTask_t &task = tasks[vm.tasks[i]];
+            if(task.rate > 0 && task.remaining < 0.5) {
+                finished.push_back(vm.tasks[i]);
+                task.remaining = 0;
+                task.rate = 0;
+                task.completed = true;
+                task.placed = false;
+                task.completion = now;
+                slaCompleted[task.spec.sla]++;
+                slaMissed[task.spec.sla] += task.completion > task.spec.target_completion;
+                vm.tasks.erase(vm.tasks.begin() + i);
+                machine.active_tasks--;
+                updateMemory(machine_id, -int(task.spec.memory));
+            } else {
+                i++;
+            }
+        }
+    }
+    refreshMachine(machine_id);
+    completedTasks += finished.size();
+    for(TaskId_t task_id: finished) {
+        HandleTaskCompletion(now, task_id);
+    }
+}
+
+static void finishMigration(VMId_t vm_id) {
+    SimVM_t &vm = vms[vm_id];
+    MachineId_t source = vm.machine;
+    advanceMachine(machines[source]);
+    advanceMachine(machines[vm.target]);
+    SimMachine_t &from = machines[source];
+    from.vms.erase(find(from.vms.begin(), from.vms.end(), vm_id));
+    machines[vm.target].vms.push_back(vm_id);
+    int memory = VM_MEMORY_OVERHEAD;
+    for(TaskId_t task_id: vm.tasks) {
+        memory += tasks[task_id].spec.memory;
+    }
+    from.active_tasks -= vm.tasks.size();
+    machines[vm.target].active_tasks += vm.tasks.size();
+    updateMemory(source, -memory);
+    updateMemory(vm.target, memory);
+    vm.machine = vm.target;
+    vm.migrating = false;
+    refreshMachine(source);
+    refreshMachine(vm.machine);
+    MigrationDone(now, vm_id);
+}
+
+/* Warns once per task whose projected finish at its current rate has slipped past its target; a
+   task that catches up again can be warned again later. Paused tasks keep their previous verdict */
+static void checkSLAs() {
+    vector<TaskId_t> late;
+    for(SimMachine_t &machine: machines) {
+        advanceMachine(machine);
+        for(VMId_t vm_id: machine.vms) {
+            for(TaskId_t task_id: vms[vm_id].tasks) {
+                SimTask_t &task = tasks[task_id];
+                if(task.spec.sla == SLA3 || task.rate <= 0) {
+                    continue;
+                }
+                bool behind = now + task.remaining / task.rate > task.spec.target_completion;
+                if(behind && !task.slaWarned) {
+                    late.push_back(task_id);
+                }
+                task.slaWarned = behind;
+            }
+        }
+    }
+    for(TaskId_t task_id: late) {
+        SLAWarning(now, task_id);
+    }
+}
+
+static void checkMemory() {
+    for(MachineId_t machine_id = 0; machine_id < machines.size(); machine_id++) {
+        if(machines[machine_id].overcommitted) {
+            MemoryWarning(now, machine_id);
+        }
+    }
+}
+
+static void buildCluster(const Workload_t &workload) {
+    for(const MachineClass_t &cls: workload.machines) {
+        for(unsigned i = 0; i < cls.count; i++) {
+            SimMachine_t machine;
+            machine.cpu = cls.cpu;
+            machine.num_cpus = cls.num_cpus;
+            machine.memory_size = cls.memory;
+            machine.memory_used = 0;
+            machine.gpus = cls.gpus;
+            machine.cls = &cls;
+            machine.corePerf.assign(cls.num_cpus, P0);
+            machine.s_state = S0;
+            machine.targetState = S0;
+            machine.transitioning = false;
+            machine.active_tasks = 0;
+            machine.energy = 0;
+            machine.lastAdvance = 0;
+            machine.version = 0;
+            machine.stateVersion = 0;
+            machine.overcommitted = false;
+            machines.push_back(machine);
+        }
+    }
+}
+
+static bool nextArrival(WorkloadSource *source, Time_t *lastArrival) {
+    TaskSpec_t spec;
+    if(!source->Next(&spec)) {
+        return false;
+    }
+    if(spec.arrival < *lastArrival) {
+        fail("workload arrivals are out of order");
+    }
+    *lastArrival = spec.arrival;
+    tasks.push_back({spec, MID_PRIORITY, 0, false, false, 0, double(spec.instructions), 0, false});
+    schedule(spec.arrival, EV_ARRIVAL, tasks.size() - 1, 0);
+    return true;
+}
+
+static const Workload_t *workload = NULL;
+static SimConfig_t config;
+static Time_t lastArrival = 0;
+static bool arriving = false;
+static bool finished = false;
+
+void StartSimulation(const Workload_t &run, const SimConfig_t &settings) {
+    workload = &run;
+    config = settings;
+    verbosity = config.verbosity;
+    buildCluster(run);
+    if(machines.empty()) {
+        fail("the workload has no machines");
+    }
+    arriving = nextArrival(workload->tasks, &lastArrival);
+    schedule(config.check_period, EV_CHECK, 0, 0);
+    InitScheduler();
+}
+
+bool RunUntil(Time_t limit) {
+    while(!finished && !events.empty() && events.top().time <= limit) {
+        Event_t event = events.top();
+        events.pop();
+        now = event.time;
+        switch(event.type) {
+            case EV_ARRIVAL:
+                arriving = nextArrival(workload->tasks, &lastArrival);
+                HandleNewTask(now, event.id);
+                break;
+            case EV_COMPLETION:
+                if(event.version == machines[event.id].version) {
+                    completeTasks(event.id);
+                }
+                break;
+            case EV_STATE_CHANGE:
+                if(event.version == machines[event.id].stateVersion) {
+                    SimMachine_t &machine = machines[event.id];
+                    advanceMachine(machine);
+                    machine.s_state = machine.targetState;
+                    machine.transitioning = false;
+                    refreshMachine(event.id);
+                    StateChangeComplete(now, event.id);
+                }
+                break;
+            case EV_MIGRATION:
+                finishMigration(event.id);
+                break;
+            case EV_MEMORY_WARNING:
+                if(machines[event.id].overcommitted) {
+                    MemoryWarning(now, event.id);
+                }
+                break;
+            case EV_CHECK:
+                checkSLAs();
+                checkMemory();
+                SchedulerCheck(now);
+                schedule(now + config.check_period, EV_CHECK, 0, 0);
+                break;
+        }
+        if(!arriving && completedTasks == tasks.size()) {
+            finished = true;
+        }
+        if(!arriving && now > lastArrival + config.drain_limit) {
+            SimOutput("Drain limit reached with " + to_string(tasks.size() - completedTasks) + " tasks unfinished", 0);
+            finished = true;
+        }
+    }
+    if(!finished && now < limit && limit != UINT64_MAX) {
+        now = limit;
+    }
+    return finished;
+}
+
+void FinishSimulation() {
+    Machine_GetClusterEnergy();
+    SimulationComplete(now);
+}
+
+void RunSimulation(const Workload_t &run, const SimConfig_t &settings) {
+    StartSimulation(run, settings);
+    RunUntil(UINT64_MAX);
+    FinishSimulation();
+}
+
+// Benchmark hooks
+
+TaskId_t InjectTask(const TaskSpec_t &spec) {
+    tasks.push_back({spec, MID_PRIORITY, 0, false, false, 0, double(spec.instructions), 0, false});
+    tasks.back().spec.arrival = now;
+    return tasks.size() - 1;
+}
+
+bool RetireTask(TaskId_t task_id) {
+    SimTask_t &task = taskAt(task_id);
+    if(!task.placed) {
+        return false;
+    }
+    SimVM_t &vm = vms[task.vm];
+    MachineId_t machine_id = vm.machine;
+    advanceMachine(machines[machine_id]);
+    vm.tasks.erase(find(vm.tasks.begin(), vm.tasks.end(), task_id));
+    task.remaining = 0;
+    task.rate = 0;
+    task.completed = true;
+    task.placed = false;
+    task.completion = now;
+    slaCompleted[task.spec.sla]++;
+    slaMissed[task.spec.sla] += task.completion > task.spec.target_completion;
+    machines[machine_id].active_tasks--;
+    updateMemory(machine_id, -int(task.spec.memory));
+    refreshMachine(machine_id);
+    completedTasks++;
+    return true;
+}
+
+void RunningTasks(vector<TaskId_t> *running) {
+    running->clear();
+    for(const SimMachine_t &machine: machines) {
+        for(VMId_t vm_id: machine.vms) {
+            running->insert(running->end(), vms[vm_id].tasks.begin(), vms[vm_id].tasks.end());
+        }
+    }
+}
@@ -0,0 +1,85 @@
+//
+//  Simulator.hpp
+//  CloudSim
+//
+//  Internals of the stand-in simulator: the cluster, the workload sources that feed it and the
+//  event loop. Schedulers only see Interfaces.h.
+//
+
+#ifndef Simulator_hpp
+#define Simulator_hpp
+
+#include <string>
+#include <vector>
+
+#include "Interfaces.h"
+
+/* One group of identical machines from the workload file */
+typedef struct {
+    unsigned count;
+    CPUType_t cpu;
+    unsigned num_cpus;
+    unsigned memory;
+    bool gpus;
+    vector<unsigned> s_states;
+    vector<unsigned> p_states;
+    vector<unsigned> c_states;
+    vector<unsigned> performance;
+} MachineClass_t;
+
+/* Everything the simulator needs to know about a task when it arrives */
+typedef struct {
+    Time_t arrival;
+    Time_t target_completion;
+    uint64_t instructions;
+    unsigned memory;
+    CPUType_t cpu;
+    VMType_t vm;
+    SLAType_t sla;
+    bool gpu;
+} TaskSpec_t;
+
+/* Hands out arrivals in time order. Sources may stream from disk, so Next is the only access */
+class WorkloadSource {
+public:
+    virtual ~WorkloadSource() {}
+    virtual bool Next(TaskSpec_t *spec) = 0;
+};
+
+typedef struct {
+    vector<MachineClass_t> machines;
+    WorkloadSource *tasks;
+} Workload_t;
+
+/* Text workloads in the course format (machine class / task class blocks) */
+bool LoadTextWorkload(const string &path, Workload_t *workload);
+
+/* Columnar binary workloads, replayed straight from a memory mapping (see BinaryWorkload.cpp) */
+bool IsBinaryWorkload(const string &path);
+bool LoadBinaryWorkload(const string &path, Workload_t *workload);
+bool WriteBinaryWorkload(const string &path, const Workload_t &workload);
+
+typedef struct {
+    unsigned verbosity;
+    Time_t check_period;        // time between SchedulerCheck calls
+    Time_t drain_limit;         // give up this long after the last arrival if tasks are still running
+} SimConfig_t;
+
+/* Runs the whole simulation against the linked scheduler and returns once SimulationComplete has been called */
+void RunSimulation(const Workload_t &workload, const SimConfig_t &config);
+
+/* The same run in steps: StartSimulation builds the cluster and calls InitScheduler, RunUntil
+   handles every event up to limit and returns true once the run is over, FinishSimulation calls
+   SimulationComplete. The workload must outlive the run */
+void StartSimulation(const Workload_t &workload, const SimConfig_t &config);
+bool RunUntil(Time_t limit);
+void FinishSimulation();
+
+/* For benchmarks that drive callbacks directly. InjectTask registers a task arriving now without
+   telling the scheduler, RetireTask completes a placed task at once without calling
+   HandleTaskCompletion, RunningTasks lists every placed task */
+TaskId_t InjectTask(const TaskSpec_t &spec);
+bool RetireTask(TaskId_t task_id);
+void RunningTasks(vector<TaskId_t> *running);
+
+#endif /* Simulator_hpp */
@@ -0,0 +1,282 @@
+//
+//  Workload.cpp
+//  CloudSim
+//
+//  Reader for text workloads in the course format:
+//
+//      machine class:
+//      {
+//              Number of machines: 16
+//              CPU type: X86
+//              Number of cores: 8
+//              Memory: 16384
+//              S-States: [120, 100, 100, 80, 40, 10, 0]
+//              P-States: [12, 8, 6, 4]
+//              C-States: [12, 3, 1, 0]
+//              MIPS: [1000, 800, 600, 400]
+//              GPUs: yes
+//      }
+//      task class:
+//      {
+//              Start time: 60000
+//              End time : 800000
+//              Inter arrival: 6000
+//              Expected runtime: 2000000
+//              Memory: 8
+//              VM type: LINUX
+//              GPU enabled: no
+//              SLA type: SLA0
+//              CPU type: X86
+//              Task type: WEB
+//              Seed: 520230
+//      }
+//
+//  Lines starting with # are comments. Each task class emits arrivals from its start to its end
+//  time with exponentially distributed gaps around the inter-arrival mean, and runtimes spread
+//  uniformly over 75%-125% of the expected runtime, all drawn from the class seed so every run
+//  of a workload sees the same tasks.
+//
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+
+#include "Simulator.hpp"
+
+/* Fraction of the expected runtime a task may take before it misses its SLA */
+static const double slaSlack[] = {1.2, 1.5, 2.0, 10.0};
+
+typedef struct {
+    Time_t start;
+    Time_t end;
+    Time_t inter_arrival;
+    Time_t runtime;
+    unsigned memory;
+    VMType_t vm;
+    bool gpu;
+    SLAType_t sla;
+    CPUType_t cpu;
+    uint64_t seed;
+} TaskClass_t;
+
+/* Arrivals of every task class merged into one time-ordered list */
+class TextWorkloadSource : public WorkloadSource {
+public:
+    vector<TaskSpec_t> specs;
+    size_t next = 0;
+    bool Next(TaskSpec_t *spec) {
+        if(next == specs.size()) {
+            return false;
+        }
+        *spec = specs[next++];
+        return true;
+    }
+};
+
+static string trim(const string &text) {
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if(first == string::npos) {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+static string lower(string text) {
+    for(char &c: text) {
+        c = tolower(c);
+    }
+    return text;
+}
+
+static vector<unsigned> parseList(const string &text) {
+    vector<unsigned> values;
+    string cleaned = text;
+    replace(cleaned.begin(), cleaned.end(), '[', ' ');
+    replace(cleaned.begin(), cleaned.end(), ']', ' ');
+    replace(cleaned.begin(), cleaned.end(), ',', ' ');
+    stringstream stream(cleaned);
+    unsigned value;
+    while(stream >> value) {
+        values.push_back(value);
+    }
+    return values;
+}
+
+static bool parseCpu(const string &text, CPUType_t *cpu) {
+    string name = lower(text);
+    if(name == "x86") { *cpu = X86; return true; }
+    if(name == "arm") { *cpu = ARM; return true; }
+    if(name == "power") { *cpu = POWER; return true; }
+    if(name == "riscv") { *cpu = RISCV; return true; }
+    return false;
+}
+
+static bool parseVm(const string &text, VMType_t *vm) {
+    string name = lower(text);
+    if(name == "linux") { *vm = LINUX; return true; }
+    if(name == "linux_rt") { *vm = LINUX_RT; return true; }
+    if(name == "win") { *vm = WIN; return true; }
+    if(name == "aix") { *vm = AIX; return true; }
+    return false;
+}
+
+static bool parseSla(const string &text, SLAType_t *sla) {
+    string name = lower(text);
+    if(name.size() == 4 && name.compare(0, 3, "sla") == 0 && name[3] >= '0' && name[3] <= '3') {
+        *sla = SLAType_t(name[3] - '0');
+        return true;
+    }
+    return false;
+}
+
+static bool parseYes(const string &text) {
+    string value = lower(text);
+    return value == "yes" || value == "true" || value == "1";
+}
+
+/* Collects the "key: value" lines of one { } block, keys lowercased with spaces squeezed out */
+static bool readBlock(istream &input, map<string, string> *fields, unsigned *line_number) {
+    string line;
+    bool opened = false;
+    while(getline(input, line)) {
+        (*line_number)++;
+        line = trim(line);
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        if(line == "{") {
+            opened = true;
+            continue;
+        }
+        if(line == "}") {
+            return opened;
+        }
+        size_t colon = line.find(':');
+        if(!opened || colon == string::npos) {
+            return false;
+        }
+        string key;
+        for(char c: lower(line.substr(0, colon))) {
+            if(!isspace(c)) {
+                key += c;
+            }
+        }
+        (*fields)[key] = trim(line.substr(colon + 1));
+    }
+    return false;
+}
+
+static bool buildMachineClass(map<string, string> &fields, MachineClass_t *machines) {
+    machines->count = stoul(fields["numberofmachines"]);
+    machines->num_cpus = stoul(fields["numberofcores"]);
+    machines->memory = stoul(fields["memory"]);
+    machines->gpus = parseYes(fields["gpus"]);
+    machines->s_states = parseList(fields["s-states"]);
+    machines->p_states = parseList(fields["p-states"]);
+    machines->c_states = parseList(fields["c-states"]);
+    machines->performance = parseList(fields["mips"]);
+    if(!parseCpu(fields["cputype"], &machines->cpu)) {
+        return false;
+    }
+    return machines->s_states.size() == 7 && machines->p_states.size() == 4 && machines->c_states.size() == 4
+        && machines->performance.size() == 4;
+}
+
+static bool buildTaskClass(map<string, string> &fields, TaskClass_t *tasks) {
+    tasks->start = stoull(fields["starttime"]);
+    tasks->end = stoull(fields["endtime"]);
+    tasks->inter_arrival = stoull(fields["interarrival"]);
+    tasks->runtime = stoull(fields["expectedruntime"]);
+    tasks->memory = stoul(fields["memory"]);
+    tasks->gpu = parseYes(fields["gpuenabled"]);
+    tasks->seed = fields.count("seed") ? stoull(fields["seed"]) : 0;
+    return parseVm(fields["vmtype"], &tasks->vm) && parseSla(fields["slatype"], &tasks->sla)
+        && parseCpu(fields["cputype"], &tasks->cpu) && tasks->inter_arrival > 0;
+}
+
+/* Uniform double in [0, 1) from the top 53 bits, the same on every platform */
+static double unitDraw(mt19937_64 &random) {
+    return (random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void emitTasks(const TaskClass_t &tasks, unsigned reference_mips, vector<TaskSpec_t> *specs) {
+    mt19937_64 random(tasks.seed);
+    double time = tasks.start;
+    while(time < tasks.end) {
+        double runtime = tasks.runtime * (0.75 + 0.5 * unitDraw(random));
+        TaskSpec_t spec;
+        spec.arrival = Time_t(time);
+        spec.instructions = uint64_t(runtime * reference_mips);
+        spec.target_completion = spec.arrival + Time_t(runtime * slaSlack[tasks.sla]);
+        spec.memory = tasks.memory;
+        spec.cpu = tasks.cpu;
+        spec.vm = tasks.vm;
+        spec.sla = tasks.sla;
+        spec.gpu = tasks.gpu;
+        specs->push_back(spec);
+        time += -log(1.0 - unitDraw(random)) * tasks.inter_arrival;
+    }
+}
+
+bool LoadTextWorkload(const string &path, Workload_t *workload) {
+    ifstream input(path);
+    if(!input) {
+        cerr << "Cannot open workload " << path << endl;
+        return false;
+    }
+    vector<TaskClass_t> taskClasses;
+    string line;
+    unsigned line_number = 0;
+    while(getline(input, line)) {
+        line_number++;
+        string header = lower(trim(line));
+        if(header.empty() || header[0] == '#') {
+            continue;
+        }
+        map<string, string> fields;
+        bool ok = readBlock(input, &fields, &line_number);
+        try {
+            if(ok && header == "machine class:") {
+                MachineClass_t machines;
+                ok = buildMachineClass(fields, &machines);
+                workload->machines.push_back(machines);
+            } else if(ok && header == "task class:") {
+                TaskClass_t tasks;
+                ok = buildTaskClass(fields, &tasks);
+                taskClasses.push_back(tasks);
+            } else {
+                ok = false;
+            }
+        } catch(const exception &) {
+            ok = false;
+        }
+        if(!ok) {
+            cerr << path << ":" << line_number << ": malformed block" << endl;
+            return false;
+        }
+    }
+
+    /* Expected runtimes are quoted for the P0 speed of the first machine class of the task's CPU type */
+    TextWorkloadSource *source = new TextWorkloadSource();
+    for(const TaskClass_t &tasks: taskClasses) {
+        unsigned reference_mips = 1000;
+        for(const MachineClass_t &machines: workload->machines) {
+            if(machines.cpu == tasks.cpu) {
+                reference_mips = machines.performance[0];
+                break;
+            }
+        }
+        emitTasks(tasks, reference_mips, &source->specs);
+    }
+    stable_sort(source->specs.begin(), source->specs.end(), [](const TaskSpec_t &a, const TaskSpec_t &b) {
+        return a.arrival < b.arrival;
+    });
+    workload->tasks = source;
+    return true;
+}
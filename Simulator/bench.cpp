@@ -0,0 +1,276 @@
+//
+//  bench.cpp
+//  CloudSim
+//
+//  Placement microbenchmarks, linked against one scheduler at a time:
+//
+//      bench_<algorithm> [-m 1000,10000,100000] [-k calls] [-o results.json]
+//
+//  For each cluster size the run builds a synthetic heterogeneous cluster (four CPU types, GPU and
+//  non-GPU classes), warms it up through the simulator until every machine carries about two
+//  tasks, then times the scheduler's entry points from Interfaces.h one call at a time. Each size
+//  runs in its own process because the schedulers keep their state in globals. Results are one
+//  JSON document with per-call mean, p50, p99 and max in nanoseconds.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Scheduler.hpp"
+#include "Simulator.hpp"
+
+#ifndef BENCH_ALGORITHM
+#define BENCH_ALGORITHM "unknown"
+#endif
+
+#define WARMUP_WINDOW 2000000           // us over which the warm-up tasks arrive
+#define TASKS_PER_MACHINE 2
+
+typedef struct {
+    string name;
+    vector<uint64_t> samples;       // ns per call
+} Timing_t;
+
+class VectorSource : public WorkloadSource {
+public:
+    vector<TaskSpec_t> specs;
+    size_t next = 0;
+    bool Next(TaskSpec_t *spec) {
+        if(next == specs.size()) {
+            return false;
+        }
+        *spec = specs[next++];
+        return true;
+    }
+};
+
+static mt19937_64 random64(20241020);
+
+static unsigned draw(unsigned bound) {
+    return random64() % bound;
+}
+
+/* Two classes per CPU type, one of them with GPUs, sized and powered differently */
+static void syntheticCluster(unsigned total, vector<MachineClass_t> *classes) {
+    static const CPUType_t cpus[] = {X86, ARM, POWER, RISCV};
+    static const unsigned cores[] = {8, 16, 32, 64};
+    for(unsigned i = 0; i < 8; i++) {
+        MachineClass_t machines;
+        machines.count = total / 8 + (i < total % 8);
+        machines.cpu = cpus[i / 2];
+        machines.num_cpus = cores[(i + i / 2) % 4];
+        machines.memory = 16384 << (i % 3);
+        machines.gpus = i % 2;
+        unsigned scale = 1 + i % 3;
+        machines.s_states = {120 * scale, 100 * scale, 100 * scale, 80 * scale, 40 * scale, 10 * scale, 0};
+        machines.p_states = {12 * scale, 8 * scale, 6 * scale, 4 * scale};
+        machines.c_states = {12 * scale, 3 * scale, 1 * scale, 0};
+        machines.performance = {1000 + 200 * i, 800 + 150 * i, 600 + 100 * i, 400 + 50 * i};
+        classes->push_back(machines);
+    }
+}
+
+static TaskSpec_t syntheticTask(Time_t arrival, const vector<MachineClass_t> &classes) {
+    TaskSpec_t spec;
+    const MachineClass_t &machines = classes[draw(classes.size())];
+    Time_t runtime = 60000000 + draw(60000000);
+    spec.arrival = arrival;
+    spec.instructions = runtime * machines.performance[0];
+    spec.sla = SLAType_t(draw(4));
+    spec.target_completion = arrival + runtime * (2 + spec.sla);
+    spec.memory = 256 << draw(4);
+    spec.cpu = machines.cpu;
+    spec.vm = draw(4) ? LINUX : LINUX_RT;
+    spec.gpu = draw(4) == 0;
+    return spec;
+}
+
+static uint64_t elapsedNs(chrono::steady_clock::time_point start) {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+}
+
+#define TIME_CALL(timing, call) do { \
+        auto start = chrono::steady_clock::now(); \
+        call; \
+        (timing).samples.push_back(elapsedNs(start)); \
+    } while(0)
+
+static string summarize(const Timing_t &timing) {
+    vector<uint64_t> sorted = timing.samples;
+    sort(sorted.begin(), sorted.end());
+    uint64_t total = 0;
+    for(uint64_t sample: sorted) {
+        total += sample;
+    }
+    size_t count = sorted.size();
+    stringstream json;
+    json << "{\"name\": \"" << timing.name << "\", \"calls\": " << count
+         << ", \"mean_ns\": " << total / count
+         << ", \"p50_ns\": " << sorted[count / 2]
+         << ", \"p99_ns\": " << sorted[min(count - 1, count * 99 / 100)]
+         << ", \"max_ns\": " << sorted.back() << "}";
+    return json.str();
+}
+
+/* One cluster size, from warm-up to the last callback. Returns the JSON object for the size */
+static string benchSize(unsigned size, unsigned calls) {
+    VectorSource source;
+    Workload_t workload;
+    syntheticCluster(size, &workload.machines);
+    unsigned warmup = size * TASKS_PER_MACHINE;
+    for(unsigned i = 0; i < warmup; i++) {
+        source.specs.push_back(syntheticTask(Time_t(i) * WARMUP_WINDOW / warmup, workload.machines));
+    }
+    workload.tasks = &source;
+    SimConfig_t config = {0, 100000, UINT64_MAX / 2};
+
+    vector<Timing_t> timings;
+    Timing_t init = {"InitScheduler", {}};
+    TIME_CALL(init, StartSimulation(workload, config));
+    timings.push_back(init);
+    RunUntil(WARMUP_WINDOW + 100000);
+
+    unsigned machines = Machine_GetTotal();
+    vector<TaskId_t> running;
+    RunningTasks(&running);
+    shuffle(running.begin(), running.end(), random64);
+    Time_t now = Now();
+
+    /* Each callback runs against the state the previous ones left */
+    Timing_t newTask = {"NewTask", {}};
+    for(unsigned i = 0; i < calls; i++) {
+        TaskId_t task_id = InjectTask(syntheticTask(now, workload.machines));
+        TIME_CALL(newTask, HandleNewTask(now, task_id));
+    }
+    timings.push_back(newTask);
+
+    Timing_t taskComplete = {"TaskComplete", {}};
+    for(unsigned i = 0; i < calls && i < running.size(); i++) {
+        if(RetireTask(running[i])) {
+            TIME_CALL(taskComplete, HandleTaskCompletion(now, running[i]));
+        }
+    }
+    if(!taskComplete.samples.empty()) {
+        timings.push_back(taskComplete);
+    }
+
+    RunningTasks(&running);
+    shuffle(running.begin(), running.end(), random64);
+    Timing_t slaWarning = {"SLAWarning", {}};
+    for(unsigned i = 0; i < calls && i < running.size(); i++) {
+        TIME_CALL(slaWarning, SLAWarning(now, running[i]));
+    }
+    if(!slaWarning.samples.empty()) {
+        timings.push_back(slaWarning);
+    }
+
+    Timing_t memoryWarning = {"MemoryWarning", {}};
+    for(unsigned i = 0; i < calls; i++) {
+        TIME_CALL(memoryWarning, MemoryWarning(now, draw(machines)));
+    }
+    timings.push_back(memoryWarning);
+
+    Timing_t periodicCheck = {"PeriodicCheck", {}};
+    for(unsigned i = 0; i < calls / 10 + 1; i++) {
+        now += config.check_period;
+        RunUntil(now);
+        TIME_CALL(periodicCheck, SchedulerCheck(now));
+    }
+    timings.push_back(periodicCheck);
+
+    stringstream json;
+    json << "{\"machines\": " << size << ", \"warmup_tasks\": " << warmup << ", \"timings\": [";
+    for(unsigned i = 0; i < timings.size(); i++) {
+        json << (i ? ", " : "") << summarize(timings[i]);
+    }
+    json << "]}";
+    return json.str();
+}
+
+/* Runs one size in a child process and reads back its JSON */
+static bool forkSize(unsigned size, unsigned calls, string *json) {
+    int pipeEnds[2];
+    if(pipe(pipeEnds) != 0) {
+        return false;
+    }
+    pid_t child = fork();
+    if(child == 0) {
+        close(pipeEnds[0]);
+        if(freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(1);
+        }
+        string result = benchSize(size, calls);
+        bool ok = write(pipeEnds[1], result.data(), result.size()) == ssize_t(result.size());
+        _exit(ok ? 0 : 1);
+    }
+    close(pipeEnds[1]);
+    char buffer[4096];
+    ssize_t read_bytes;
+    while((read_bytes = read(pipeEnds[0], buffer, sizeof(buffer))) > 0) {
+        json->append(buffer, read_bytes);
+    }
+    close(pipeEnds[0]);
+    int status;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 && !json->empty();
+}
+
+int main(int argc, char **argv) {
+    vector<unsigned> sizes = {1000, 10000, 100000};
+    unsigned calls = 1000;
+    string output;
+    int option;
+    while((option = getopt(argc, argv, "m:k:o:")) != -1) {
+        switch(option) {
+            case 'm': {
+                sizes.clear();
+                stringstream list(optarg);
+                string item;
+                while(getline(list, item, ',')) {
+                    sizes.push_back(strtoul(item.c_str(), NULL, 10));
+                }
+                break;
+            }
+            case 'k':
+                calls = strtoul(optarg, NULL, 10);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                cerr << "usage: " << argv[0] << " [-m sizes] [-k calls] [-o results.json]" << endl;
+                return 2;
+        }
+    }
+
+    stringstream json;
+    json << "{\"algorithm\": \"" << BENCH_ALGORITHM << "\", \"calls\": " << calls << ", \"sizes\": [";
+    bool ok = true;
+    bool first = true;
+    for(unsigned size: sizes) {
+        string result;
+        if(size == 0 || !forkSize(size, calls, &result)) {
+            cerr << BENCH_ALGORITHM << ": benchmark at " << size << " machines failed" << endl;
+            ok = false;
+            continue;
+        }
+        json << (first ? "" : ", ") << result;
+        first = false;
+    }
+    json << "]}" << endl;
+
+    if(output.empty()) {
+        cout << json.str();
+    } else {
+        FILE *file = fopen(output.c_str(), "w");
+        ok = file != NULL && fputs(json.str().c_str(), file) >= 0 && fclose(file) == 0 && ok;
+    }
+    return ok ? 0 : 1;
+}
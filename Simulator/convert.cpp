@@ -0,0 +1,24 @@
+//
+//  convert.cpp
+//  CloudSim
+//
+//  workload_convert <text workload> <binary workload>
+//
+//  Expands a text workload into the columnar binary format so long replays skip the parse.
+//
+
+#include "Simulator.hpp"
+
+int main(int argc, char **argv) {
+    if(argc != 3) {
+        cerr << "usage: " << argv[0] << " <text workload> <binary workload>" << endl;
+        return 2;
+    }
+    Workload_t workload;
+    if(!LoadTextWorkload(argv[1], &workload)) {
+        return 1;
+    }
+    bool ok = WriteBinaryWorkload(argv[2], workload);
+    delete workload.tasks;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+//
+//  main.cpp
+//  CloudSim
+//
+//  simulator -i <workload> [-v verbosity] [-p check period in us] [-d drain limit in us]
+//
+//  The workload may be in the text format or the binary format written by workload_convert.
+//
+
+#include <cstdlib>
+#include <unistd.h>
+
+#include "Simulator.hpp"
+
+static void usage(const char *program) {
+    cerr << "usage: " << program << " -i <workload> [-v verbosity] [-p check period] [-d drain limit]" << endl;
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    string input;
+    SimConfig_t config = {0, 100000, 3600000000ULL};
+    int option;
+    while((option = getopt(argc, argv, "i:v:p:d:")) != -1) {
+        switch(option) {
+            case 'i':
+                input = optarg;
+                break;
+            case 'v':
+                config.verbosity = strtoul(optarg, NULL, 10);
+                break;
+            case 'p':
+                config.check_period = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                config.drain_limit = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if(input.empty() || config.check_period == 0) {
+        usage(argv[0]);
+    }
+
+    Workload_t workload;
+    bool loaded = IsBinaryWorkload(input) ? LoadBinaryWorkload(input, &workload) : LoadTextWorkload(input, &workload);
+    if(!loaded) {
+        return 1;
+    }
+    RunSimulation(workload, config);
+    delete workload.tasks;
+    return 0;
+}
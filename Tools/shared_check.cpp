@@ -0,0 +1,131 @@
+//
+//  shared_check.cpp
+//  Checks that the code the Scheduler.cpp files share has not drifted apart
+//
+//  Build: g++ -std=c++17 -O2 -o shared_check shared_check.cpp
+//
+//  shared_check <Scheduler.cpp>...       exits 1 at the first shared block that differs
+//
+//  Each algorithm has to stay one self-contained Scheduler.cpp for the course simulator, so the
+//  code they have in common is copied into each of them between
+//      /* SHARED BEGIN <name> */
+//      /* SHARED END <name> */
+//  lines. Every file that has a block of some name must have it byte for byte the same
+//
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define BEGIN_MARK "/* SHARED BEGIN "
+#define END_MARK "/* SHARED END "
+
+typedef struct {
+    string file;
+    unsigned line;          // of the BEGIN marker
+    vector<string> text;
+} Block_t;
+
+/* Name between the marker and the closing comment, empty when the line isn't that marker */
+string markerName(const string &line, const char *mark) {
+    string prefix(mark);
+    if(line.compare(0, prefix.size(), prefix) != 0 || line.size() < prefix.size() + 3) {
+        return "";
+    }
+    if(line.compare(line.size() - 3, 3, " */") != 0) {
+        return "";
+    }
+    return line.substr(prefix.size(), line.size() - prefix.size() - 3);
+}
+
+bool readBlocks(const char *path, map<string, vector<Block_t>> *blocks) {
+    ifstream in(path);
+    if(!in) {
+        cerr << path << ": cannot open" << endl;
+        return false;
+    }
+    map<string, bool> seen;
+    string line;
+    string open;
+    Block_t block;
+    unsigned number = 0;
+    while(getline(in, line)) {
+        number++;
+        string begin = markerName(line, BEGIN_MARK);
+        string end = markerName(line, END_MARK);
+        if(!begin.empty()) {
+            if(!open.empty()) {
+                cerr << path << ":" << number << ": " << begin << " begins inside " << open << endl;
+                return false;
+            }
+            if(seen[begin]) {
+                cerr << path << ":" << number << ": " << begin << " appears twice" << endl;
+                return false;
+            }
+            seen[begin] = true;
+            open = begin;
+            block = Block_t();
+            block.file = path;
+            block.line = number;
+        } else if(!end.empty()) {
+            if(end != open) {
+                cerr << path << ":" << number << ": " << end << " ends but " << (open.empty() ? "no block" : open) << " is open" << endl;
+                return false;
+            }
+            (*blocks)[open].push_back(block);
+            open.clear();
+        } else if(!open.empty()) {
+            block.text.push_back(line);
+        }
+    }
+    if(!open.empty()) {
+        cerr << path << ": " << open << " never ends" << endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        cerr << "usage: shared_check <Scheduler.cpp>..." << endl;
+        return 2;
+    }
+    map<string, vector<Block_t>> blocks;
+    for(int i = 1; i < argc; i++) {
+        if(!readBlocks(argv[i], &blocks)) {
+            return 1;
+        }
+    }
+
+    /* Every copy against the first one, reporting the first line where they part */
+    bool same = true;
+    for(auto & named: blocks) {
+        const Block_t &first = named.second[0];
+        for(unsigned b = 1; b < named.second.size(); b++) {
+            const Block_t &other = named.second[b];
+            unsigned n = min(first.text.size(), other.text.size());
+            unsigned at = 0;
+            while(at < n && first.text[at] == other.text[at]) {
+                at++;
+            }
+            if(at == n && first.text.size() == other.text.size()) {
+                continue;
+            }
+            same = false;
+            cerr << named.first << " differs: " << first.file << ":" << first.line + at + 1 << " and "
+                 << other.file << ":" << other.line + at + 1 << endl;
+            cerr << "  " << (at < first.text.size() ? first.text[at] : "(block ends)") << endl;
+            cerr << "  " << (at < other.text.size() ? other.text[at] : "(block ends)") << endl;
+        }
+    }
+    if(!same) {
+        return 1;
+    }
+    cout << blocks.size() << " shared blocks identical across " << argc - 1 << " files" << endl;
+    return 0;
+}
@@ -0,0 +1,199 @@
+//
+//  trace_reader.cpp
+//  Reads the decision traces written by the schedulers when SCHED_TRACE is set
+//
+//  Build: g++ -std=c++17 -O2 -o trace_reader trace_reader.cpp
+//
+//  trace_reader dump <trace>             one line per decision
+//  trace_reader summary <trace>          decision counts by kind and reason
+//  trace_reader diff <trace> <trace>     counts side by side and the first decision where the runs part
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Must match the layout in the Scheduler.cpp files */
+#define TRACE_VERSION 1
+#define TRACE_NONE UINT32_MAX
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    char algorithm[16];
+} TraceHeader_t;
+
+typedef struct {
+    uint64_t time;
+    uint32_t machine;
+    uint32_t vm;
+    uint32_t task;
+    uint32_t arg;
+    uint8_t kind;
+    uint8_t reason;
+    uint8_t reserved[6];
+} TraceRecord_t;
+static_assert(sizeof(TraceRecord_t) == 32, "trace records are 32 bytes");
+
+#define NUM_KINDS 6
+#define NUM_REASONS 13
+const char *kindNames[NUM_KINDS] = {"place", "migrate", "set_state", "set_perf", "vm_attach", "vm_shutdown"};
+const char *reasonNames[NUM_REASONS] = {"init", "place", "fallback", "memory_warning", "sla_warning", "consolidate",
+                                        "idle", "demand", "governor", "reclaim", "shutdown", "forecast", "slack"};
+#define NUM_S_STATES 7
+const char *stateNames[NUM_S_STATES] = {"S0", "S0i1", "S1", "S2", "S3", "S4", "S5"};
+
+typedef struct {
+    string algorithm;
+    vector<TraceRecord_t> records;
+} Trace_t;
+
+bool loadTrace(const char *path, Trace_t *trace) {
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        cerr << "Cannot open " << path << endl;
+        return false;
+    }
+    TraceHeader_t header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "SCHTRACE", 8) != 0) {
+        cerr << path << " is not a scheduler trace" << endl;
+        fclose(file);
+        return false;
+    }
+    if(header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord_t)) {
+        cerr << path << " has trace version " << header.version << ", expected " << TRACE_VERSION << endl;
+        fclose(file);
+        return false;
+    }
+    header.algorithm[sizeof(header.algorithm) - 1] = '\0';
+    trace->algorithm = header.algorithm;
+
+    TraceRecord_t chunk[4096];
+    size_t read;
+    while((read = fread(chunk, sizeof(TraceRecord_t), 4096, file)) > 0) {
+        trace->records.insert(trace->records.end(), chunk, chunk + read);
+    }
+    fclose(file);
+    return true;
+}
+
+string field(uint32_t value) {
+    return (value == TRACE_NONE) ? "-" : to_string(value);
+}
+
+string describe(const TraceRecord_t &record) {
+    string kind = (record.kind < NUM_KINDS) ? kindNames[record.kind] : to_string(record.kind);
+    string reason = (record.reason < NUM_REASONS) ? reasonNames[record.reason] : to_string(record.reason);
+    string line = to_string(record.time) + " " + kind + " " + reason + " machine " + field(record.machine)
+                + " vm " + field(record.vm) + " task " + field(record.task);
+    switch(record.kind) {
+        case 1:
+            return line + " from " + to_string(record.arg);
+        case 2:
+            return line + " " + ((record.arg < NUM_S_STATES) ? string(stateNames[record.arg]) : "S?" + to_string(record.arg));
+        case 3:
+            return line + " P" + to_string(record.arg);
+        default:
+            return line + " type " + to_string(record.arg);
+    }
+}
+
+void countDecisions(const Trace_t &trace, vector<uint64_t> *counts) {
+    counts->assign(NUM_KINDS * NUM_REASONS, 0);
+    for(const TraceRecord_t &record: trace.records) {
+        if(record.kind < NUM_KINDS && record.reason < NUM_REASONS) {
+            (*counts)[record.kind * NUM_REASONS + record.reason]++;
+        }
+    }
+}
+
+bool sameDecision(const TraceRecord_t &a, const TraceRecord_t &b) {
+    return a.time == b.time && a.machine == b.machine && a.vm == b.vm && a.task == b.task
+        && a.arg == b.arg && a.kind == b.kind && a.reason == b.reason;
+}
+
+int dump(const Trace_t &trace) {
+    cout << "# " << trace.algorithm << ", " << trace.records.size() << " decisions" << endl;
+    for(const TraceRecord_t &record: trace.records) {
+        cout << describe(record) << endl;
+    }
+    return 0;
+}
+
+int summary(const Trace_t &trace) {
+    vector<uint64_t> counts;
+    countDecisions(trace, &counts);
+    cout << trace.algorithm << ": " << trace.records.size() << " decisions";
+    if(!trace.records.empty()) {
+        cout << " from " << trace.records.front().time << " to " << trace.records.back().time;
+    }
+    cout << endl;
+    for(unsigned i = 0; i < counts.size(); i++) {
+        if(counts[i] != 0) {
+            cout << "  " << kindNames[i / NUM_REASONS] << "/" << reasonNames[i % NUM_REASONS] << ": " << counts[i] << endl;
+        }
+    }
+    return 0;
+}
+
+int diff(const Trace_t &a, const Trace_t &b) {
+    vector<uint64_t> countsA;
+    vector<uint64_t> countsB;
+    countDecisions(a, &countsA);
+    countDecisions(b, &countsB);
+    cout << "decision" << "\t" << a.algorithm << "\t" << b.algorithm << endl;
+    for(unsigned i = 0; i < countsA.size(); i++) {
+        if(countsA[i] != 0 || countsB[i] != 0) {
+            cout << kindNames[i / NUM_REASONS] << "/" << reasonNames[i % NUM_REASONS] << "\t" << countsA[i] << "\t" << countsB[i] << endl;
+        }
+    }
+
+    size_t common = min(a.records.size(), b.records.size());
+    for(size_t i = 0; i < common; i++) {
+        if(!sameDecision(a.records[i], b.records[i])) {
+            cout << "first difference at decision " << i << endl;
+            cout << "  < " << describe(a.records[i]) << endl;
+            cout << "  > " << describe(b.records[i]) << endl;
+            return 1;
+        }
+    }
+    if(a.records.size() != b.records.size()) {
+        cout << "traces agree for " << common << " decisions, then one of them ends" << endl;
+        return 1;
+    }
+    cout << "traces are identical" << endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 3) {
+        cerr << "usage: trace_reader dump|summary <trace>" << endl;
+        cerr << "       trace_reader diff <trace> <trace>" << endl;
+        return 2;
+    }
+    string mode = argv[1];
+    Trace_t first;
+    if(!loadTrace(argv[2], &first)) {
+        return 2;
+    }
+    if(mode == "dump") {
+        return dump(first);
+    }
+    if(mode == "summary") {
+        return summary(first);
+    }
+    if(mode == "diff" && argc >= 4) {
+        Trace_t second;
+        if(!loadTrace(argv[3], &second)) {
+            return 2;
+        }
+        return diff(first, second);
+    }
+    cerr << "unknown mode " << mode << endl;
+    return 2;
+}